@@ -43,6 +43,28 @@ void   jsb_strip(jsb_t *);
 
 int    jsb_equals(jsb_t*, jsb_t*);
 
+#ifndef JSB_READ_BLOCK
+#define JSB_READ_BLOCK 1048576
+#endif
+
+/*
+ * Reads lines from a FILE in blocks of JSB_READ_BLOCK bytes. A line is a
+ * span of the block, newline included, valid until the next call; NUL
+ * bytes are part of it. Only a last line without a newline is followed by
+ * a NUL. The block buffer is reused, growing only for longer lines.
+ */
+typedef struct {
+    FILE  *fp;
+    jsb_t  buf;
+    size_t pos;     // start of the next line in buf
+    size_t scan;    // bytes from pos known to hold no newline
+    int    eof;
+} jsb_reader_t;
+
+void   jsb_reader_init(jsb_reader_t *, FILE *);
+void   jsb_reader_clean(jsb_reader_t *);
+int    jsb_reader_getline(jsb_reader_t *, const char **line, size_t *size);
+
 #define jsb_space(sb) ((sb)->data + (sb)->size)
 #define jsb_space_size(sb) ((sb)->alloc_size + (sb)->size)
 #define jsb_last_char(sb) ((sb)->data[(sb)->size-1])
@@ -24,6 +24,9 @@ typedef void (*jsh_free_entry)(void *, void *);
 void jsh_free_ex(jsh_t *, jsh_free_entry);
 
 int jsh_put(jsh_t *, const void *key, const void *value);
+// Adds a key known not to be in the table, with a hash from jsh_hash()
+int jsh_put_new(jsh_t *, uint32_t hash, const void *key, const void *value);
+uint32_t jsh_hash(jsh_t *, const void *key);
 void *jsh_get(jsh_t *, const void *key);
 int jsh_exists(jsh_t *, const void *key);
 int jsh_remove(jsh_t *, const void *key);
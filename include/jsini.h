@@ -37,6 +37,8 @@ extern "C" {
 
 // Parser options
 #define JSINI_COMMENT           1
+#define JSINI_PACK_ARRAYS       2 // store homogeneous numeric arrays packed
+#define JSINI_NO_LINENO         4 // skip line counting; nodes get lineno 0
 
 // Options
 #define JSINI_PRETTY_PRINT      1
@@ -48,16 +50,60 @@ extern "C" {
 #define JSINI_CSV_TAB           1 // default comma
 #define JSINI_CSV_HEADER        2
 #define JSINI_CSV_DOUBLE_QUOTE  4
+#define JSINI_CSV_PARALLEL      8 // mmap the file and parse slices on worker threads
+#define JSINI_CSV_INFER_TYPES   16 // unquoted numbers, true, false and null are typed
+#define JSINI_CSV_INFER_COLUMNS 32 // also fix a type per column from the first records
 #define JSINI_CSV_DEFAULT (JSINI_CSV_HEADER | JSINI_CSV_DOUBLE_QUOTE)
 
+// Records sampled for JSINI_CSV_INFER_COLUMNS
+#ifndef JSINI_CSV_INFER_ROWS
+#define JSINI_CSV_INFER_ROWS    100
+#endif
+
+// Key stats options
+#define JSINI_STATS_VALUES      1 // also profile the values found at each path
+#define JSINI_STATS_SAMPLED     2 // print confidence intervals of the ratios
+
+// Sizes of the value profile sketches
+#define JSINI_STATS_TOP_K       8   // counters of the top values sketch
+#define JSINI_STATS_TOP_TEXT    32  // bytes kept of a top value, NUL included
+#define JSINI_STATS_SPARSE      64  // distinct values counted exactly
+#define JSINI_STATS_HLL_BITS    10  // 1024 registers past that, about 3% error
+#define JSINI_STATS_LENGTHS     16  // string length buckets
+
 #include <stdint.h>
 #include <stdio.h>
 #include <limits.h>
 
+// Builds defining JSINI_OMIT_LINENO drop the line number from every node and
+// always parse as if JSINI_NO_LINENO was given.
+#ifdef JSINI_OMIT_LINENO
 #define JSINI_VALUE_FIELDS      \
     uint8_t         type;       \
     uint8_t         lang;       \
+    uint8_t         packed;
+#define jsini_lineno(v)         0
+#define jsini_set_lineno(v,n)   ((void)(n))
+#else
+#define JSINI_VALUE_FIELDS      \
+    uint8_t         type;       \
+    uint8_t         lang;       \
+    uint8_t         packed;     \
     uint32_t        lineno;
+#define jsini_lineno(v)         (((const jsini_value_t*)(v))->lineno)
+#define jsini_set_lineno(v,n)   (((jsini_value_t*)(v))->lineno = (uint32_t)(n))
+#endif
+
+// Packed arrays keep raw 64-bit element values in the jsa_t items instead of
+// pointers to boxed nodes, which needs pointer-sized items of 64 bits.
+#if UINTPTR_MAX >= UINT64_MAX
+#define JSINI_HAVE_PACKED       1
+#endif
+
+// Tagged values share that layout, so they are left out of other builds
+#if defined(JSINI_TAGGED_VALUES) && !defined(JSINI_HAVE_PACKED)
+#undef JSINI_TAGGED_VALUES
+#endif
 
 typedef struct {
     JSINI_VALUE_FIELDS
@@ -83,11 +129,28 @@ typedef struct {
     jsb_t           data;
 } jsini_string_t;
 
+/*
+ * When `packed` is non-zero it holds the element type (JSINI_TBOOL,
+ * JSINI_TINTEGER, JSINI_TNUMBER or JSINI_TSTRING) and `data` holds the raw
+ * values instead of node pointers. Pushing or setting a value of another type
+ * promotes the array back to boxed nodes.
+ */
 typedef struct {
     JSINI_VALUE_FIELDS
     jsa_t           data;
 } jsini_array_t;
 
+/*
+ * Layout of an array from jsini_alloc_packed_array(JSINI_TSTRING): item i is
+ * the offset of element i in `blob`, which stores every element followed by
+ * a NUL.
+ */
+typedef struct {
+    JSINI_VALUE_FIELDS
+    jsa_t           data;
+    jsb_t           blob;
+} jsini_string_array_t;
+
 typedef struct {
     jsini_string_t *name;
     jsini_value_t  *value;
@@ -106,10 +169,28 @@ jsini_bool_t    *jsini_alloc_bool(int);
 jsini_integer_t *jsini_alloc_integer(int64_t);
 jsini_number_t  *jsini_alloc_number(double value);
 jsini_array_t   *jsini_alloc_array();
+jsini_array_t   *jsini_alloc_packed_array(uint8_t type);
 jsini_attr_t    *jsini_alloc_attr(jsini_object_t *, jsini_string_t *);
 jsini_object_t  *jsini_alloc_object();
+jsini_object_t  *jsini_alloc_object_ex(uint32_t size); // room for `size` keys
 jsini_string_t  *jsini_alloc_string(const char *data, size_t length);
 
+/*
+ * A string that can name attributes of many objects, such as a CSV header.
+ * Every attribute holds a reference and jsini_free_string() drops one; the
+ * text must not change while it is shared.
+ */
+jsini_string_t  *jsini_alloc_shared_string(const char *data, size_t length);
+jsini_string_t  *jsini_retain_string(jsini_string_t *);
+
+/*
+ * Appends an attribute whose name is not in the object yet, taking a
+ * reference on the shared `name`. `hash` is jsh_hash() of the name text on
+ * any object map.
+ */
+jsini_attr_t    *jsini_add_attr(jsini_object_t *, jsini_string_t *name, uint32_t hash,
+        jsini_value_t *value);
+
 void jsini_free(jsini_value_t *);
 void jsini_free_array(jsini_array_t *array);
 void jsini_free_object(jsini_object_t *object);
@@ -118,9 +199,16 @@ void jsini_free_string(jsini_string_t *js);
 #define jsini_push(a,v) jsini_push_value(a,(jsini_value_t*)v)
 #define jsini_array_size(a) ((a)->data.size)
 #define jsini_array_resize(a,n) jsa_resize(&(a)->data, n)
-#define jsini_aget(a,i) ((jsini_value_t*)jsa_get(&(a)->data,i))
 
-#define jsini_aget_integer(a,i) ((jsini_integer_t*)jsini_aget(a,i))->data
+/*
+ * Element access without unpacking a packed array. These return values, not
+ * lvalues: write with jsini_array_set_*(). Bools read as 1 or 0.
+ */
+#define jsini_atype(a,i) jsini_array_type(a,i)
+#define jsini_aget_bool(a,i) jsini_array_get_bool(a,i)
+#define jsini_aget_integer(a,i) jsini_array_get_integer(a,i)
+#define jsini_aget_number(a,i) jsini_array_get_number(a,i)
+#define jsini_aget_string(a,i) jsini_array_get_string(a,i,NULL)
 
 void jsini_push_null(jsini_array_t *);
 void jsini_push_bool(jsini_array_t*, int);
@@ -129,9 +217,54 @@ void jsini_push_number(jsini_array_t*, double);
 void jsini_push_string(jsini_array_t*, const char *, size_t);
 void jsini_push_value(jsini_array_t*, jsini_value_t *);
 
+/*
+ * A node whose type matches a packed array is copied into it and released,
+ * so it must not be used after jsini_push_value() or jsini_array_set().
+ */
 void jsini_array_set(jsini_array_t*, uint32_t, jsini_value_t*);
+void jsini_array_set_bool(jsini_array_t*, uint32_t, int);
+void jsini_array_set_integer(jsini_array_t*, uint32_t, int64_t);
+void jsini_array_set_number(jsini_array_t*, uint32_t, double);
 void jsini_array_remove(jsini_array_t*, uint32_t);
 
+// Returns a boxed element, unpacking a packed array first
+jsini_value_t *jsini_array_get(jsini_array_t*, uint32_t);
+
+/*
+ * Item `i`, or NULL past the end. A packed array is unpacked in place first,
+ * so this writes to the array: threads sharing one must use the
+ * jsini_aget_*() accessors, which never unpack.
+ */
+static inline jsini_value_t *jsini_aget(jsini_array_t *a, uint32_t i) {
+    if (a->packed) {
+        return jsini_array_get(a, i);
+    }
+    return (jsini_value_t*) jsa_get(&a->data, i);
+}
+uint8_t jsini_array_type(const jsini_array_t*, uint32_t);
+int     jsini_array_get_bool(const jsini_array_t*, uint32_t);
+int64_t jsini_array_get_integer(const jsini_array_t*, uint32_t);
+double  jsini_array_get_number(const jsini_array_t*, uint32_t);
+// NULL unless the element is a string; `size` may be NULL
+const char *jsini_array_get_string(const jsini_array_t*, uint32_t, size_t *size);
+
+/*
+ * Converts an array whose elements are all bools, all integers or all
+ * numbers into the packed form. Packed string arrays can only be created
+ * with jsini_alloc_packed_array(). Returns JSINI_OK if the array is packed
+ * afterwards.
+ */
+int  jsini_array_pack(jsini_array_t*);
+void jsini_array_unpack(jsini_array_t*);
+
+/*
+ * Copies every element of the array into `dst`, which must have room for
+ * jsini_array_size() items. Integers convert to double; anything else is an
+ * error. A packed array of the same type is copied with a single memcpy.
+ */
+int jsini_array_to_int64(const jsini_array_t*, int64_t *dst);
+int jsini_array_to_double(const jsini_array_t*, double *dst);
+
 #define jsini_object_size(o) (jsh_count((o)->map))
 #define jsini_set(o,k,v) jsini_set_value(o,k,(jsini_value_t*)v)
 jsini_attr_t *jsini_attr(jsini_object_t *object, const char *name);
@@ -158,25 +291,127 @@ int jsini_select_integer(const jsini_object_t *object, const char *path);
 const char* jsini_select_string(const jsini_object_t *object, const char *path);
 
 jsini_value_t *jsini_parse_string(const char *s, uint32_t len);
+jsini_value_t *jsini_parse_string_ex(const char *s, uint32_t len, int options);
 jsini_value_t *jsini_parse_string_ini(const char *s, uint32_t len);
 jsini_value_t *jsini_parse_string_jsonl(const char *s, uint32_t len);
 jsini_value_t *jsini_parse_string_csv(const char *s, uint32_t len);
 jsini_value_t *jsini_parse_file(const char *);
+jsini_value_t *jsini_parse_file_ex(const char *, int options);
 #define jsini_parse_object_file(s) ((jsini_object_t*)jsini_parse_file(s))
 jsini_value_t *jsini_parse_file_ini(const char *);
 jsini_value_t *jsini_parse_file_jsonl(const char *);
 
+// Line number (from 1) of the byte at `offset` in `s`, counted on demand
+size_t jsini_offset_lineno(const char *s, size_t offset);
+
 typedef int (*jsini_jsonl_cb)(jsini_value_t *value, void *user_data);
 int jsini_parse_file_jsonl_ex(const char *file, jsini_jsonl_cb cb, void *user_data);
 
+// Same as jsini_parse_file_jsonl_ex() over memory; `s` must end in a newline or a NUL
+int jsini_parse_string_jsonl_ex(const char *s, size_t len, jsini_jsonl_cb cb, void *user_data);
+
+/*
+ * Calls `cb` with the value at `path` (as in jsini_select()) of each record of
+ * a JSONL file, or with NULL when a record has none. Only that value is built;
+ * the objects on the path are skipped through, so a repeated key resolves to
+ * its last value as when the record is parsed. Nothing past the record's
+ * top-level object on the path is read, so a line holds a single record here.
+ */
+int jsini_select_file_jsonl(const char *file, const char *path, jsini_jsonl_cb cb,
+        void *user_data);
+
+// Same as jsini_select_file_jsonl() over memory; `s` must end in a newline or a NUL
+int jsini_select_string_jsonl(const char *s, size_t len, const char *path, jsini_jsonl_cb cb,
+        void *user_data);
+
 int jsini_parse_file_csv_ex(const char *file, int flags, jsini_jsonl_cb cb, void *user_data);
+
+/*
+ * Like jsini_parse_file_csv_ex() but builds only the listed columns, given
+ * as comma-separated header names or 0-based indexes ("id,price,7"). Other
+ * fields are skipped without being copied. Columns keep their file order.
+ * An unknown name is an error; names need JSINI_CSV_HEADER.
+ */
+int jsini_parse_file_csv_select(const char *file, int flags, const char *columns,
+        jsini_jsonl_cb cb, void *user_data);
 jsini_value_t *jsini_parse_file_csv(const char *);
+
+/*
+ * Reads a CSV file column by column: an object of header name to the array
+ * of that column's values, or an array of columns without JSINI_CSV_HEADER.
+ * Each column is packed by the type of its first value, strings included,
+ * and stays packed while the values agree (an integer column becomes a
+ * number column at its first number). JSINI_CSV_PARALLEL is ignored.
+ */
+jsini_value_t *jsini_parse_file_csv_columnar(const char *file, int flags);
 int jsini_print_file_csv(const char *file, const jsini_value_t *value, char delimiter);
 
+/*
+ * Writes CSV one row at a time through a reused buffer. Rows are objects,
+ * written in the order of the columns, or arrays, written as they are. The
+ * columns are the keys of the first object unless set before the first row.
+ * A NULL file writes to stdout. After a row that is neither or a failed
+ * write, every call returns JSINI_ERROR and nothing more is written.
+ */
+typedef struct jsini_csv_writer_t jsini_csv_writer_t;
+jsini_csv_writer_t *jsini_csv_writer_open(const char *file, char delimiter);
+int jsini_csv_writer_columns(jsini_csv_writer_t *, const jsini_array_t *names);
+int jsini_csv_write_row(jsini_csv_writer_t *, const jsini_value_t *row);
+int jsini_csv_writer_close(jsini_csv_writer_t *);
+
+/*
+ * A CSV field as a span of the input. Quotes around the field are not
+ * included; when `quote` is non-zero the span still holds doubled quote
+ * characters and jsini_csv_unescape() gives the actual value.
+ */
+typedef struct {
+    const char *data;
+    uint32_t    size;
+    char        quote;
+    char        quoted;     // the field was enclosed in quotes
+} jsini_csv_field_t;
+
+typedef int (*jsini_csv_record_cb)(const jsini_csv_field_t *fields, uint32_t count,
+        void *user_data);
+
+// Splits CSV text into records of field spans without copying any field
+int  jsini_scan_csv(const char *s, size_t len, int flags, jsini_csv_record_cb cb,
+        void *user_data);
+void jsini_csv_unescape(const jsini_csv_field_t *, jsb_t *);
+
+/*
+ * Row filter tested on raw fields: comparisons of a column, by header name
+ * or 0-based index, with a literal, joined by && and || (&& first):
+ *
+ *     status == "error" || latency > 500 && 3 != x
+ *
+ * A literal that reads as a number compares numerically; a field that is
+ * not a number then fails every operator except !=. Other literals compare
+ * bytes. Names must be bound to a header before matching. Compile returns
+ * NULL on a syntax error; bind returns JSINI_ERROR on an unknown name.
+ */
+typedef struct jsini_csv_filter_t jsini_csv_filter_t;
+jsini_csv_filter_t *jsini_csv_filter_compile(const char *expr);
+int  jsini_csv_filter_bind(jsini_csv_filter_t *, const jsini_array_t *headers);
+int  jsini_csv_filter_match(const jsini_csv_filter_t *, const jsini_csv_field_t *fields,
+        uint32_t count);
+void jsini_csv_filter_free(jsini_csv_filter_t *);
+
+/*
+ * Like jsini_parse_file_csv_select(), passing only the records that match
+ * `filter`. Values are built for matching records only; `filter` is bound
+ * to the file's header as it is read. Either of columns and filter may be
+ * NULL.
+ */
+int jsini_parse_file_csv_filter(const char *file, int flags, const char *columns,
+        jsini_csv_filter_t *filter, jsini_jsonl_cb cb, void *user_data);
+
 void           jsini_print(FILE *, const jsini_value_t *, int options);
 int            jsini_print_file(const char *, const jsini_value_t *, int);
 jsini_value_t *jsini_select(const jsini_object_t *, const char *);
 void jsini_stringify(const jsini_value_t *, jsb_t *, int options, int indent);
+// Same as jsini_stringify() for a value nested `level` deep, e.g. an array item
+void jsini_stringify_real(const jsini_value_t *, jsb_t *, int options, int level, int indent);
 void jsini_write_string(jsb_t *sb, jsb_t *s, int options);
 
 double jsini_cast_double(const jsini_value_t *js);
@@ -195,8 +430,68 @@ int jsini_cast_int(const jsini_value_t *js);
 #define jsini_iter_array(it) ((jsini_array_t*)((jsini_attr_t*) (it)->value)->value)
 #define jsini_iter_object(it) ((jsini_object_t*)((jsini_attr_t*) (it)->value)->value)
 
+#ifdef JSINI_TAGGED_VALUES
+
+/*
+ * Compact tagged values. A jsini_tval_t is an 8-byte word that holds a double
+ * as its IEEE bits (NaNs are canonicalized) or, in the otherwise unused
+ * negative quiet-NaN space 0xfff8..., a 3-bit tag in bits 48-50 over a 48-bit
+ * payload. Null, bools and integers that fit in 48 bits are stored inline;
+ * strings, wider integers, arrays and objects are heap nodes referenced by
+ * the payload. Arrays and attrs hold the words themselves, so a scalar inside
+ * a container costs no allocation.
+ */
+typedef uint64_t jsini_tval_t;
+
+#define JSINI_TVAL_BOX          0xfff8000000000000ULL
+#define JSINI_TVAL_MAKE(tag,p)  (JSINI_TVAL_BOX | ((uint64_t)(tag) << 48) | (p))
+
+#define JSINI_TVAL_NULL         JSINI_TVAL_MAKE(1, 0)
+#define JSINI_TVAL_FALSE        JSINI_TVAL_MAKE(2, 0)
+#define JSINI_TVAL_TRUE         JSINI_TVAL_MAKE(2, 1)
+#define JSINI_TVAL_UNDEFINED    JSINI_TVAL_MAKE(7, 0)
+
+#define jsini_tval_is_double(v) (((v) & JSINI_TVAL_BOX) != JSINI_TVAL_BOX)
+
+typedef struct {
+    jsini_string_t *name;
+    jsini_tval_t    value;
+} jsini_tattr_t;
+
+jsini_tval_t jsini_tval_bool(int);
+jsini_tval_t jsini_tval_integer(int64_t);
+jsini_tval_t jsini_tval_number(double);
+jsini_tval_t jsini_tval_string(const char *data, size_t length);
+jsini_tval_t jsini_tval_array();
+jsini_tval_t jsini_tval_object();
+void         jsini_tval_free(jsini_tval_t);
+
+uint8_t      jsini_tval_type(jsini_tval_t);
+int          jsini_tval_get_bool(jsini_tval_t);
+int64_t      jsini_tval_get_integer(jsini_tval_t);
+double       jsini_tval_get_number(jsini_tval_t);
+const jsb_t *jsini_tval_get_string(jsini_tval_t);
+
+// Arrays and objects; the container takes ownership of values put into it
+uint32_t             jsini_tval_size(jsini_tval_t);
+jsini_tval_t         jsini_tval_aget(jsini_tval_t array, uint32_t);
+int                  jsini_tval_push(jsini_tval_t array, jsini_tval_t value);
+jsini_tval_t         jsini_tval_get(jsini_tval_t object, const char *key);
+int                  jsini_tval_set(jsini_tval_t object, const char *key, jsini_tval_t value);
+const jsini_tattr_t *jsini_tval_attr(jsini_tval_t object, uint32_t);
+
+// Returns JSINI_TVAL_UNDEFINED on a parse error
+jsini_tval_t   jsini_tval_parse_string(const char *s, uint32_t len, int options);
+void           jsini_tval_stringify(jsini_tval_t, jsb_t *, int options, int indent);
+
+// Conversions to and from the classic tree; the source is left untouched
+jsini_tval_t   jsini_tval_from_value(const jsini_value_t *);
+jsini_value_t *jsini_tval_to_value(jsini_tval_t);
+#endif
+
 // Internal
 typedef struct {
+    const char *input_start;
     const char *input;
     const char *input_end;
     size_t      lineno;
@@ -205,24 +500,126 @@ typedef struct {
     int         options;
 } jsl_t;
 
+typedef struct {
+    uint8_t     type;       // JSINI_TNULL, JSINI_TBOOL, JSINI_TINTEGER or JSINI_TNUMBER
+    union {
+        int64_t integer;    // also holds bools
+        double  number;
+    } data;
+} jsl_scalar_t;
+
 void            jsl_init(jsl_t*, const char *, size_t, int);
+size_t          jsl_lineno(const jsl_t *);
 jsini_string_t *jsl_read_attr_name(jsl_t *);
 jsini_string_t *jsl_read_json_string(jsl_t *);
+jsini_string_t *jsl_read_bare_string(jsl_t *);
 jsini_value_t  *jsl_read_primitive(jsl_t *lex);
+int             jsl_scan_primitive(jsl_t *lex, jsl_scalar_t *);
 void            jsl_skip_space(jsl_t *, const char *seps);
 int             jsl_skip_keyword(jsl_t *, const char *, int (*is_break)(int));
 int             jsl_skip_line(jsl_t *lex);
 void            jsini_write_error(jsl_t *, FILE *);
 
+/*
+ * Callbacks of jsl_read_events(). Strings and keys are decoded into the
+ * scratch buffer, so they are NUL-terminated but only valid during the
+ * call. A callback returns JSINI_OK to go on.
+ */
+typedef struct {
+    int (*begin_object)(void *user_data);
+    int (*key)(void *user_data, const char *name, size_t size);
+    int (*end_object)(void *user_data);
+    int (*begin_array)(void *user_data);
+    int (*end_array)(void *user_data);
+    int (*scalar)(void *user_data, const jsl_scalar_t *);
+    int (*string)(void *user_data, const char *data, size_t size);
+} jsl_handler_t;
+
+/*
+ * Reads one value with the grammar of jsini_read_json(), reporting it as
+ * events instead of building nodes. Returns JSINI_OK, the first result of
+ * a callback that is not JSINI_OK, or the JSINI_ERROR_* code in lex->error.
+ */
+int             jsl_read_events(jsl_t *, const jsl_handler_t *, jsb_t *scratch, void *user_data);
+
+/*
+ * Moves past one value with the grammar of jsini_read_json() without
+ * building or decoding it. Returns JSINI_OK or the code in lex->error.
+ */
+int             jsl_skip_value(jsl_t *, jsb_t *scratch);
+
+/*
+ * Moves to the value at `path` (as in jsini_select()) of the value at the
+ * input, skipping the members on the way. Returns 1 when it is there, 0
+ * when it is not, or the code in lex->error. Each object on the path is
+ * skipped to its end, and a repeated key is matched at its last occurrence,
+ * as jsini_read_json() keeps the last value.
+ */
+int             jsl_find_path(jsl_t *, const char *path, jsb_t *scratch);
+
+/*
+ * Builds with JSINI_COUNT_ALLOCS allocate through these, so a benchmark can
+ * count the library's allocation calls, reallocations included. Other builds
+ * call the C allocator directly.
+ */
+#ifdef JSINI_COUNT_ALLOCS
+void   *jsini_counted_malloc(size_t);
+void   *jsini_counted_calloc(size_t, size_t);
+void   *jsini_counted_realloc(void *, size_t);
+size_t  jsini_alloc_count(void);
+#endif
+
 // Utils
 int32_t json_escape_unicode(int32_t ch, char *buffer);
 int32_t json_unescape_unicode(const char *start, const char *end, int32_t *ch);
 int32_t decode_utf8(const char *s, int32_t *ch);
 int32_t encode_utf8(int32_t ch, char *buffer);
 
+typedef struct {
+    uint64_t hash;
+    size_t count;   // never below the true count
+    size_t error;   // count - error is never above it
+    char text[JSINI_STATS_TOP_TEXT];
+} jsini_top_value_t;
+
+/*
+ * Profile of the values found at one path; array elements are profiled at
+ * the path of their array. Distinct values are counted exactly up to
+ * JSINI_STATS_SPARSE and estimated by a HyperLogLog sketch past that, and
+ * the most frequent scalars are tracked by a space-saving sketch, so the
+ * memory used does not grow with the input.
+ */
+typedef struct jsini_value_stats {
+    size_t type_counts[JSINI_TOBJECT + 1];
+    size_t number_count;    // integers and numbers
+    double number_min;
+    double number_max;
+    double number_sum;
+    size_t string_count;
+    size_t length_min;
+    size_t length_max;
+    size_t length_sum;
+    // Bucket 0 counts empty strings and bucket i lengths in [2^(i-1), 2^i);
+    // the last bucket also counts anything longer
+    size_t lengths[JSINI_STATS_LENGTHS];
+    uint32_t sparse_count;
+    uint32_t sparse_alloc;
+    uint64_t *sparse;       // hashes of the distinct values so far
+    uint8_t *registers;     // replaces `sparse` once it overflows
+    uint32_t top_count;
+    jsini_top_value_t top[JSINI_STATS_TOP_K];
+} jsini_value_stats_t;
+
+jsini_value_stats_t* jsini_alloc_value_stats();
+void jsini_free_value_stats(jsini_value_stats_t*);
+void jsini_merge_value_stats(jsini_value_stats_t* dst, const jsini_value_stats_t* src);
+// Exact up to JSINI_STATS_SPARSE distinct values, estimated past that
+double jsini_value_stats_distinct(const jsini_value_stats_t*);
+
 typedef struct jsini_key_stats {
     size_t object_count;
     jsh_t *key_frequencies; // key -> occurrence count
+    jsini_value_stats_t *values; // NULL unless collected with JSINI_STATS_VALUES
 } jsini_key_stats_t;
 
 jsini_key_stats_t* jsini_alloc_key_stats();
@@ -238,9 +635,42 @@ typedef jsh_t jsini_key_stats_map_t;
  */
 void jsini_collect_key_stats(jsini_value_t* value, jsini_key_stats_map_t* stats);
 
+/**
+ * Collects key statistics without building path strings: keys and paths
+ * are interned into integer ids and counted in flat arrays, so adding a
+ * value allocates nothing once its keys and paths have been seen. Flush
+ * adds the counts so far into a key statistics map.
+ */
+typedef struct jsini_key_stats_collector jsini_key_stats_collector_t;
+jsini_key_stats_collector_t* jsini_key_stats_collector_create();
+/*
+ * With JSINI_STATS_VALUES the values at every path are profiled too, and
+ * flush also creates entries for paths that only held scalars, with no
+ * key_frequencies.
+ */
+jsini_key_stats_collector_t* jsini_key_stats_collector_create_ex(uint32_t flags);
+void jsini_key_stats_collector_add(jsini_key_stats_collector_t*, jsini_value_t* value);
+/*
+ * Counts the values in JSON text, such as a JSONL line, straight from the
+ * lexer without building them. Returns the number of values read, or a
+ * JSINI_ERROR_* code after writing the error to stderr. The values before
+ * the broken one stay counted; nothing of the broken one is.
+ */
+int  jsini_key_stats_collector_add_json(jsini_key_stats_collector_t*, const char* s, size_t len);
+void jsini_key_stats_collector_flush(jsini_key_stats_collector_t*, jsini_key_stats_map_t* stats);
+void jsini_key_stats_collector_free(jsini_key_stats_collector_t*);
+
+/**
+ * Adds the statistics of `src` into `dst`, leaving `src` unchanged. Maps
+ * collected from parts of the input merge into the same statistics as one
+ * map collected from all of it.
+ */
+void jsini_merge_key_stats(jsini_key_stats_map_t* dst, jsini_key_stats_map_t* src);
+
 /**
  * Prints the collected key statistics in a human-readable format to the
- * specified file stream.
+ * specified file stream. Paths with a value profile are followed by lines
+ * for their types, numbers, string lengths, distinct and top values.
  * @param out Output file stream
  * @param stats Key statistics map
  * @param max_level Maximum depth level to print (0 = root only, -1 = unlimited)
@@ -248,6 +678,14 @@ void jsini_collect_key_stats(jsini_value_t* value, jsini_key_stats_map_t* stats)
  */
 void jsini_print_key_stats(FILE* out, jsini_key_stats_map_t* stats, int max_level, double min_ratio);
 
+/*
+ * With JSINI_STATS_SAMPLED the statistics come from a sample of the input,
+ * and every ratio is followed by its 95% Wilson score interval, computed
+ * from the number of objects sampled at the parent path.
+ */
+void jsini_print_key_stats_ex(FILE* out, jsini_key_stats_map_t* stats, int max_level,
+                              double min_ratio, uint32_t options);
+
 /**
  * Frees a key statistics map and all its entries.
  */
@@ -9,6 +9,7 @@
 #include <vector>
 #include <map>
 #include <functional>
+#include <iterator>
 
 #include "jsini.h"
 
@@ -99,6 +100,10 @@ public:
         init(jsini_parse_string(s, length));
     }
 
+    static jsini_value_t* parse(const std::string &s, int options) {
+        return jsini_parse_string_ex(s.c_str(), s.length(), options);
+    }
+
     static jsini_value_t* from_jsonl(const std::string &s) {
         return jsini_parse_string_jsonl(s.c_str(), s.length());
     }
@@ -132,6 +137,9 @@ public:
     }
 
     inline uint8_t type() const {
+        if (jsini_array_t *array = node_->packed()) {
+            return jsini_array_type(array, node_->index());
+        }
         return node_->value()->type;
     }
 
@@ -168,7 +176,7 @@ public:
     }
 
     inline uint32_t lineno() const {
-        return node_->value()->lineno;
+        return jsini_lineno(node_->value());
     }
 
     size_t size() const {
@@ -184,6 +192,12 @@ public:
     }
 
     operator bool() const {
+        if (jsini_array_t *array = node_->packed()) {
+            if (array->packed == JSINI_TBOOL) {
+                return jsini_array_get_bool(array, node_->index()) != 0;
+            }
+            return jsini_array_get_number(array, node_->index()) != 0.0;
+        }
         jsini_value_t *value = node_->value();
         switch (value->type) {
         case JSINI_UNDEFINED:
@@ -201,18 +215,23 @@ public:
     }
 
     operator int() const {
+        if (jsini_array_t *array = node_->packed()) {
+            return (int) jsini_array_get_integer(array, node_->index());
+        }
         jsini_value_t *value = node_->value();
         return jsini_cast_int(value);
     }
 
     operator double() const {
+        if (jsini_array_t *array = node_->packed()) {
+            return jsini_array_get_number(array, node_->index());
+        }
         jsini_value_t *value = node_->value();
         return jsini_cast_double(value);
     }
 
     operator float() const {
-        jsini_value_t *value = node_->value();
-        return (float) jsini_cast_double(value);
+        return (float) operator double();
     }
 
     explicit operator const char *() const {
@@ -235,6 +254,13 @@ public:
     }
 
     int to(bool &dst) const {
+        if (jsini_array_t *array = node_->packed()) {
+            if (array->packed != JSINI_TBOOL) {
+                return JSINI_ERROR;
+            }
+            dst = jsini_array_get_bool(array, node_->index()) != 0;
+            return JSINI_OK;
+        }
         jsini_value_t *value = node_->value();
         if (value->type != JSINI_TBOOL) {
             return JSINI_ERROR;
@@ -246,7 +272,11 @@ public:
     template<class T>
     int to(T &dst) const {
         if (type() == JSINI_TINTEGER) {
-            dst = (T)((jsini_integer_t *)node_->value())->data;
+            if (jsini_array_t *array = node_->packed()) {
+                dst = (T) jsini_array_get_integer(array, node_->index());
+            } else {
+                dst = (T)((jsini_integer_t *)node_->value())->data;
+            }
             return JSINI_OK;
         }
         return JSINI_ERROR;
@@ -262,6 +292,13 @@ public:
     }
 
     int to(double &dst) const {
+        if (jsini_array_t *array = node_->packed()) {
+            if (array->packed == JSINI_TBOOL) {
+                return JSINI_ERROR;
+            }
+            dst = jsini_array_get_number(array, node_->index());
+            return JSINI_OK;
+        }
         jsini_value_t *value = node_->value();
         if (value->type != JSINI_TINTEGER && value->type != JSINI_TNUMBER) {
             return JSINI_ERROR;
@@ -294,6 +331,32 @@ public:
         return JSINI_OK;
     }
 
+    int to(std::vector<double> &dst) const {
+        jsini_value_t *value = node_->value();
+        if (value->type != JSINI_TARRAY) {
+            return JSINI_ERROR;
+        }
+        jsini_array_t *array = (jsini_array_t *) value;
+        dst.resize(jsini_array_size(array));
+        if (dst.empty()) {
+            return JSINI_OK;
+        }
+        return jsini_array_to_double(array, &dst[0]);
+    }
+
+    int to(std::vector<int64_t> &dst) const {
+        jsini_value_t *value = node_->value();
+        if (value->type != JSINI_TARRAY) {
+            return JSINI_ERROR;
+        }
+        jsini_array_t *array = (jsini_array_t *) value;
+        dst.resize(jsini_array_size(array));
+        if (dst.empty()) {
+            return JSINI_OK;
+        }
+        return jsini_array_to_int64(array, &dst[0]);
+    }
+
     template <class V, class F>
     int to(std::vector<V> &dst, F parse) {
         if (type() != JSINI_TARRAY) {
@@ -385,6 +448,10 @@ public:
     }
 
     Value& operator=(bool data) {
+        if (jsini_array_t *array = node_->packed()) {
+            jsini_array_set_bool(array, node_->index(), (int) data);
+            return *this;
+        }
         jsini_value_t *value = node_->value();
         if (value->type == JSINI_TBOOL) {
             ((jsini_bool_t*) value)->data = data;
@@ -396,6 +463,10 @@ public:
     }
 
     Value& operator=(int data) {
+        if (jsini_array_t *array = node_->packed()) {
+            jsini_array_set_integer(array, node_->index(), data);
+            return *this;
+        }
         jsini_value_t *value = node_->value();
         if (value->type == JSINI_TINTEGER) {
             ((jsini_integer_t*) value)->data = data;
@@ -407,6 +478,10 @@ public:
     }
 
     Value& operator=(double data) {
+        if (jsini_array_t *array = node_->packed()) {
+            jsini_array_set_number(array, node_->index(), data);
+            return *this;
+        }
         jsini_value_t *value = node_->value();
         if (value->type == JSINI_TNUMBER) {
             ((jsini_number_t*) value)->data = data;
@@ -532,11 +607,20 @@ public:
         Iterator(Value *value=NULL) : value_(value), data_{0} {
         }
 
+        Iterator& operator++() {
+            data_++;
+            return *this;
+        }
+
         Iterator& operator++(int) {
             data_++;
             return *this;
         }
 
+        bool operator==(const Iterator &other) const {
+            return value_ == other.value_ && data_ == other.data_;
+        }
+
         bool operator!=(const Iterator &other) const {
             return value_ != other.value_ || data_ != other.data_;
         }
@@ -550,7 +634,7 @@ public:
             }
 
             inline uint32_t lineno() const {
-                return data_->lineno;
+                return jsini_lineno(data_);
             }
 
             inline bool operator==(const char *value) const {
@@ -590,6 +674,124 @@ public:
         return it;
     }
 
+    // Random access iterator over the elements of an array. Elements are
+    // read straight from the underlying jsa_t, so stepping and dereferencing
+    // never allocate or touch the Root's node map.
+    class ArrayIterator {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef jsini_value_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef jsini_value_t *pointer;
+        typedef jsini_value_t &reference;
+
+        ArrayIterator(const JSA_TYPE *item = NULL) : item_(item) {
+        }
+
+        reference operator*() const { return *(jsini_value_t *) *item_; }
+        pointer operator->() const { return (jsini_value_t *) *item_; }
+        reference operator[](difference_type n) const {
+            return *(jsini_value_t *) item_[n];
+        }
+
+        ArrayIterator &operator++() { ++item_; return *this; }
+        ArrayIterator &operator--() { --item_; return *this; }
+        ArrayIterator operator++(int) { ArrayIterator t(*this); ++item_; return t; }
+        ArrayIterator operator--(int) { ArrayIterator t(*this); --item_; return t; }
+
+        ArrayIterator &operator+=(difference_type n) { item_ += n; return *this; }
+        ArrayIterator &operator-=(difference_type n) { item_ -= n; return *this; }
+        ArrayIterator operator+(difference_type n) const { return ArrayIterator(item_ + n); }
+        ArrayIterator operator-(difference_type n) const { return ArrayIterator(item_ - n); }
+        friend ArrayIterator operator+(difference_type n, const ArrayIterator &it) {
+            return it + n;
+        }
+        difference_type operator-(const ArrayIterator &other) const {
+            return item_ - other.item_;
+        }
+
+        bool operator==(const ArrayIterator &other) const { return item_ == other.item_; }
+        bool operator!=(const ArrayIterator &other) const { return item_ != other.item_; }
+        bool operator<(const ArrayIterator &other) const { return item_ < other.item_; }
+        bool operator>(const ArrayIterator &other) const { return item_ > other.item_; }
+        bool operator<=(const ArrayIterator &other) const { return item_ <= other.item_; }
+        bool operator>=(const ArrayIterator &other) const { return item_ >= other.item_; }
+
+    private:
+        const JSA_TYPE *item_;
+    };
+
+    // Forward iterator over the attributes of an object in insertion order.
+    // Each step yields the jsini_attr_t (name/value pair) held in the object's
+    // keys array; no hash lookup is involved.
+    class ObjectIterator {
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef jsini_attr_t value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef jsini_attr_t *pointer;
+        typedef jsini_attr_t &reference;
+
+        ObjectIterator(const JSA_TYPE *item = NULL) : item_(item) {
+        }
+
+        reference operator*() const { return *(jsini_attr_t *) *item_; }
+        pointer operator->() const { return (jsini_attr_t *) *item_; }
+
+        ObjectIterator &operator++() { ++item_; return *this; }
+        ObjectIterator operator++(int) { ObjectIterator t(*this); ++item_; return t; }
+
+        bool operator==(const ObjectIterator &other) const { return item_ == other.item_; }
+        bool operator!=(const ObjectIterator &other) const { return item_ != other.item_; }
+
+    private:
+        const JSA_TYPE *item_;
+    };
+
+    template <class I>
+    class Range {
+    public:
+        Range(I first, I last) : first_(first), last_(last) {
+        }
+        I begin() const { return first_; }
+        I end() const { return last_; }
+        size_t size() const { return (size_t) std::distance(first_, last_); }
+        bool empty() const { return first_ == last_; }
+
+    private:
+        I first_;
+        I last_;
+    };
+
+    // Elements of an array for use with range-for and <algorithm>; empty if
+    // this value is not an array. A packed array is unpacked first, which
+    // replaces its storage, so this is not const. The range is invalidated by
+    // any operation that changes the size of the array.
+    Range<ArrayIterator> elements() {
+        jsini_value_t *value = node_->value();
+        if (value->type != JSINI_TARRAY) {
+            return Range<ArrayIterator>(ArrayIterator(), ArrayIterator());
+        }
+        if (((jsini_array_t *) value)->packed) {
+            jsini_array_unpack((jsini_array_t *) value);
+        }
+        const jsa_t *a = &((jsini_array_t *) value)->data;
+        return Range<ArrayIterator>(ArrayIterator(a->item),
+                ArrayIterator(a->item + a->size));
+    }
+
+    // Attributes of an object in insertion order; empty if this value is not
+    // an object. The range is invalidated by adding or removing keys.
+    Range<ObjectIterator> entries() const {
+        jsini_value_t *value = node_->value();
+        if (value->type != JSINI_TOBJECT) {
+            return Range<ObjectIterator>(ObjectIterator(), ObjectIterator());
+        }
+        const jsa_t *a = &((jsini_object_t *) value)->keys;
+        return Range<ObjectIterator>(ObjectIterator(a->item),
+                ObjectIterator(a->item + a->size));
+    }
+
 private:
     class Node {
     private:
@@ -658,6 +860,21 @@ private:
             return index_ == INVALID_INDEX;
         }
 
+        /* The containing array when this node is an element of a packed one.
+         * Packed strings are boxed on access like any other string. */
+        jsini_array_t *packed() const {
+            if (is_root() || container_->type != JSINI_TARRAY
+                    || !container_->packed
+                    || ((jsini_array_t *) container_)->packed == JSINI_TSTRING) {
+                return NULL;
+            }
+            return (jsini_array_t *) container_;
+        }
+
+        uint32_t index() const {
+            return (uint32_t) index_;
+        }
+
     };
 
     class Root {
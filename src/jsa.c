@@ -9,8 +9,15 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef JSINI_COUNT_ALLOCS
+void *jsini_counted_malloc(size_t);
+void *jsini_counted_realloc(void *, size_t);
+#define xmalloc         jsini_counted_malloc
+#define xrealloc        jsini_counted_realloc
+#else
 #define xmalloc         malloc
 #define xrealloc        realloc
+#endif
 #define xfree           free
 
 #define JSA_MAX_SIZE    1073741824
@@ -11,8 +11,15 @@
 
 #define JSB_MAX_SIZE   536870912   // 512M
 
+#ifdef JSINI_COUNT_ALLOCS
+void *jsini_counted_malloc(size_t);
+void *jsini_counted_realloc(void *, size_t);
+#define xmalloc         jsini_counted_malloc
+#define xrealloc        jsini_counted_realloc
+#else
 #define xmalloc         malloc
 #define xrealloc        realloc
+#endif
 #define xfree           free
 #define xfree_safe(p)   if (p) free(p)
 
@@ -162,6 +169,57 @@ int jsb_getline(jsb_t *sb, FILE *fp) {
     return sb->size > 0 ? JSB_OK : JSB_ERROR;
 }
 
+void jsb_reader_init(jsb_reader_t *r, FILE *fp) {
+    r->fp = fp;
+    jsb_init(&r->buf);
+    r->pos = 0;
+    r->scan = 0;
+    r->eof = 0;
+}
+
+void jsb_reader_clean(jsb_reader_t *r) {
+    jsb_clean(&r->buf);
+}
+
+int jsb_reader_getline(jsb_reader_t *r, const char **line, size_t *size) {
+    while (1) {
+        const char *start = r->buf.data + r->pos;
+        size_t avail = r->buf.size - r->pos;
+        const char *nl = avail > r->scan
+                       ? (const char *) memchr(start + r->scan, '\n', avail - r->scan)
+                       : NULL;
+        size_t n;
+
+        if (nl || (r->eof && avail > 0)) {
+            *line = start;
+            *size = nl ? (size_t) (nl - start) + 1 : avail;
+            r->pos += *size;
+            r->scan = 0;
+            return JSB_OK;
+        }
+        if (r->eof) {
+            return JSB_ERROR;
+        }
+        r->scan = avail;
+
+        // Keep the partial line at the front and read the next block after it
+        if (r->pos > 0) {
+            memmove(r->buf.data, start, avail);
+            r->buf.size = avail;
+            r->pos = 0;
+        }
+        if (jsb_alloc(&r->buf, r->buf.size + JSB_READ_BLOCK + 1) != JSB_OK) {
+            return JSB_ERROR;
+        }
+        n = fread(r->buf.data + r->buf.size, 1, JSB_READ_BLOCK, r->fp);
+        r->buf.size += n;
+        r->buf.data[r->buf.size] = '\0';
+        if (n < JSB_READ_BLOCK) {
+            r->eof = 1;
+        }
+    }
+}
+
 void jsb_lstrip(jsb_t *sb) {
     size_t n = 0;
     while (n < sb->size) {
@@ -54,7 +54,12 @@ struct jsh_t {
 #define TINY_MAX        1073741824  /* maximum size */
 #define HOME_OF(t,h)    (&(t)->slot[(h) % (t)->size])
 
+#ifdef JSINI_COUNT_ALLOCS
+void *jsini_counted_malloc(size_t);
+#define xmalloc         jsini_counted_malloc
+#else
 #define xmalloc         malloc
+#endif
 #define xfree           free
 
 int jsh_resize(jsh_t *, uint32_t);
@@ -344,6 +349,17 @@ jsh_put(jsh_t *t, const void *key, const void *value) {
     return jsh_insert(t, h, key, value);
 }
 
+int
+jsh_put_new(jsh_t *t, uint32_t hash, const void *key, const void *value) {
+    assert(jsh_locate(t, hash, key) == NULL);
+    return jsh_insert(t, hash, key, value);
+}
+
+uint32_t
+jsh_hash(jsh_t *t, const void *key) {
+    return hash_key(t, key);
+}
+
 static int
 jsh_test(jsh_t *t, Slot *slot, HASH hash, const void *key)
 {
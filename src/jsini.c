@@ -11,20 +11,67 @@
 #include <string.h>
 #include <ctype.h>
 
+#ifdef JSINI_COUNT_ALLOCS
+#define xmalloc jsini_counted_malloc
+#else
 #define xmalloc malloc
+#endif
 #define xfree free
 
+#if defined(__GNUC__)
+#define atomic_add(p,n) __atomic_add_fetch(p, n, __ATOMIC_ACQ_REL)
+#else
+#define atomic_add(p,n) (*(p) += (n))
+#endif
+
+#ifdef JSINI_COUNT_ALLOCS
+static size_t alloc_count;
+
+void *jsini_counted_malloc(size_t size) {
+    atomic_add(&alloc_count, 1);
+    return malloc(size);
+}
+
+void *jsini_counted_calloc(size_t n, size_t size) {
+    atomic_add(&alloc_count, 1);
+    return calloc(n, size);
+}
+
+void *jsini_counted_realloc(void *p, size_t size) {
+    atomic_add(&alloc_count, 1);
+    return realloc(p, size);
+}
+
+size_t jsini_alloc_count(void) {
+    return atomic_add(&alloc_count, 0);
+}
+#endif
+
+// A string with `packed` set is one of these: a name shared by many attributes
+typedef struct {
+    JSINI_VALUE_FIELDS
+    jsb_t           data;
+    uint32_t        refs;
+} shared_string_t;
+
 jsini_array_t *jsini_alloc_array() {
     jsini_array_t *array = (jsini_array_t *) xmalloc(sizeof(jsini_array_t));
     array->type = JSINI_TARRAY;
+    array->lang = 0;
+    array->packed = 0;
     jsa_init(&array->data);
     return array;
 }
 
 void jsini_free_array(jsini_array_t *array) {
     uint32_t i;
-    for (i = 0; i < array->data.size; i++) {
-        jsini_free((jsini_value_t*)array->data.item[i]);
+    if (!array->packed) {
+        for (i = 0; i < array->data.size; i++) {
+            jsini_free((jsini_value_t*)array->data.item[i]);
+        }
+    }
+    else if (array->packed == JSINI_TSTRING) {
+        jsb_clean(&((jsini_string_array_t*)array)->blob);
     }
     jsa_clean(&array->data);
     xfree(array);
@@ -39,6 +86,16 @@ jsini_attr_t *jsini_alloc_attr(jsini_object_t *object, jsini_string_t *name) {
     return attr;
 }
 
+jsini_attr_t *jsini_add_attr(jsini_object_t *object, jsini_string_t *name,
+        uint32_t hash, jsini_value_t *value) {
+    jsini_attr_t *attr = (jsini_attr_t *) xmalloc(sizeof(jsini_attr_t));
+    attr->name = jsini_retain_string(name);
+    attr->value = value;
+    jsa_push(&object->keys, attr);
+    jsh_put_new(object->map, hash, name->data.data, attr);
+    return attr;
+}
+
 void jsini_free_attr(jsini_attr_t *attr) {
     jsini_free_string(attr->name);
     if (attr->value) {
@@ -86,11 +143,21 @@ jsini_number_t *jsini_alloc_number(double value) {
 }
 
 jsini_object_t *jsini_alloc_object() {
+    return jsini_alloc_object_ex(0);
+}
+
+jsini_object_t *jsini_alloc_object_ex(uint32_t size) {
     jsini_object_t *object = (jsini_object_t *) xmalloc(sizeof(jsini_object_t));
     object->type = JSINI_TOBJECT;
     object->lang = 0;
     jsa_init(&object->keys);
-    object->map = jsh_create_simple(0,0);
+    if (size > 0) {
+        // Room for `size` keys below the 0.75 load factor
+        jsa_alloc(&object->keys, size);
+        object->map = jsh_create_simple(size * 4 / 3 + 1, 0);
+    } else {
+        object->map = jsh_create_simple(0,0);
+    }
     return object;
 }
 
@@ -109,6 +176,7 @@ jsini_string_t *jsini_alloc_string(const char *data, size_t length) {
     jsini_string_t *js = (jsini_string_t *) xmalloc(sizeof(jsini_string_t));
     js->type = JSINI_TSTRING;
     js->lang = 0;
+    js->packed = 0;
     jsb_init(&js->data);
     if (data != NULL) {
       jsb_append(&js->data, data, length);
@@ -116,7 +184,29 @@ jsini_string_t *jsini_alloc_string(const char *data, size_t length) {
     return js;
 }
 
+jsini_string_t *jsini_alloc_shared_string(const char *data, size_t length) {
+    shared_string_t *js = (shared_string_t *) xmalloc(sizeof(shared_string_t));
+    js->type = JSINI_TSTRING;
+    js->lang = 0;
+    js->packed = 1;
+    js->refs = 1;
+    jsb_init(&js->data);
+    if (data != NULL) {
+      jsb_append(&js->data, data, length);
+    }
+    return (jsini_string_t *) js;
+}
+
+jsini_string_t *jsini_retain_string(jsini_string_t *js) {
+    assert(js->packed);
+    atomic_add(&((shared_string_t *) js)->refs, 1);
+    return js;
+}
+
 void jsini_free_string(jsini_string_t *js) {
+    if (js->packed && atomic_add(&((shared_string_t *) js)->refs, -1) > 0) {
+        return;
+    }
     jsb_clean(&js->data);
     xfree(js);
 }
@@ -139,42 +229,109 @@ void jsini_free(jsini_value_t *js) {
 }
 
 void jsl_init(jsl_t *lex, const char *s, size_t len, int options) {
+#ifdef JSINI_OMIT_LINENO
+    options |= JSINI_NO_LINENO;
+#endif
+    lex->input_start = s;
     lex->input     = s;
     lex->input_end = s + len;
-    lex->lineno    = 1;
+    lex->lineno    = (options & JSINI_NO_LINENO) ? 0 : 1;
     lex->error     = JSINI_OK;
     lex->options   = options;
 }
 
+#define JSL_NEWLINE(lex) \
+    do { if (!((lex)->options & JSINI_NO_LINENO)) (lex)->lineno++; } while (0)
+
+size_t jsini_offset_lineno(const char *s, size_t offset) {
+    size_t i, lineno = 1;
+    for (i = 0; i < offset; i++) {
+        if (s[i] == '\n' || s[i] == '\r') {
+            lineno++;
+        }
+    }
+    return lineno;
+}
+
+/*
+ * Current line of the lexer; resolved from the input offset when line
+ * tracking is off.
+ */
+size_t jsl_lineno(const jsl_t *lex) {
+    if (lex->options & JSINI_NO_LINENO) {
+        return jsini_offset_lineno(lex->input_start,
+                lex->input - lex->input_start);
+    }
+    return lex->lineno;
+}
+
 int jsl_is_break(int c) {
     return !isalnum(c) && c != '_';
 }
 
-jsini_number_t *jsl_read_number(jsl_t *lex) {
+/*
+ * strtod() reads up to a byte it cannot use, which may lie past the input, so
+ * a token that runs to the end of the input is parsed from a terminated copy.
+ */
+static int jsl_scan_number(jsl_t *lex, jsl_scalar_t *scalar) {
+    const char *s = lex->input;
+    const char *p = lex->input;
+    char   buf[64], *copy = NULL;
     char  *tok_end;
-    double data = strtod(lex->input, &tok_end);
+    double data;
+    int    res = 0;
 
-    if (tok_end != lex->input && tok_end <= lex->input_end && errno != ERANGE) {
-        jsini_number_t * result;
+    while (p != lex->input_end && (isalnum(*p) || (*p && strchr("+-.()_", *p)))) {
+        p++;
+    }
+    if (p == lex->input_end) {
+        size_t n = p - s;
+        copy = n < sizeof(buf) ? buf : (char*) xmalloc(n + 1);
+        memcpy(copy, s, n);
+        copy[n] = '\0';
+        s = copy;
+    }
+
+    data = strtod(s, &tok_end);
+
+    if (tok_end != s && errno != ERANGE) {
+        const char *tok = lex->input + (tok_end - s);
         int is_float = 0;
-        while (lex->input != tok_end) {
+        while (lex->input != tok) {
             if (*lex->input++ == '.') {
                 is_float = 1;
                 break;
             }
         }
-        result = is_float ? jsini_alloc_number(data) :
-                (jsini_number_t *) jsini_alloc_integer((int64_t)data);
-        lex->input = tok_end;
-        return result;
+        if (is_float) {
+            scalar->type = JSINI_TNUMBER;
+            scalar->data.number = data;
+        } else {
+            scalar->type = JSINI_TINTEGER;
+            scalar->data.integer = (int64_t)data;
+        }
+        lex->input = tok;
+        res = 1;
     }
 
-    return NULL ;
+    if (copy && copy != buf) {
+        xfree(copy);
+    }
+    return res;
 }
 
-jsini_value_t *jsl_read_primitive(jsl_t *lex) {
-    jsini_value_t *value = NULL;
+jsini_number_t *jsl_read_number(jsl_t *lex) {
+    jsl_scalar_t scalar;
 
+    if (!jsl_scan_number(lex, &scalar)) {
+        return NULL;
+    }
+
+    return scalar.type == JSINI_TNUMBER ? jsini_alloc_number(scalar.data.number) :
+            (jsini_number_t *) jsini_alloc_integer(scalar.data.integer);
+}
+
+int jsl_scan_primitive(jsl_t *lex, jsl_scalar_t *scalar) {
     assert(lex->input < lex->input_end);
 
     switch (*lex->input) {
@@ -190,35 +347,61 @@ jsini_value_t *jsl_read_primitive(jsl_t *lex) {
     case '9':
     case '-':
     case '.':
-        if ((value = (jsini_value_t*) jsl_read_number(lex))) {
-            value->lineno = lex->lineno;
-        }
-        break;
+        return jsl_scan_number(lex, scalar);
     case 'T':
     case 't':
         if (jsl_skip_keyword(lex, "true", NULL)) {
-            value = (jsini_value_t*) jsini_alloc_bool(1);
-            value->lineno = lex->lineno;
+            scalar->type = JSINI_TBOOL;
+            scalar->data.integer = 1;
+            return 1;
         }
         break;
     case 'F':
     case 'f':
         if (jsl_skip_keyword(lex, "false", NULL)) {
-            value = (jsini_value_t*) jsini_alloc_bool(0);
-            value->lineno = lex->lineno;
+            scalar->type = JSINI_TBOOL;
+            scalar->data.integer = 0;
+            return 1;
         }
         break;
     case 'N':
     case 'n':
         if (jsl_skip_keyword(lex, "null", NULL)) {
-            value = jsini_alloc_null();
-            value->lineno = lex->lineno;
+            scalar->type = JSINI_TNULL;
+            return 1;
         }
         break;
     default:
         break;
     }
 
+    return 0;
+}
+
+jsini_value_t *jsl_read_primitive(jsl_t *lex) {
+    jsini_value_t *value;
+    jsl_scalar_t scalar;
+
+    if (!jsl_scan_primitive(lex, &scalar)) {
+        return NULL;
+    }
+
+    switch (scalar.type) {
+    case JSINI_TBOOL:
+        value = (jsini_value_t*) jsini_alloc_bool((int) scalar.data.integer);
+        break;
+    case JSINI_TINTEGER:
+        value = (jsini_value_t*) jsini_alloc_integer(scalar.data.integer);
+        break;
+    case JSINI_TNUMBER:
+        value = (jsini_value_t*) jsini_alloc_number(scalar.data.number);
+        break;
+    default:
+        value = jsini_alloc_null();
+        break;
+    }
+
+    jsini_set_lineno(value, lex->lineno);
     return value;
 }
 
@@ -251,7 +434,7 @@ void jsini_write_error(jsl_t *lex, FILE *stream) {
         len++;
     }
 
-    fprintf(stream, " (line %zu): %.*s\n", lex->lineno, len, lex->input);
+    fprintf(stream, " (line %zu): %.*s\n", jsl_lineno(lex), len, lex->input);
 }
 
 int jsl_skip_keyword(jsl_t *lex, const char *keyword, int (*is_break)(int)) {
@@ -278,7 +461,7 @@ int jsl_skip_line(jsl_t *lex) {
     while (lex->input != lex->input_end) {
         if (*lex->input == '\n' || *lex->input == '\r') {
             lex->input++;
-            lex->lineno++;
+            JSL_NEWLINE(lex);
             break;
         }
         lex->input++;
@@ -294,7 +477,7 @@ void jsl_skip_space(jsl_t *lex, const char *seps) {
         }
         else if (c == '\n' || c == '\r') {
             lex->input++;
-            lex->lineno++;
+            JSL_NEWLINE(lex);
         }
         else if (seps && strchr(seps, c)) {
             lex->input++;
@@ -304,7 +487,7 @@ void jsl_skip_space(jsl_t *lex, const char *seps) {
                 jsl_skip_line(lex);
             } else if (c == '/') {
                 lex->input++;
-                c = *lex->input;
+                c = lex->input < lex->input_end ? *lex->input : '\0';
                 if (c == '/') {
                     jsl_skip_line(lex);
                 }
@@ -312,7 +495,7 @@ void jsl_skip_space(jsl_t *lex, const char *seps) {
                     lex->input++;
                     while (lex->input + 1 < lex->input_end) {
                         if (lex->input[0] == '\n' || lex->input[0] == '\r') {
-                            lex->lineno++;
+                            JSL_NEWLINE(lex);
                         }
                         if (lex->input[0] == '*' && lex->input[1] == '/') {
                             lex->input += 2;
@@ -433,25 +616,78 @@ const char* jsini_select_string(const jsini_object_t *object, const char *name)
 }
 
 // API
+static JSA_TYPE pack_number(double d) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    return (JSA_TYPE) bits;
+}
+
+static double unpack_number(JSA_TYPE item) {
+    uint64_t bits = (uint64_t) item;
+    double d;
+    memcpy(&d, &bits, sizeof(d));
+    return d;
+}
+
+/*
+ * Stores a raw value in a packed array if its type matches, or the boxed
+ * node otherwise (which promotes the array).
+ */
+static void push_packed(jsini_array_t *array, uint8_t type, JSA_TYPE item,
+        jsini_value_t *(*box)(JSA_TYPE)) {
+    if (array->packed == type) {
+        jsa_append(&array->data, item);
+    } else {
+        jsini_push_value(array, box(item));
+    }
+}
+
+static jsini_value_t *box_bool(JSA_TYPE item) {
+    return (jsini_value_t*) jsini_alloc_bool(item != 0);
+}
+
+static jsini_value_t *box_integer(JSA_TYPE item) {
+    return (jsini_value_t*) jsini_alloc_integer((int64_t) item);
+}
+
+static jsini_value_t *box_number(JSA_TYPE item) {
+    return (jsini_value_t*) jsini_alloc_number(unpack_number(item));
+}
+
 void jsini_push_null(jsini_array_t *array) {
-    jsa_push(&array->data, jsini_alloc_null());
+    jsini_push_value(array, jsini_alloc_null());
 }
 
 void jsini_push_bool(jsini_array_t *array, int value) {
-    jsa_push(&array->data, jsini_alloc_bool(value));
+    push_packed(array, JSINI_TBOOL, value != 0, box_bool);
 }
 
 void jsini_push_integer(jsini_array_t *array, int64_t value) {
-    jsa_push(&array->data, jsini_alloc_integer(value));
+    push_packed(array, JSINI_TINTEGER, (JSA_TYPE) value, box_integer);
 }
 
 void jsini_push_number(jsini_array_t *array, double value) {
-    jsa_push(&array->data, jsini_alloc_number(value));
+    push_packed(array, JSINI_TNUMBER, pack_number(value), box_number);
+}
+
+static void push_packed_string(jsini_array_t *array, const char *data,
+        size_t len) {
+    jsb_t *blob = &((jsini_string_array_t*)array)->blob;
+    jsa_append(&array->data, (JSA_TYPE) blob->size);
+    if (len > 0) {
+        jsb_append(blob, data, len);
+    }
+    jsb_append_char(blob, '\0');
 }
 
 void jsini_push_string(jsini_array_t *array, const char *data, size_t len) {
-    jsini_string_t *s = jsini_alloc_string(data, len);
-    jsa_push(&array->data, s);
+    jsini_string_t *s;
+    if (array->packed == JSINI_TSTRING) {
+        push_packed_string(array, data, len);
+        return;
+    }
+    s = jsini_alloc_string(data, len);
+    jsini_push_value(array, (jsini_value_t*) s);
 }
 
 jsini_attr_t *jsini_attr(jsini_object_t *object, const char *name) {
@@ -467,12 +703,61 @@ jsini_attr_t *jsini_attr(jsini_object_t *object, const char *name) {
     return attr;
 }
 
+/*
+ * If `value` has the element type of a packed array, stores its raw value in
+ * `item`, releases the node and returns 1.
+ */
+static int absorb_packed(jsini_array_t *array, jsini_value_t *value,
+        JSA_TYPE *item) {
+    if (value->type != array->packed) {
+        return 0;
+    }
+    switch (value->type) {
+    case JSINI_TBOOL:
+        *item = ((jsini_bool_t*)value)->data != 0;
+        break;
+    case JSINI_TINTEGER:
+        *item = (JSA_TYPE) ((jsini_integer_t*)value)->data;
+        break;
+    case JSINI_TNUMBER:
+        *item = pack_number(((jsini_number_t*)value)->data);
+        break;
+    default:
+        return 0;
+    }
+    xfree(value);
+    return 1;
+}
+
 void jsini_push_value(jsini_array_t *array, jsini_value_t *value) {
+    if (array->packed == JSINI_TSTRING && value->type == JSINI_TSTRING) {
+        jsb_t *sb = &((jsini_string_t*)value)->data;
+        push_packed_string(array, sb->data, sb->size);
+        jsini_free(value);
+        return;
+    }
+    if (array->packed) {
+        JSA_TYPE item;
+        if (absorb_packed(array, value, &item)) {
+            jsa_append(&array->data, item);
+            return;
+        }
+        jsini_array_unpack(array);
+    }
     jsa_push(&array->data, value);
 }
 
 void jsini_array_set(jsini_array_t *array, uint32_t key, jsini_value_t *value) {
-    jsini_value_t *old_value = (jsini_value_t*)jsa_get(&array->data, key);
+    jsini_value_t *old_value;
+    if (array->packed) {
+        JSA_TYPE item;
+        if (absorb_packed(array, value, &item)) {
+            jsa_set(&array->data, key, item);
+            return;
+        }
+        jsini_array_unpack(array);
+    }
+    old_value = (jsini_value_t*)jsa_get(&array->data, key);
     if (old_value) {
         jsini_free(old_value);
     }
@@ -480,13 +765,307 @@ void jsini_array_set(jsini_array_t *array, uint32_t key, jsini_value_t *value) {
 }
 
 void jsini_array_remove(jsini_array_t*array, uint32_t key) {
-    jsini_value_t *value = (jsini_value_t*) jsa_get(&array->data, key);
+    jsini_value_t *value;
+    if (array->packed == JSINI_TSTRING) {
+        // Offsets of the later elements also give the size of each element
+        jsini_array_unpack(array);
+    }
+    if (array->packed) {
+        jsa_remove(&array->data, key);
+        return;
+    }
+    value = (jsini_value_t*) jsa_get(&array->data, key);
     if (value) {
         jsini_free(value);
     }
     jsa_remove(&array->data, key);
 }
 
+jsini_value_t *jsini_array_get(jsini_array_t *array, uint32_t key) {
+    if (array->packed) jsini_array_unpack(array);
+    return (jsini_value_t*) jsa_get(&array->data, key);
+}
+
+uint8_t jsini_array_type(const jsini_array_t *array, uint32_t key) {
+    if (key >= array->data.size) {
+        return JSINI_UNDEFINED;
+    }
+    if (array->packed) {
+        return array->packed;
+    }
+    return ((jsini_value_t*)array->data.item[key])->type;
+}
+
+int64_t jsini_array_get_integer(const jsini_array_t *array, uint32_t key) {
+    if (key >= array->data.size) {
+        return 0;
+    }
+    switch (array->packed) {
+    case JSINI_TBOOL:
+        return array->data.item[key] != 0;
+    case JSINI_TINTEGER:
+        return (int64_t) array->data.item[key];
+    case JSINI_TNUMBER:
+        return (int64_t) unpack_number(array->data.item[key]);
+    case JSINI_TSTRING:
+        return 0;
+    default: {
+            const jsini_value_t *value = (jsini_value_t*)array->data.item[key];
+            if (value->type == JSINI_TINTEGER) {
+                return ((const jsini_integer_t*)value)->data;
+            }
+            if (value->type == JSINI_TNUMBER) {
+                return (int64_t) ((const jsini_number_t*)value)->data;
+            }
+            if (value->type == JSINI_TBOOL) {
+                return ((const jsini_bool_t*)value)->data != 0;
+            }
+            return 0;
+        }
+    }
+}
+
+double jsini_array_get_number(const jsini_array_t *array, uint32_t key) {
+    if (key >= array->data.size) {
+        return 0;
+    }
+    switch (array->packed) {
+    case JSINI_TBOOL:
+        return array->data.item[key] != 0;
+    case JSINI_TINTEGER:
+        return (double) (int64_t) array->data.item[key];
+    case JSINI_TNUMBER:
+        return unpack_number(array->data.item[key]);
+    case JSINI_TSTRING:
+        return 0;
+    default: {
+            const jsini_value_t *value = (jsini_value_t*)array->data.item[key];
+            if (value->type == JSINI_TBOOL) {
+                return ((const jsini_bool_t*)value)->data != 0;
+            }
+            return jsini_cast_double(value);
+        }
+    }
+}
+
+const char *jsini_array_get_string(const jsini_array_t *array, uint32_t key,
+        size_t *size) {
+    if (key >= array->data.size) {
+        return NULL;
+    }
+    if (array->packed == JSINI_TSTRING) {
+        const jsb_t *blob = &((const jsini_string_array_t*)array)->blob;
+        size_t offset = (size_t) array->data.item[key];
+        if (size) {
+            size_t next = key + 1 < array->data.size
+                    ? (size_t) array->data.item[key + 1] : blob->size;
+            *size = next - offset - 1;
+        }
+        return blob->data + offset;
+    }
+    if (!array->packed) {
+        const jsini_value_t *value = (jsini_value_t*)array->data.item[key];
+        if (value->type == JSINI_TSTRING) {
+            const jsb_t *sb = &((const jsini_string_t*)value)->data;
+            if (size) {
+                *size = sb->size;
+            }
+            return sb->data ? sb->data : "";
+        }
+    }
+    return NULL;
+}
+
+int jsini_array_get_bool(const jsini_array_t *array, uint32_t key) {
+    if (key >= array->data.size) {
+        return 0;
+    }
+    switch (array->packed) {
+    case JSINI_TBOOL:
+        return array->data.item[key] != 0;
+    case 0: {
+            const jsini_value_t *value = (jsini_value_t*)array->data.item[key];
+            return value->type == JSINI_TBOOL && ((jsini_bool_t*)value)->data;
+        }
+    default:
+        return 0;
+    }
+}
+
+void jsini_array_set_bool(jsini_array_t *array, uint32_t key, int value) {
+    if (array->packed == JSINI_TBOOL) {
+        jsa_set(&array->data, key, value != 0);
+    } else {
+        jsini_array_set(array, key, (jsini_value_t*) jsini_alloc_bool(value));
+    }
+}
+
+void jsini_array_set_integer(jsini_array_t *array, uint32_t key, int64_t value) {
+    if (array->packed == JSINI_TINTEGER) {
+        jsa_set(&array->data, key, (JSA_TYPE) value);
+    } else {
+        jsini_array_set(array, key, (jsini_value_t*) jsini_alloc_integer(value));
+    }
+}
+
+void jsini_array_set_number(jsini_array_t *array, uint32_t key, double value) {
+    if (array->packed == JSINI_TNUMBER) {
+        jsa_set(&array->data, key, pack_number(value));
+    } else {
+        jsini_array_set(array, key, (jsini_value_t*) jsini_alloc_number(value));
+    }
+}
+
+jsini_array_t *jsini_alloc_packed_array(uint8_t type) {
+    jsini_array_t *array;
+#ifdef JSINI_HAVE_PACKED
+    if (type == JSINI_TSTRING) {
+        jsini_string_array_t *strings =
+                (jsini_string_array_t *) xmalloc(sizeof(jsini_string_array_t));
+        strings->type = JSINI_TARRAY;
+        strings->lang = 0;
+        strings->packed = JSINI_TSTRING;
+        jsa_init(&strings->data);
+        jsb_init(&strings->blob);
+        return (jsini_array_t*) strings;
+    }
+#endif
+    array = jsini_alloc_array();
+#ifdef JSINI_HAVE_PACKED
+    if (type == JSINI_TBOOL || type == JSINI_TINTEGER || type == JSINI_TNUMBER) {
+        array->packed = type;
+    }
+#endif
+    return array;
+}
+
+int jsini_array_pack(jsini_array_t *array) {
+#ifdef JSINI_HAVE_PACKED
+    uint8_t type;
+    uint32_t i;
+
+    if (array->packed) return JSINI_OK;
+    if (array->data.size == 0) return JSINI_ERROR;
+
+    type = ((jsini_value_t*)array->data.item[0])->type;
+    if (type != JSINI_TBOOL && type != JSINI_TINTEGER && type != JSINI_TNUMBER) {
+        return JSINI_ERROR;
+    }
+
+    for (i = 1; i < array->data.size; i++) {
+        if (((jsini_value_t*)array->data.item[i])->type != type) {
+            return JSINI_ERROR;
+        }
+    }
+
+    array->packed = type;
+
+    for (i = 0; i < array->data.size; i++) {
+        absorb_packed(array, (jsini_value_t*)array->data.item[i],
+                &array->data.item[i]);
+    }
+
+    return JSINI_OK;
+#else
+    return JSINI_ERROR;
+#endif
+}
+
+void jsini_array_unpack(jsini_array_t *array) {
+    jsini_value_t *(*box)(JSA_TYPE);
+    uint32_t i;
+
+    if (array->packed == JSINI_TSTRING) {
+        jsb_t *blob = &((jsini_string_array_t*)array)->blob;
+        for (i = 0; i < array->data.size; i++) {
+            size_t size;
+            const char *s = jsini_array_get_string(array, i, &size);
+            jsini_value_t *value = (jsini_value_t*) jsini_alloc_string(s, size);
+            jsini_set_lineno(value, jsini_lineno(array));
+            array->data.item[i] = (JSA_TYPE) value;
+        }
+        jsb_clean(blob);
+        array->packed = 0;
+        return;
+    }
+
+    switch (array->packed) {
+    case JSINI_TBOOL:
+        box = box_bool;
+        break;
+    case JSINI_TINTEGER:
+        box = box_integer;
+        break;
+    case JSINI_TNUMBER:
+        box = box_number;
+        break;
+    default:
+        return;
+    }
+
+    for (i = 0; i < array->data.size; i++) {
+        jsini_value_t *value = box(array->data.item[i]);
+        jsini_set_lineno(value, jsini_lineno(array));
+        array->data.item[i] = (JSA_TYPE) value;
+    }
+
+    array->packed = 0;
+}
+
+int jsini_array_to_int64(const jsini_array_t *array, int64_t *dst) {
+    uint32_t i;
+
+    if (array->packed == JSINI_TINTEGER) {
+        memcpy(dst, array->data.item, array->data.size * sizeof(int64_t));
+        return JSINI_OK;
+    }
+
+    if (array->packed) return JSINI_ERROR;
+
+    for (i = 0; i < array->data.size; i++) {
+        const jsini_value_t *value = (const jsini_value_t*)array->data.item[i];
+        if (value->type != JSINI_TINTEGER) {
+            return JSINI_ERROR;
+        }
+        dst[i] = ((const jsini_integer_t*)value)->data;
+    }
+
+    return JSINI_OK;
+}
+
+int jsini_array_to_double(const jsini_array_t *array, double *dst) {
+    uint32_t i;
+
+    switch (array->packed) {
+    case JSINI_TNUMBER:
+        memcpy(dst, array->data.item, array->data.size * sizeof(double));
+        return JSINI_OK;
+    case JSINI_TINTEGER:
+        for (i = 0; i < array->data.size; i++) {
+            dst[i] = (double) (int64_t) array->data.item[i];
+        }
+        return JSINI_OK;
+    case JSINI_TBOOL:
+    case JSINI_TSTRING:
+        return JSINI_ERROR;
+    default:
+        break;
+    }
+
+    for (i = 0; i < array->data.size; i++) {
+        const jsini_value_t *value = (const jsini_value_t*)array->data.item[i];
+        if (value->type == JSINI_TINTEGER) {
+            dst[i] = (double) ((const jsini_integer_t*)value)->data;
+        } else if (value->type == JSINI_TNUMBER) {
+            dst[i] = ((const jsini_number_t*)value)->data;
+        } else {
+            return JSINI_ERROR;
+        }
+    }
+
+    return JSINI_OK;
+}
+
 void jsini_set_undefined(jsini_object_t *object, const char *key) {
     jsini_attr(object, key)->value = (jsini_value_t*) jsini_alloc_undefined();
 }
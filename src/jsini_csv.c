@@ -4,270 +4,1936 @@
 
 #include "jsini.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <errno.h>
 
-#define JSINI_CSV_INCOMPLETE -99
+#if defined(__GNUC__) && defined(__AVX2__)
+#include <immintrin.h>
+#define CSV_SIMD_AVX2
+#elif defined(__GNUC__) && defined(__SSE2__)
+#include <emmintrin.h>
+#define CSV_SIMD_SSE2
+#endif
 
-static int is_quote(char c)
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define CSV_HAVE_PARALLEL
+#endif
+
+#ifdef JSINI_COUNT_ALLOCS
+#define xmalloc jsini_counted_malloc
+#define xcalloc jsini_counted_calloc
+#define xrealloc jsini_counted_realloc
+#else
+#define xmalloc malloc
+#define xcalloc calloc
+#define xrealloc realloc
+#endif
+
+#define CSV_CHUNK_SIZE  65536
+
+// Reader states
+#define CSV_FIELD_START 0   // at the first byte of a field
+#define CSV_UNQUOTED    1   // inside an unquoted field
+#define CSV_QUOTED      2   // inside a quoted field
+#define CSV_QUOTE       3   // quote seen inside a quoted field: closing or doubled
+#define CSV_AFTER_QUOTE 4   // skipping bytes between a closing quote and the delimiter
+#define CSV_CR          5   // record ended on '\r'; a following '\n' belongs to it
+
+/*
+ * Bit i of the result is set when p[i] is one of a to e. Looks at 32 bytes,
+ * which must all be readable.
+ */
+static uint32_t csv_mask32(const char *p, char a, char b, char c, char d, char e)
+{
+#if defined(CSV_SIMD_AVX2)
+    __m256i v = _mm256_loadu_si256((const __m256i *)p);
+    __m256i m = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(a)),
+                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(b))),
+            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(c)),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(v, _mm256_set1_epi8(d)),
+                                            _mm256_cmpeq_epi8(v, _mm256_set1_epi8(e)))));
+    return (uint32_t)_mm256_movemask_epi8(m);
+#elif defined(CSV_SIMD_SSE2)
+    __m128i va = _mm_set1_epi8(a), vb = _mm_set1_epi8(b), vc = _mm_set1_epi8(c);
+    __m128i vd = _mm_set1_epi8(d), ve = _mm_set1_epi8(e);
+    __m128i lo = _mm_loadu_si128((const __m128i *)p);
+    __m128i hi = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i mlo = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(lo, va), _mm_cmpeq_epi8(lo, vb)),
+                               _mm_or_si128(_mm_cmpeq_epi8(lo, vc),
+                                            _mm_or_si128(_mm_cmpeq_epi8(lo, vd), _mm_cmpeq_epi8(lo, ve))));
+    __m128i mhi = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(hi, va), _mm_cmpeq_epi8(hi, vb)),
+                               _mm_or_si128(_mm_cmpeq_epi8(hi, vc),
+                                            _mm_or_si128(_mm_cmpeq_epi8(hi, vd), _mm_cmpeq_epi8(hi, ve))));
+    return (uint32_t)_mm_movemask_epi8(mlo) | ((uint32_t)_mm_movemask_epi8(mhi) << 16);
+#else
+    uint32_t mask = 0;
+    int i;
+    for (i = 0; i < 32; i++)
+    {
+        if (p[i] == a || p[i] == b || p[i] == c || p[i] == d || p[i] == e)
+            mask |= (uint32_t)1 << i;
+    }
+    return mask;
+#endif
+}
+
+static int csv_ctz(uint32_t mask)
+{
+#if defined(__GNUC__)
+    return __builtin_ctz(mask);
+#else
+    int n = 0;
+    while (!(mask & 1))
+    {
+        mask >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+static int csv_popcount(uint32_t mask)
+{
+#if defined(__GNUC__)
+    return __builtin_popcount(mask);
+#else
+    int n = 0;
+    while (mask)
+    {
+        mask &= mask - 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/*
+ * Returns the first byte in [p, end) that is a, b or c, or end.
+ */
+static const char *csv_find(const char *p, const char *end, char a, char b, char c)
+{
+    while (end - p >= 32)
+    {
+        uint32_t mask = csv_mask32(p, a, b, c, c, c);
+        if (mask)
+            return p + csv_ctz(mask);
+        p += 32;
+    }
+    while (p < end && *p != a && *p != b && *p != c)
+        p++;
+    return p;
+}
+
+#define csv_find_break(p,end,delim) csv_find(p, end, delim, '\n', '\r')
+#define csv_find_quote(p,end,quote) csv_find(p, end, quote, quote, quote)
+
+static int csv_is_quote(int flags, char c)
+{
+    return (flags & JSINI_CSV_DOUBLE_QUOTE) ? c == '"' : (c == '"' || c == '\'');
+}
+
+/*
+ * Walks the delimiters, newlines and quotes of the input in order. The
+ * bitmask of those bytes is computed for 32 bytes at a time and then consumed
+ * bit by bit, so a run of short fields costs one vector compare per block.
+ */
+typedef struct
+{
+    const char *block;
+    const char *end;
+    uint32_t mask;      // special bytes of the block not passed yet
+    char delimiter;
+    char quote1;
+    char quote2;
+} csv_cursor_t;
+
+static void csv_cursor_load(csv_cursor_t *c, const char *p)
+{
+    c->block = p;
+    if (c->end - p >= 32)
+    {
+        c->mask = csv_mask32(p, c->delimiter, '\n', '\r', c->quote1, c->quote2);
+    }
+    else
+    {
+        int i, n = (int)(c->end - p);
+        c->mask = 0;
+        for (i = 0; i < n; i++)
+        {
+            if (p[i] == c->delimiter || p[i] == '\n' || p[i] == '\r'
+                    || p[i] == c->quote1 || p[i] == c->quote2)
+                c->mask |= (uint32_t)1 << i;
+        }
+    }
+}
+
+static void csv_cursor_init(csv_cursor_t *c, const char *p, const char *end,
+                            char delimiter, int flags)
+{
+    c->end = end;
+    c->delimiter = delimiter;
+    c->quote1 = '"';
+    c->quote2 = (flags & JSINI_CSV_DOUBLE_QUOTE) ? '"' : '\'';
+    csv_cursor_load(c, p);
+}
+
+/*
+ * Returns the first special byte at or after p, which must not go back
+ * before an earlier call, or end.
+ */
+static const char *csv_next(csv_cursor_t *c, const char *p)
+{
+    for (;;)
+    {
+        if (p - c->block >= 32)
+            csv_cursor_load(c, p);
+        else
+            c->mask &= ~(uint32_t)0 << (p - c->block);
+        if (c->mask)
+            return c->block + csv_ctz(c->mask);
+        if (c->end - c->block <= 32)
+            return c->end;
+        p = c->block + 32;
+    }
+}
+
+/*
+ * Scans one field starting at p into a span over the input. Returns the
+ * delimiter or newline that ends it, or NULL if the input runs out first.
+ * When `final` is set the end of input also ends the field; NULL then means
+ * a quote was left open.
+ */
+static const char *csv_scan_field(csv_cursor_t *c, const char *p, int flags, int final,
+                                  jsini_csv_field_t *field)
+{
+    const char *end = c->end;
+    const char *q;
+    int quoted = p < end && csv_is_quote(flags, *p);
+
+    field->quote = 0;
+    field->quoted = (char)quoted;
+    field->data = p;
+
+    if (quoted)
+    {
+        char quote = *p++;
+        field->data = p;
+        for (;;)
+        {
+            q = csv_next(c, p);
+            if (q == end)
+                return NULL;
+            p = q + 1;
+            if (*q != quote)
+                continue;
+            if (p == end)
+            {
+                if (!final)
+                    return NULL;
+                break;
+            }
+            if (*p != quote)
+                break;
+            field->quote = quote;
+            p++;
+        }
+        field->size = (uint32_t)(q - field->data);
+    }
+
+    // Quotes past the start of a field are plain bytes
+    while ((q = csv_next(c, p)) < end && (*q == c->quote1 || *q == c->quote2))
+        p = q + 1;
+
+    if (!quoted)
+        field->size = (uint32_t)(q - field->data);
+
+    return q < end || final ? q : NULL;
+}
+
+void jsini_csv_unescape(const jsini_csv_field_t *field, jsb_t *sb)
+{
+    const char *p = field->data;
+    const char *end = p + field->size;
+
+    if (!field->quote)
+    {
+        if (field->size > 0)
+            jsb_append(sb, p, field->size);
+        return;
+    }
+
+    while (p < end)
+    {
+        const char *q = csv_find_quote(p, end, field->quote);
+        if (q == end)
+        {
+            jsb_append(sb, p, q - p);
+            break;
+        }
+        jsb_append(sb, p, q + 1 - p); // keep one of the pair
+        p = q + 2;
+    }
+}
+
+int jsini_scan_csv(const char *s, size_t len, int flags, jsini_csv_record_cb cb, void *user_data)
+{
+    const char *p = s;
+    const char *end = s + len;
+    char delimiter = (flags & JSINI_CSV_TAB) ? '\t' : ',';
+    jsini_csv_field_t *fields = NULL;
+    uint32_t count, alloc_count = 0;
+    csv_cursor_t cursor;
+    int res = JSINI_OK;
+
+    csv_cursor_init(&cursor, p, end, delimiter, flags);
+
+    while (p < end && res == JSINI_OK)
+    {
+        count = 0;
+        for (;;)
+        {
+            const char *q;
+            if (count == alloc_count)
+            {
+                alloc_count = alloc_count ? alloc_count * 2 : 16;
+                fields = (jsini_csv_field_t *)xrealloc(fields, alloc_count * sizeof(*fields));
+            }
+            if ((q = csv_scan_field(&cursor, p, flags, 1, &fields[count])) == NULL)
+            {
+                // Quote left open at the end of input: drop the record
+                free(fields);
+                return JSINI_OK;
+            }
+            count++;
+            if ((p = q) == end)
+                break;
+            if (*p++ == delimiter)
+            {
+                if (p < end)
+                    continue;
+                // A trailing delimiter leaves one more empty field
+                if (count == alloc_count)
+                {
+                    alloc_count *= 2;
+                    fields = (jsini_csv_field_t *)xrealloc(fields, alloc_count * sizeof(*fields));
+                }
+                fields[count].data = p;
+                fields[count].size = 0;
+                fields[count].quote = 0;
+                fields[count].quoted = 0;
+                count++;
+                break;
+            }
+            if (p[-1] == '\r' && p < end && *p == '\n')
+                p++;
+            break;
+        }
+        res = cb(fields, count, user_data);
+    }
+
+    free(fields);
+    return res;
+}
+
+#define CSV_COLUMN_MIXED    0xff    // sampled values disagree: type each field
+
+/*
+ * Column types for JSINI_CSV_INFER_TYPES. With JSINI_CSV_INFER_COLUMNS the
+ * first JSINI_CSV_INFER_ROWS records fix a type per column before any record
+ * is built: a column of only integers, only numbers (integers may be mixed
+ * in) or only bools is parsed with that type first, and a column of only
+ * text stays text. Other columns, and values that do not fit, fall back to
+ * typing each field.
+ */
+typedef struct
+{
+    int sampled;
+    uint32_t size;
+    uint8_t *types;     // while sampling, a bit per type seen
+} csv_columns_t;
+
+static void csv_columns_init(csv_columns_t *c)
+{
+    c->sampled = 0;
+    c->size = 0;
+    c->types = NULL;
+}
+
+static void csv_columns_clean(csv_columns_t *c)
+{
+    free(c->types);
+}
+
+/*
+ * Returns 1 if all of s is an integer without leading zeros that fits in
+ * 18 digits.
+ */
+static int csv_scan_integer(const char *s, uint32_t n, int64_t *value)
+{
+    const char *p = s, *end = s + n;
+    int64_t v = 0;
+
+    if (p < end && *p == '-')
+        p++;
+    if (p == end || end - p > 18 || (*p == '0' && end - p > 1))
+        return 0;
+    for (; p < end; p++)
+    {
+        if (*p < '0' || *p > '9')
+            return 0;
+        v = v * 10 + (*p - '0');
+    }
+    *value = *s == '-' ? -v : v;
+    return 1;
+}
+
+/*
+ * Returns 1 if all of s is a JSON number with a fraction or an exponent.
+ */
+static int csv_scan_number(const char *s, uint32_t n, double *value)
+{
+    const char *p = s, *end = s + n;
+    const char *digits;
+    char buf[64];
+    double d;
+
+    if (n >= sizeof(buf))
+        return 0;
+    if (p < end && *p == '-')
+        p++;
+    if (p == end || *p < '0' || *p > '9' || (*p == '0' && p + 1 < end && isdigit((unsigned char)p[1])))
+        return 0;
+    while (p < end && isdigit((unsigned char)*p))
+        p++;
+    digits = p;
+    if (p < end && *p == '.')
+    {
+        if (++p == end || !isdigit((unsigned char)*p))
+            return 0;
+        while (p < end && isdigit((unsigned char)*p))
+            p++;
+    }
+    if (p < end && (*p == 'e' || *p == 'E'))
+    {
+        if (++p < end && (*p == '+' || *p == '-'))
+            p++;
+        if (p == end || !isdigit((unsigned char)*p))
+            return 0;
+        while (p < end && isdigit((unsigned char)*p))
+            p++;
+    }
+    if (p != end || p == digits)
+        return 0;
+
+    memcpy(buf, s, n);
+    buf[n] = 0;
+    errno = 0;
+    d = strtod(buf, NULL);
+    if (errno == ERANGE)
+        return 0;
+    *value = d;
+    return 1;
+}
+
+static int csv_is_keyword(const char *s, uint32_t n, const char *keyword)
+{
+    uint32_t i;
+
+    for (i = 0; i < n; i++)
+    {
+        if (!keyword[i] || tolower((unsigned char)s[i]) != keyword[i])
+            return 0;
+    }
+    return keyword[n] == 0;
+}
+
+/*
+ * Types an unquoted field the way the JSON parser reads a bare value,
+ * without allocating. Returns JSINI_TSTRING for anything that is not a
+ * number, true, false or null; numbers with leading zeros and integers of
+ * more than 18 digits stay text so codes and ids keep their form.
+ */
+static uint8_t csv_classify(const char *s, uint32_t n, jsl_scalar_t *scalar)
+{
+    if (n == 0)
+        return JSINI_TSTRING;
+
+    switch (*s)
+    {
+    case 't':
+    case 'T':
+    case 'f':
+    case 'F':
+        if (!csv_is_keyword(s, n, "true") && !csv_is_keyword(s, n, "false"))
+            return JSINI_TSTRING;
+        scalar->data.integer = n == 4;
+        return scalar->type = JSINI_TBOOL;
+    case 'n':
+    case 'N':
+        if (!csv_is_keyword(s, n, "null"))
+            return JSINI_TSTRING;
+        return scalar->type = JSINI_TNULL;
+    case '-':
+    case '0': case '1': case '2': case '3': case '4':
+    case '5': case '6': case '7': case '8': case '9':
+        if (csv_scan_integer(s, n, &scalar->data.integer))
+            return scalar->type = JSINI_TINTEGER;
+        if (csv_scan_number(s, n, &scalar->data.number))
+            return scalar->type = JSINI_TNUMBER;
+        break;
+    }
+    return JSINI_TSTRING;
+}
+
+static uint8_t csv_infer(const csv_columns_t *c, uint32_t column, const char *s, uint32_t n,
+                         jsl_scalar_t *scalar)
+{
+    int64_t i;
+
+    switch (column < c->size ? c->types[column] : CSV_COLUMN_MIXED)
+    {
+    case JSINI_TSTRING:
+        return JSINI_TSTRING;
+    case JSINI_TBOOL:
+        if (csv_is_keyword(s, n, "true") || csv_is_keyword(s, n, "false"))
+        {
+            scalar->data.integer = n == 4;
+            return scalar->type = JSINI_TBOOL;
+        }
+        break;
+    case JSINI_TINTEGER:
+        if (csv_scan_integer(s, n, &scalar->data.integer))
+            return scalar->type = JSINI_TINTEGER;
+        break;
+    case JSINI_TNUMBER:
+        if (csv_scan_integer(s, n, &i))
+        {
+            scalar->data.number = (double)i;
+            return scalar->type = JSINI_TNUMBER;
+        }
+        if (csv_scan_number(s, n, &scalar->data.number))
+            return scalar->type = JSINI_TNUMBER;
+        break;
+    }
+    return csv_classify(s, n, scalar);
+}
+
+typedef struct
+{
+    csv_columns_t *columns;
+    int skip;
+    uint32_t rows;
+} csv_sample_t;
+
+static int csv_sample_record(const jsini_csv_field_t *fields, uint32_t count, void *user_data)
+{
+    csv_sample_t *sample = (csv_sample_t *)user_data;
+    csv_columns_t *c = sample->columns;
+    jsl_scalar_t scalar;
+    uint32_t i;
+
+    if (sample->skip)
+    {
+        sample->skip = 0;
+        return JSINI_OK;
+    }
+
+    if (count > c->size)
+    {
+        c->types = (uint8_t *)xrealloc(c->types, count);
+        memset(c->types + c->size, 0, count - c->size);
+        c->size = count;
+    }
+
+    // Empty fields and nulls fit any column
+    for (i = 0; i < count; i++)
+    {
+        uint8_t type = fields[i].quoted ? JSINI_TSTRING
+                       : csv_classify(fields[i].data, fields[i].size, &scalar);
+        if (fields[i].size > 0 && type != JSINI_TNULL)
+            c->types[i] |= 1 << type;
+    }
+
+    return ++sample->rows < JSINI_CSV_INFER_ROWS ? JSINI_OK : JSINI_ERROR;
+}
+
+/*
+ * Fixes the column types from the complete records at the start of s,
+ * skipping the header record when `skip` is set.
+ */
+static void csv_columns_sample(csv_columns_t *c, const char *s, size_t len, int flags, int skip)
+{
+    const char *end = s + len;
+    csv_sample_t sample;
+    uint32_t i;
+
+    // The last record may be cut short
+    while (end > s && end[-1] != '\n' && end[-1] != '\r')
+        end--;
+
+    sample.columns = c;
+    sample.skip = skip;
+    sample.rows = 0;
+    jsini_scan_csv(s, end - s, flags, csv_sample_record, &sample);
+
+    for (i = 0; i < c->size; i++)
+    {
+        switch (c->types[i])
+        {
+        case 1 << JSINI_TSTRING:
+            c->types[i] = JSINI_TSTRING;
+            break;
+        case 1 << JSINI_TBOOL:
+            c->types[i] = JSINI_TBOOL;
+            break;
+        case 1 << JSINI_TINTEGER:
+            c->types[i] = JSINI_TINTEGER;
+            break;
+        case 1 << JSINI_TNUMBER:
+        case (1 << JSINI_TINTEGER) | (1 << JSINI_TNUMBER):
+            c->types[i] = JSINI_TNUMBER;
+            break;
+        default:
+            c->types[i] = CSV_COLUMN_MIXED;
+            break;
+        }
+    }
+    c->sampled = 1;
+}
+
+/*
+ * Appends the field of file column `column` to `row`, typed when `columns`
+ * is given and the field was not quoted.
+ */
+static void csv_push_value(jsini_array_t *row, const char *s, uint32_t n, int quoted,
+                           uint32_t column, const csv_columns_t *columns)
+{
+    jsl_scalar_t scalar;
+    uint8_t type = JSINI_TSTRING;
+
+    if (columns && !quoted)
+        type = csv_infer(columns, column, s, n, &scalar);
+
+    switch (type)
+    {
+    case JSINI_TNULL:
+        jsini_push_null(row);
+        break;
+    case JSINI_TBOOL:
+        jsini_push_bool(row, (int)scalar.data.integer);
+        break;
+    case JSINI_TINTEGER:
+        jsini_push_integer(row, scalar.data.integer);
+        break;
+    case JSINI_TNUMBER:
+        jsini_push_number(row, scalar.data.number);
+        break;
+    default:
+        jsini_push_string(row, n > 0 ? s : "", n);
+        break;
+    }
+}
+
+/*
+ * Column projection. The spec lists the columns to keep, separated by
+ * commas: header names, or 0-based indexes for entries made of digits only.
+ * Names are resolved against the header record, so without
+ * JSINI_CSV_HEADER only indexes can be used. Kept columns stay in file
+ * order. A NULL selection keeps every column.
+ */
+typedef struct
+{
+    const char *spec;
+    uint8_t *keep;          // per file column, once resolved
+    uint32_t size;
+} csv_select_t;
+
+#define CSV_SELECT_MAX_INDEX    (1 << 20)
+
+#define csv_select_keep(s,i) (!(s) || ((i) < (s)->size && (s)->keep[i]))
+
+static void csv_select_mark(csv_select_t *s, uint32_t column)
+{
+    if (column >= s->size)
+    {
+        s->keep = (uint8_t *)xrealloc(s->keep, column + 1);
+        memset(s->keep + s->size, 0, column + 1 - s->size);
+        s->size = column + 1;
+    }
+    s->keep[column] = 1;
+}
+
+static int csv_select_resolve(csv_select_t *s, const jsini_array_t *headers)
+{
+    const char *p = s->spec;
+
+    for (;;)
+    {
+        const char *q = strchr(p, ',');
+        uint32_t i, n = q ? (uint32_t)(q - p) : (uint32_t)strlen(p);
+        int found = 0;
+
+        for (i = 0; i < n && isdigit((unsigned char)p[i]); i++)
+            ;
+        if (n > 0 && i == n)
+        {
+            unsigned long column = strtoul(p, NULL, 10);
+            if (column >= CSV_SELECT_MAX_INDEX)
+                return JSINI_ERROR;
+            csv_select_mark(s, (uint32_t)column);
+            found = 1;
+        }
+        else if (headers)
+        {
+            for (i = 0; i < jsini_array_size(headers); i++)
+            {
+                const jsb_t *name = &((jsini_string_t *)headers->data.item[i])->data;
+                if (name->size == n && (n == 0 || memcmp(name->data, p, n) == 0))
+                {
+                    csv_select_mark(s, i);
+                    found = 1;
+                }
+            }
+        }
+
+        if (!found)
+            return JSINI_ERROR;
+        if (!q)
+            return JSINI_OK;
+        p = q + 1;
+    }
+}
+
+// Drops the unselected names from a header record
+static jsini_array_t *csv_select_headers(const csv_select_t *s, jsini_array_t *headers)
+{
+    jsini_array_t *kept = jsini_alloc_array();
+    uint32_t i;
+
+    for (i = 0; i < jsini_array_size(headers); i++)
+    {
+        jsini_value_t *name = jsini_aget(headers, i);
+        if (csv_select_keep(s, i))
+            jsini_push_value(kept, name);
+        else
+            jsini_free(name);
+    }
+    jsini_array_resize(headers, 0);
+    jsini_free_array(headers);
+    return kept;
+}
+
+/*
+ * Row filter compiled from comparisons of a column with a literal, joined
+ * by && and ||, && binding tighter. A column is a header name or a 0-based
+ * index; names and literals may be double quoted. An unquoted literal that
+ * is a JSON number compares numerically and fails on fields that are not
+ * numbers (except for !=); anything else compares bytes. Terms are
+ * evaluated on the raw field spans, so rows that do not match are never
+ * built.
+ */
+#define CSV_OP_EQ   0
+#define CSV_OP_NE   1
+#define CSV_OP_LT   2
+#define CSV_OP_LE   3
+#define CSV_OP_GT   4
+#define CSV_OP_GE   5
+
+#define CSV_NO_COLUMN   0xffffffffu
+
+typedef struct
+{
+    char *name;             // NULL when the column was given by index
+    uint32_t column;
+    int op;
+    int numeric;
+    double number;
+    char *text;
+    uint32_t size;
+    int alternative;        // starts a new || branch
+} csv_term_t;
+
+struct jsini_csv_filter_t
+{
+    uint32_t size;
+    csv_term_t *terms;
+};
+
+static const char *csv_filter_space(const char *p)
+{
+    while (isspace((unsigned char)*p))
+        p++;
+    return p;
+}
+
+// A double quoted string with backslash escapes, or a bare word
+static const char *csv_filter_token(const char *p, jsb_t *out, int *quoted)
+{
+    jsb_clear(out);
+    *quoted = *p == '"';
+
+    if (*quoted)
+    {
+        for (p++; *p && *p != '"'; p++)
+        {
+            if (*p == '\\' && p[1])
+                p++;
+            jsb_append_char(out, *p);
+        }
+        return *p == '"' ? p + 1 : NULL;
+    }
+
+    while (*p && !isspace((unsigned char)*p) && !strchr("=!<>&|", *p))
+        jsb_append_char(out, *p++);
+    return out->size > 0 ? p : NULL;
+}
+
+static const char *csv_filter_op(const char *p, int *op)
+{
+    if (p[0] == '=')
+    {
+        *op = CSV_OP_EQ;
+        return p + (p[1] == '=' ? 2 : 1);
+    }
+    if (p[0] == '!' && p[1] == '=')
+    {
+        *op = CSV_OP_NE;
+        return p + 2;
+    }
+    if (p[0] == '<' || p[0] == '>')
+    {
+        *op = (p[0] == '<' ? CSV_OP_LT : CSV_OP_GT) + (p[1] == '=');
+        return p + 1 + (p[1] == '=');
+    }
+    return NULL;
+}
+
+static char *csv_filter_strdup(const jsb_t *sb)
+{
+    char *s = (char *)xmalloc(sb->size + 1);
+    if (sb->size > 0)
+        memcpy(s, sb->data, sb->size);
+    s[sb->size] = 0;
+    return s;
+}
+
+static int csv_filter_term_parse(csv_term_t *t, const char **pp, jsb_t *tok)
+{
+    const char *p = csv_filter_space(*pp);
+    int quoted;
+    uint32_t i;
+
+    if ((p = csv_filter_token(p, tok, &quoted)) == NULL)
+        return JSINI_ERROR;
+    for (i = 0; i < tok->size && isdigit((unsigned char)tok->data[i]); i++)
+        ;
+    if (!quoted && i == tok->size)
+    {
+        t->column = (uint32_t)strtoul(tok->data, NULL, 10);
+    }
+    else
+    {
+        t->name = csv_filter_strdup(tok);
+        t->column = CSV_NO_COLUMN;
+    }
+
+    if ((p = csv_filter_op(csv_filter_space(p), &t->op)) == NULL)
+        return JSINI_ERROR;
+    if ((p = csv_filter_token(csv_filter_space(p), tok, &quoted)) == NULL)
+        return JSINI_ERROR;
+
+    t->text = csv_filter_strdup(tok);
+    t->size = tok->size;
+    if (!quoted)
+    {
+        // The grammar of typed fields, so nan, inf or hex stay text
+        int64_t integer;
+        if (csv_scan_integer(t->text, t->size, &integer))
+        {
+            t->number = (double)integer;
+            t->numeric = 1;
+        }
+        else
+        {
+            t->numeric = csv_scan_number(t->text, t->size, &t->number);
+        }
+    }
+
+    *pp = csv_filter_space(p);
+    return JSINI_OK;
+}
+
+jsini_csv_filter_t *jsini_csv_filter_compile(const char *expr)
+{
+    jsini_csv_filter_t *f = (jsini_csv_filter_t *)xcalloc(1, sizeof(jsini_csv_filter_t));
+    const char *p = expr;
+    int alternative = 1;
+    jsb_t tok;
+
+    jsb_init(&tok);
+    for (;;)
+    {
+        csv_term_t *t;
+
+        f->terms = (csv_term_t *)xrealloc(f->terms, (f->size + 1) * sizeof(csv_term_t));
+        t = &f->terms[f->size++];
+        memset(t, 0, sizeof(*t));
+        t->alternative = alternative;
+
+        if (csv_filter_term_parse(t, &p, &tok) != JSINI_OK)
+            break;
+        if (*p == 0)
+        {
+            jsb_clean(&tok);
+            return f;
+        }
+        if ((p[0] != '&' && p[0] != '|') || p[1] != p[0])
+            break;
+        alternative = p[0] == '|';
+        p += 2;
+    }
+
+    jsb_clean(&tok);
+    jsini_csv_filter_free(f);
+    return NULL;
+}
+
+void jsini_csv_filter_free(jsini_csv_filter_t *f)
+{
+    uint32_t i;
+
+    for (i = 0; i < f->size; i++)
+    {
+        free(f->terms[i].name);
+        free(f->terms[i].text);
+    }
+    free(f->terms);
+    free(f);
+}
+
+int jsini_csv_filter_bind(jsini_csv_filter_t *f, const jsini_array_t *headers)
+{
+    uint32_t i, k;
+
+    for (i = 0; i < f->size; i++)
+    {
+        csv_term_t *t = &f->terms[i];
+        size_t n;
+
+        if (!t->name)
+            continue;
+
+        t->column = CSV_NO_COLUMN;
+        n = strlen(t->name);
+        for (k = 0; headers && k < jsini_array_size(headers); k++)
+        {
+            const jsb_t *h = &((jsini_string_t *)headers->data.item[k])->data;
+            // A repeated name means its last column, as for keyed rows
+            if (h->size == n && (n == 0 || memcmp(h->data, t->name, n) == 0))
+                t->column = k;
+        }
+        if (t->column == CSV_NO_COLUMN)
+            return JSINI_ERROR;
+    }
+    return JSINI_OK;
+}
+
+// Whether any term reads file column `column`
+static int csv_filter_uses(const jsini_csv_filter_t *f, uint32_t column)
+{
+    uint32_t i;
+
+    for (i = 0; i < f->size; i++)
+        if (f->terms[i].column == column)
+            return 1;
+    return 0;
+}
+
+// Compares a field with a literal, collapsing doubled quotes on the way
+static int csv_filter_compare(const jsini_csv_field_t *field, const char *s, uint32_t n)
+{
+    const char *p = field->data, *end = p + field->size;
+    uint32_t i = 0;
+
+    if (!field->quote)
+    {
+        uint32_t m = field->size < n ? field->size : n;
+        int cmp = m > 0 ? memcmp(p, s, m) : 0;
+        if (cmp != 0)
+            return cmp;
+        return field->size < n ? -1 : field->size > n;
+    }
+
+    for (; p < end && i < n; p++, i++)
+    {
+        if (*p == field->quote)
+            p++;
+        if ((unsigned char)*p != (unsigned char)s[i])
+            return (unsigned char)*p < (unsigned char)s[i] ? -1 : 1;
+    }
+    return p < end ? 1 : (i < n ? -1 : 0);
+}
+
+static int csv_filter_term(const csv_term_t *t, const jsini_csv_field_t *fields, uint32_t count)
+{
+    static const jsini_csv_field_t missing = { "", 0, 0, 0 };
+    const jsini_csv_field_t *field = t->column < count ? &fields[t->column] : &missing;
+    int cmp;
+
+    if (t->numeric)
+    {
+        int64_t i;
+        double d;
+
+        if (field->quote)
+            return t->op == CSV_OP_NE;
+        if (csv_scan_integer(field->data, field->size, &i))
+            d = (double)i;
+        else if (!csv_scan_number(field->data, field->size, &d))
+            return t->op == CSV_OP_NE;
+        cmp = d < t->number ? -1 : d > t->number;
+    }
+    else
+    {
+        cmp = csv_filter_compare(field, t->text, t->size);
+    }
+
+    switch (t->op)
+    {
+    case CSV_OP_EQ: return cmp == 0;
+    case CSV_OP_NE: return cmp != 0;
+    case CSV_OP_LT: return cmp < 0;
+    case CSV_OP_LE: return cmp <= 0;
+    case CSV_OP_GT: return cmp > 0;
+    default:        return cmp >= 0;
+    }
+}
+
+int jsini_csv_filter_match(const jsini_csv_filter_t *f, const jsini_csv_field_t *fields,
+                           uint32_t count)
+{
+    uint32_t i = 0;
+
+    while (i < f->size)
+    {
+        // One && branch: stop at its first failing term
+        int match = 1;
+        do
+        {
+            if (match && !csv_filter_term(&f->terms[i], fields, count))
+                match = 0;
+            i++;
+        } while (i < f->size && !f->terms[i].alternative);
+
+        if (match)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+ * Row object layout taken from the header record. Every name is a shared
+ * string hashed once, so a row object allocates no keys and inserts without
+ * hashing. A name repeated in the header goes through jsini_set_value() and
+ * the later column wins.
+ */
+typedef struct
+{
+    uint32_t size;
+    jsini_string_t **names;
+    uint32_t *hashes;
+    uint8_t *repeated;
+} csv_template_t;
+
+static void csv_template_init(csv_template_t *t, jsini_array_t *headers)
+{
+    uint32_t i, n = jsini_array_size(headers);
+    jsini_object_t *seen = jsini_alloc_object_ex(n);
+
+    t->size = n;
+    t->names = (jsini_string_t **)xmalloc(n * sizeof(*t->names));
+    t->hashes = (uint32_t *)xmalloc(n * sizeof(*t->hashes));
+    t->repeated = (uint8_t *)xmalloc(n);
+
+    for (i = 0; i < n; i++)
+    {
+        jsb_t *h = &((jsini_string_t *)jsini_aget(headers, i))->data;
+        t->names[i] = jsini_alloc_shared_string(h->size > 0 ? h->data : "", h->size);
+        t->hashes[i] = jsh_hash(seen->map, t->names[i]->data.data);
+        t->repeated[i] = jsh_get(seen->map, t->names[i]->data.data) != NULL;
+        if (!t->repeated[i])
+            jsini_add_attr(seen, t->names[i], t->hashes[i], NULL);
+    }
+
+    jsini_free_object(seen);
+}
+
+static void csv_template_clean(csv_template_t *t)
+{
+    uint32_t i;
+
+    for (i = 0; i < t->size; i++)
+        jsini_free_string(t->names[i]);
+    free(t->names);
+    free(t->hashes);
+    free(t->repeated);
+    t->size = 0;
+}
+
+/*
+ * Turns a record into an object keyed by the header. The values move to the
+ * object and the record is left empty for reuse.
+ */
+static jsini_value_t *csv_keyed_row(jsini_array_t *row, const csv_template_t *t)
 {
-    return c == '"' || c == '\'';
+    uint32_t i, n = jsini_array_size(row);
+    jsini_object_t *obj = jsini_alloc_object_ex(n < t->size ? n : t->size);
+
+    for (i = 0; i < n; i++)
+    {
+        jsini_value_t *value = jsini_aget(row, i);
+        if (i >= t->size)
+            jsini_free(value);
+        else if (t->repeated[i])
+            jsini_set_value(obj, t->names[i]->data.data, value);
+        else
+            jsini_add_attr(obj, t->names[i], t->hashes[i], value);
+    }
+    jsini_array_resize(row, 0);
+
+    return (jsini_value_t *)obj;
 }
 
 /*
- * Parses a single CSV record from the buffer.
- * Returns JSINI_OK on success and populates out_row.
- * Returns JSINI_CSV_INCOMPLETE if the record has an open quote at the end.
+ * Resumable CSV reader. Input can be fed in arbitrary pieces; the state,
+ * the partial field and the partial record are kept between calls, so every
+ * byte is looked at once no matter how many lines a quoted field spans.
+ * Fields that lie within one piece are taken as spans straight from the
+ * input; `field` only collects fields cut by a piece boundary.
  */
-static int try_parse_csv_record(const char *buffer, size_t len, int flags, jsini_array_t **out_row)
+typedef struct
 {
-    jsini_array_t *row = jsini_alloc_array();
-    const char *p = buffer;
-    const char *end = buffer + len;
-    char delimiter = (flags & JSINI_CSV_TAB) ? '\t' : ',';
+    int flags;
+    char delimiter;
+    char quote_char;
+    int state;
+    int quoted;
+    int skip;               // the current field is not selected
+    uint32_t column;        // file column of the current field
+    jsb_t field;
+    jsini_array_t *row;
+    jsini_array_t *headers;
+    csv_select_t *select;
+    jsini_csv_filter_t *filter;
+    jsb_t record;           // with a filter, field bytes of the pending record
+    jsini_csv_field_t *fields;
+    uint32_t *offsets;      // of each field in `record`
+    uint32_t nfields;
+    uint32_t fields_cap;
+    int keyed;              // records go to cb as objects keyed by the header
+    csv_template_t keys;
+    csv_columns_t columns;
+    jsini_jsonl_cb cb;
+    void *user_data;
+} csv_reader_t;
 
-    while (p < end)
+static void csv_reader_init(csv_reader_t *r, int flags, jsini_jsonl_cb cb, void *user_data)
+{
+    r->flags = flags;
+    r->delimiter = (flags & JSINI_CSV_TAB) ? '\t' : ',';
+    r->quote_char = 0;
+    r->state = CSV_FIELD_START;
+    r->quoted = 0;
+    r->skip = 0;
+    r->column = 0;
+    jsb_init(&r->field);
+    r->row = jsini_alloc_array();
+    r->headers = NULL;
+    r->select = NULL;
+    r->filter = NULL;
+    jsb_init(&r->record);
+    r->fields = NULL;
+    r->offsets = NULL;
+    r->nfields = 0;
+    r->fields_cap = 0;
+    r->keyed = 1;
+    r->keys.size = 0;
+    r->keys.names = NULL;
+    r->keys.hashes = NULL;
+    r->keys.repeated = NULL;
+    csv_columns_init(&r->columns);
+    r->cb = cb;
+    r->user_data = user_data;
+}
+
+static void csv_reader_clean(csv_reader_t *r)
+{
+    jsb_clean(&r->field);
+    jsb_clean(&r->record);
+    free(r->fields);
+    free(r->offsets);
+    jsini_free_array(r->row);
+    if (r->headers)
+        jsini_free_array(r->headers);
+    csv_template_clean(&r->keys);
+    csv_columns_clean(&r->columns);
+}
+
+// Column types for the fields of the current record, or NULL for text
+static const csv_columns_t *csv_reader_columns(const csv_reader_t *r)
+{
+    if (!(r->flags & (JSINI_CSV_INFER_TYPES | JSINI_CSV_INFER_COLUMNS)))
+        return NULL;
+    if ((r->flags & JSINI_CSV_HEADER) && !r->headers)
+        return NULL;
+    return &r->columns;
+}
+
+// Whether the current field is built; the header record is always read whole
+static int csv_reader_keep(const csv_reader_t *r)
+{
+    if ((r->flags & JSINI_CSV_HEADER) && !r->headers)
+        return 1;
+    if (r->filter && csv_filter_uses(r->filter, r->column))
+        return 1;
+    return csv_select_keep(r->select, r->column);
+}
+
+/*
+ * With a filter, fields are held as bytes of the pending record until the
+ * whole record can be tested. A skipped field is kept as an empty one so
+ * that fields stay indexed by column.
+ */
+static void csv_record_add(csv_reader_t *r, const char *s, uint32_t n, char quote, char quoted)
+{
+    jsini_csv_field_t *field;
+
+    if (r->nfields == r->fields_cap)
+    {
+        r->fields_cap = r->fields_cap ? r->fields_cap * 2 : 16;
+        r->fields = (jsini_csv_field_t *)xrealloc(r->fields, r->fields_cap * sizeof(jsini_csv_field_t));
+        r->offsets = (uint32_t *)xrealloc(r->offsets, r->fields_cap * sizeof(uint32_t));
+    }
+
+    field = &r->fields[r->nfields];
+    field->size = n;
+    field->quote = quote;
+    field->quoted = quoted;
+    r->offsets[r->nfields++] = (uint32_t)r->record.size;
+    if (n > 0)
+        jsb_append(&r->record, s, n);
+}
+
+/*
+ * Appends a field span to `row`; `tmp` holds the value while doubled quotes
+ * are collapsed.
+ */
+static void csv_push_span(jsini_array_t *row, const jsini_csv_field_t *field, jsb_t *tmp,
+                          uint32_t column, const csv_columns_t *columns)
+{
+    if (!field->quote)
+    {
+        csv_push_value(row, field->data, field->size, field->quoted, column, columns);
+        return;
+    }
+    jsb_clear(tmp);
+    jsini_csv_unescape(field, tmp);
+    jsini_push_string(row, tmp->size > 0 ? tmp->data : "", tmp->size);
+    jsb_clear(tmp);
+}
+
+static void csv_end_field(csv_reader_t *r)
+{
+    if (r->filter)
+        csv_record_add(r, r->field.data, r->skip ? 0 : r->field.size, 0, r->quoted);
+    else if (!r->skip)
+        csv_push_value(r->row, r->field.data, r->field.size, r->quoted, r->column,
+                       csv_reader_columns(r));
+    r->skip = 0;
+    r->quoted = 0;
+    jsb_clear(&r->field);
+}
+
+/*
+ * Tests the held record against the filter and, if it matches, builds the
+ * selected fields into the row. The header record is always built.
+ */
+static int csv_record_build(csv_reader_t *r)
+{
+    int header = (r->flags & JSINI_CSV_HEADER) && !r->headers;
+    int match;
+    uint32_t i;
+
+    for (i = 0; i < r->nfields; i++)
+        r->fields[i].data = r->record.data ? r->record.data + r->offsets[i] : "";
+
+    match = header || jsini_csv_filter_match(r->filter, r->fields, r->nfields);
+    for (i = 0; match && i < r->nfields; i++)
+        if (header || csv_select_keep(r->select, i))
+            csv_push_span(r->row, &r->fields[i], &r->field, i, csv_reader_columns(r));
+
+    jsb_clear(&r->record);
+    r->nfields = 0;
+    return match;
+}
+
+/*
+ * Hands a finished record to the callback, as an object keyed by the header
+ * row when JSINI_CSV_HEADER is set. The first record then becomes the header.
+ */
+static int csv_end_record(csv_reader_t *r)
+{
+    jsini_array_t *row = r->row;
+
+    r->column = 0;
+    if (r->filter && !csv_record_build(r))
+        return JSINI_OK;
+
+    // The record array is reused once its values have moved to the object
+    if (r->headers && r->keyed)
+        return r->cb(csv_keyed_row(row, &r->keys), r->user_data);
+
+    r->row = jsini_alloc_array();
+
+    if (!(r->flags & JSINI_CSV_HEADER))
     {
-        jsb_t *sb = jsb_create();
-        char quote_char = 0;
+        return r->cb((jsini_value_t *)row, r->user_data);
+    }
 
-        if (flags & JSINI_CSV_DOUBLE_QUOTE)
+    if (!r->headers)
+    {
+        if (r->filter && jsini_csv_filter_bind(r->filter, row) != JSINI_OK)
         {
-            if (*p == '"')
-            {
-                quote_char = *p++;
-            }
+            jsini_free_array(row);
+            return JSINI_ERROR;
         }
-        else
+        if (r->select)
         {
-            if (is_quote(*p))
+            if (csv_select_resolve(r->select, row) != JSINI_OK)
             {
-                quote_char = *p++;
+                jsini_free_array(row);
+                return JSINI_ERROR;
             }
+            row = csv_select_headers(r->select, row);
         }
+        r->headers = row;
+        if (r->keyed)
+            csv_template_init(&r->keys, row);
+        return JSINI_OK;
+    }
 
-        if (quote_char)
-        {
-            int closed = 0;
-            while (p < end)
-            {
-                if (*p == quote_char)
-                {
-                    if (p + 1 < end && *(p + 1) == quote_char)
-                    {
-                        jsb_append_char(sb, quote_char);
-                        p += 2;
-                    }
-                    else
-                    {
-                        p++; // Closing quote
-                        closed = 1;
-                        break;
-                    }
-                }
-                else
-                {
-                    jsb_append_char(sb, *p++);
-                }
-            }
+    return r->cb((jsini_value_t *)row, r->user_data);
+}
 
-            if (!closed)
-            {
-                jsb_free(sb);
-                jsini_free_array(row);
-                return JSINI_CSV_INCOMPLETE;
-            }
+/*
+ * Moves on after a field that ended on `c`: to the next field on a
+ * delimiter, or to the next record on a newline.
+ */
+static int csv_after_field(csv_reader_t *r, char c)
+{
+    if (c == r->delimiter)
+    {
+        r->state = CSV_FIELD_START;
+        r->column++;
+        return JSINI_OK;
+    }
 
-            // Consume trailing chars until delimiter or newline
-            while (p < end && *p != delimiter && *p != '\n' && *p != '\r')
-                p++;
-        }
-        else
-        {
-            // Unquoted
-            while (p < end && *p != delimiter && *p != '\n' && *p != '\r')
-            {
-                jsb_append_char(sb, *p++);
-            }
-        }
+    r->state = c == '\r' ? CSV_CR : CSV_FIELD_START;
+    return csv_end_record(r);
+}
+
+static int csv_reader_feed(csv_reader_t *r, const char *p, size_t len)
+{
+    const char *end = p + len;
+    const char *q;
+    jsini_csv_field_t span;
+    csv_cursor_t cursor;
+    int res;
+
+    if (len == 0)
+        return JSINI_OK;
+
+    if ((r->flags & JSINI_CSV_INFER_COLUMNS) && !r->columns.sampled)
+        csv_columns_sample(&r->columns, p, len, r->flags, (r->flags & JSINI_CSV_HEADER) && !r->headers);
 
-        jsini_push_string(row, sb->data, sb->size);
-        jsb_free(sb);
+    csv_cursor_init(&cursor, p, end, r->delimiter, r->flags);
 
-        if (p < end)
+    while (p < end)
+    {
+        switch (r->state)
         {
-            if (*p == delimiter)
+        case CSV_CR:
+            r->state = CSV_FIELD_START;
+            if (*p == '\n')
             {
                 p++;
-                // If delimiter is last char or followed by newline, add empty field
-                if (p == end || *p == '\n' || *p == '\r')
-                {
-                    jsini_push_string(row, "", 0);
-                }
+                break;
             }
-
-            // Check for record terminator
-            if (p < end && (*p == '\n' || *p == '\r'))
+            /* fall through */
+        case CSV_FIELD_START:
+            if ((q = csv_scan_field(&cursor, p, r->flags, 0, &span)) != NULL)
+            {
+                if (r->filter)
+                    csv_record_add(r, span.data, csv_reader_keep(r) ? span.size : 0,
+                                   span.quote, span.quoted);
+                else if (csv_reader_keep(r))
+                    csv_push_span(r->row, &span, &r->field, r->column, csv_reader_columns(r));
+                p = q;
+                if ((res = csv_after_field(r, *p++)) != JSINI_OK)
+                    return res;
+                break;
+            }
+            r->skip = !csv_reader_keep(r);
+            if (csv_is_quote(r->flags, *p))
+            {
+                r->quote_char = *p++;
+                r->quoted = 1;
+                r->state = CSV_QUOTED;
+                break;
+            }
+            r->state = CSV_UNQUOTED;
+            /* fall through */
+        case CSV_UNQUOTED:
+            q = csv_find_break(p, end, r->delimiter);
+            if (q > p && !r->skip)
+                jsb_append(&r->field, p, q - p);
+            if ((p = q) == end)
+                break;
+            csv_end_field(r);
+            if ((res = csv_after_field(r, *p++)) != JSINI_OK)
+                return res;
+            break;
+        case CSV_QUOTED:
+            q = csv_find_quote(p, end, r->quote_char);
+            if (q > p && !r->skip)
+                jsb_append(&r->field, p, q - p);
+            if ((p = q) == end)
+                break;
+            p++;
+            r->state = CSV_QUOTE;
+            break;
+        case CSV_QUOTE:
+            if (*p == r->quote_char)
             {
-                // Found end of record
+                if (!r->skip)
+                    jsb_append_char(&r->field, *p);
+                p++;
+                r->state = CSV_QUOTED;
                 break;
             }
+            r->state = CSV_AFTER_QUOTE;
+            /* fall through */
+        case CSV_AFTER_QUOTE:
+            p = csv_find_break(p, end, r->delimiter);
+            if (p == end)
+                break;
+            csv_end_field(r);
+            if ((res = csv_after_field(r, *p++)) != JSINI_OK)
+                return res;
+            break;
         }
     }
 
-    *out_row = row;
     return JSINI_OK;
 }
 
-int jsini_parse_file_csv_ex(const char *file, int flags, jsini_jsonl_cb cb, void *user_data)
+/*
+ * Flushes a record left without a trailing newline. A quote still open at
+ * the end of input drops the record.
+ */
+static int csv_reader_finish(csv_reader_t *r)
 {
-    FILE *fp = fopen(file, "r");
-    if (!fp)
+    switch (r->state)
+    {
+    case CSV_QUOTED:
+        return JSINI_OK;
+    case CSV_FIELD_START:
+    case CSV_CR:
+        if (r->column == 0)
+            return JSINI_OK;
+        r->skip = !csv_reader_keep(r);
+        /* fall through */
+    default:
+        r->state = CSV_FIELD_START;
+        csv_end_field(r);
+        return csv_end_record(r);
+    }
+}
+
+#ifdef CSV_HAVE_PARALLEL
+
+#define CSV_PARALLEL_CHUNK      (4 << 20)
+#define CSV_PARALLEL_WINDOW     2   // chunks in flight per worker
+
+/*
+ * A fixed-size slice of a memory-mapped file. The first pass counts the
+ * quotes in the nominal range [start, end). Once the parity of all earlier
+ * chunks is known, `inside` says whether `start` falls inside a quoted
+ * field, and the second pass parses from the first record after `start` to
+ * the first record after the next chunk's `start`.
+ */
+typedef struct
+{
+    const char *start;
+    const char *end;
+    int parity;
+    int inside;
+    jsa_t rows;
+    int done;
+} csv_chunk_t;
+
+typedef struct
+{
+    const char *data;               // records after the header
+    const char *end;
+    csv_chunk_t *chunks;
+    int count;
+    int next;                       // next chunk to claim
+    int delivered;                  // chunks handed to the callback
+    int window;                     // chunks claimed but not yet delivered
+    int flags;
+    const csv_template_t *keys;     // NULL when records stay arrays
+    const csv_columns_t *columns;
+    const csv_select_t *select;
+    const jsini_csv_filter_t *filter;
+    volatile int cancel;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+} csv_parallel_t;
+
+typedef struct
+{
+    csv_parallel_t *par;
+    csv_chunk_t *chunk;
+    jsini_array_t *row;
+    jsb_t tmp;
+} csv_worker_t;
+
+static const char *csv_next_record(const char *p, const char *end, int inside)
+{
+    while ((p = csv_find(p, end, '"', '\n', '\r')) < end)
+    {
+        char c = *p++;
+        if (c == '"')
+        {
+            inside = !inside;
+        }
+        else if (!inside)
+        {
+            if (c == '\r' && p < end && *p == '\n')
+                p++;
+            return p;
+        }
+    }
+    return end;
+}
+
+static int csv_parallel_claim(csv_parallel_t *par)
+{
+    int i = -1;
+
+    pthread_mutex_lock(&par->lock);
+    while (!par->cancel && par->next < par->count && par->next - par->delivered >= par->window)
+        pthread_cond_wait(&par->cond, &par->lock);
+    if (!par->cancel && par->next < par->count)
+        i = par->next++;
+    pthread_mutex_unlock(&par->lock);
+    return i;
+}
+
+static void *csv_parallel_count(void *arg)
+{
+    csv_worker_t *w = (csv_worker_t *)arg;
+    int i;
+
+    while ((i = csv_parallel_claim(w->par)) >= 0)
+    {
+        csv_chunk_t *chunk = &w->par->chunks[i];
+        const char *p = chunk->start;
+        int count = 0;
+
+        while (chunk->end - p >= 32)
+        {
+            count += csv_popcount(csv_mask32(p, '"', '"', '"', '"', '"'));
+            p += 32;
+        }
+        for (; p < chunk->end; p++)
+            count += *p == '"';
+        chunk->parity = count & 1;
+    }
+    return NULL;
+}
+
+static int csv_chunk_record(const jsini_csv_field_t *fields, uint32_t count, void *user_data)
+{
+    csv_worker_t *w = (csv_worker_t *)user_data;
+    const csv_parallel_t *par = w->par;
+    jsini_array_t *row;
+    jsini_value_t *value;
+    uint32_t i;
+
+    if (par->cancel)
         return JSINI_ERROR;
+    if (par->filter && !jsini_csv_filter_match(par->filter, fields, count))
+        return JSINI_OK;
 
-    jsb_t sb; // Accumulator
-    jsb_init(&sb);
+    row = par->keys ? w->row : jsini_alloc_array();
+    for (i = 0; i < count; i++)
+        if (csv_select_keep(par->select, i))
+            csv_push_span(row, &fields[i], &w->tmp, i, par->columns);
 
-    jsb_t line_buf;
-    jsb_init(&line_buf);
+    value = par->keys ? csv_keyed_row(row, par->keys) : (jsini_value_t *)row;
+    jsa_push(&w->chunk->rows, value);
+    return JSINI_OK;
+}
 
-    jsini_array_t *headers = NULL;
-    int res = JSINI_OK;
-    int has_header = (flags & JSINI_CSV_HEADER) ? 1 : 0;
+static void *csv_parallel_parse(void *arg)
+{
+    csv_worker_t *w = (csv_worker_t *)arg;
+    csv_parallel_t *par = w->par;
+    int i;
 
-    while (jsb_getline(&line_buf, fp) == JSB_OK)
+    while ((i = csv_parallel_claim(par)) >= 0)
     {
-        jsb_append(&sb, line_buf.data, line_buf.size);
+        csv_chunk_t *chunk = &par->chunks[i];
+        const char *start = i == 0 ? par->data
+                                   : csv_next_record(chunk->start, par->end, chunk->inside);
+        const char *end = i == par->count - 1 ? par->end
+                                              : csv_next_record(chunk[1].start, par->end, chunk[1].inside);
+
+        w->chunk = chunk;
+        if (end > start)
+            jsini_scan_csv(start, end - start, par->flags, csv_chunk_record, w);
+
+        pthread_mutex_lock(&par->lock);
+        chunk->done = 1;
+        pthread_cond_broadcast(&par->cond);
+        pthread_mutex_unlock(&par->lock);
+    }
+    return NULL;
+}
+
+/*
+ * Starts up to `n` workers and returns how many are running; they are in
+ * threads[0..started). Any one of them drains the whole queue.
+ */
+static int csv_parallel_run(csv_parallel_t *par, csv_worker_t *workers, pthread_t *threads,
+                            int n, void *(*run)(void *))
+{
+    int i, started = 0;
+
+    par->next = 0;
+    for (i = 0; i < n; i++)
+        if (pthread_create(&threads[started], NULL, run, &workers[started]) == 0)
+            started++;
+    return started;
+}
+
+static int csv_collect_headers(const jsini_csv_field_t *fields, uint32_t count, void *user_data)
+{
+    jsini_array_t *headers = (jsini_array_t *)user_data;
+    jsb_t tmp;
+    uint32_t i;
+
+    jsb_init(&tmp);
+    for (i = 0; i < count; i++)
+        csv_push_span(headers, &fields[i], &tmp, i, NULL);
+    jsb_clean(&tmp);
+    return JSINI_OK;
+}
 
-        jsini_array_t *row = NULL;
-        int parse_res = try_parse_csv_record(sb.data, sb.size, flags, &row);
+/*
+ * Parses `data` in fixed-size chunks on up to one thread per CPU and hands
+ * the records to `cb` in file order. Workers stay at most a few chunks ahead
+ * of the callback, and each chunk's rows are released once delivered, so
+ * memory does not grow with the file. Record boundaries are found from quote
+ * parity, so a quote inside an unquoted field can make the split differ from
+ * what the sequential reader would do.
+ */
+static int csv_parse_parallel(const char *data, size_t size, int flags, csv_select_t *select,
+                              jsini_csv_filter_t *filter, jsini_jsonl_cb cb, void *user_data)
+{
+    const char *p = data, *end = data + size;
+    csv_parallel_t par;
+    csv_template_t keys;
+    csv_columns_t columns;
+    csv_worker_t *workers;
+    pthread_t *threads;
+    long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, n, started, inside = 0, res = JSINI_OK;
 
-        if (parse_res == JSINI_CSV_INCOMPLETE)
+    if (flags & JSINI_CSV_HEADER)
+    {
+        const char *q = csv_next_record(p, end, 0);
+        jsini_array_t *headers = jsini_alloc_array();
+        jsini_scan_csv(p, q - p, flags, csv_collect_headers, headers);
+        if (filter && jsini_csv_filter_bind(filter, headers) != JSINI_OK)
         {
-            // Continue reading
-            continue;
+            jsini_free_array(headers);
+            return JSINI_ERROR;
         }
-        else if (parse_res == JSINI_OK)
+        if (select)
         {
-            // Success
-            jsb_clear(&sb); // Reset accumulator
-
-            if (jsini_array_size(row) == 0)
+            if (csv_select_resolve(select, headers) != JSINI_OK)
             {
-                jsini_free_array(row);
-                continue;
+                jsini_free_array(headers);
+                return JSINI_ERROR;
             }
+            headers = csv_select_headers(select, headers);
+        }
+        csv_template_init(&keys, headers);
+        jsini_free_array(headers);
+        p = q;
+    }
+
+    csv_columns_init(&columns);
+    if (flags & JSINI_CSV_INFER_COLUMNS)
+        csv_columns_sample(&columns, p, end - p, flags, 0);
+
+    memset(&par, 0, sizeof(par));
+    par.data = p;
+    par.end = end;
+    par.count = (int)((end - p + CSV_PARALLEL_CHUNK - 1) / CSV_PARALLEL_CHUNK);
+    if (par.count < 1)
+        par.count = 1;
+    par.flags = flags;
+    par.keys = (flags & JSINI_CSV_HEADER) ? &keys : NULL;
+    par.columns = (flags & (JSINI_CSV_INFER_TYPES | JSINI_CSV_INFER_COLUMNS)) ? &columns : NULL;
+    par.select = select;
+    par.filter = filter;
+    pthread_mutex_init(&par.lock, NULL);
+    pthread_cond_init(&par.cond, NULL);
+
+    n = par.count < nproc ? par.count : (int)nproc;
+    if (n < 1)
+        n = 1;
+    par.window = n * CSV_PARALLEL_WINDOW;
+
+    par.chunks = (csv_chunk_t *)xcalloc(par.count, sizeof(csv_chunk_t));
+    for (i = 0; i < par.count; i++)
+    {
+        csv_chunk_t *chunk = &par.chunks[i];
+        chunk->start = p + (size_t)i * CSV_PARALLEL_CHUNK;
+        chunk->end = i == par.count - 1 ? end : chunk->start + CSV_PARALLEL_CHUNK;
+        jsa_init(&chunk->rows);
+    }
+
+    workers = (csv_worker_t *)xcalloc(n, sizeof(csv_worker_t));
+    threads = (pthread_t *)xmalloc(n * sizeof(pthread_t));
+    for (i = 0; i < n; i++)
+    {
+        workers[i].par = &par;
+        workers[i].row = jsini_alloc_array();
+        jsb_init(&workers[i].tmp);
+    }
+
+    // Counting keeps nothing per chunk, so it is not held to the window
+    par.delivered = par.count;
+    started = csv_parallel_run(&par, workers, threads, n, csv_parallel_count);
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    if (started == 0)
+        res = JSINI_ERROR;
+
+    for (i = 0; i < par.count; i++)
+    {
+        par.chunks[i].inside = inside;
+        inside ^= par.chunks[i].parity;
+    }
+
+    par.delivered = 0;
+    if (res == JSINI_OK)
+        started = csv_parallel_run(&par, workers, threads, n, csv_parallel_parse);
+    if (started == 0)
+        res = JSINI_ERROR;
+
+    for (i = 0; i < par.count && res == JSINI_OK; i++)
+    {
+        csv_chunk_t *chunk = &par.chunks[i];
+        uint32_t k;
+
+        pthread_mutex_lock(&par.lock);
+        while (!chunk->done)
+            pthread_cond_wait(&par.cond, &par.lock);
+        pthread_mutex_unlock(&par.lock);
+
+        for (k = 0; k < chunk->rows.size; k++)
+        {
+            jsini_value_t *value = (jsini_value_t *)chunk->rows.item[k];
+            if (res == JSINI_OK)
+                res = cb(value, user_data);
+            else
+                jsini_free(value);
+        }
+        jsa_clean(&chunk->rows);
+
+        pthread_mutex_lock(&par.lock);
+        par.delivered = i + 1;
+        if (res != JSINI_OK)
+            par.cancel = 1;
+        pthread_cond_broadcast(&par.cond);
+        pthread_mutex_unlock(&par.lock);
+    }
+
+    pthread_mutex_lock(&par.lock);
+    par.cancel = 1;
+    pthread_cond_broadcast(&par.cond);
+    pthread_mutex_unlock(&par.lock);
+
+    for (i = 0; i < started; i++)
+        pthread_join(threads[i], NULL);
+    for (i = 0; i < n; i++)
+    {
+        jsb_clean(&workers[i].tmp);
+        jsini_free_array(workers[i].row);
+    }
+
+    // Chunks parsed ahead of a failed callback
+    for (i = par.delivered; i < par.count; i++)
+    {
+        uint32_t k;
+        for (k = 0; k < par.chunks[i].rows.size; k++)
+            jsini_free((jsini_value_t *)par.chunks[i].rows.item[k]);
+        jsa_clean(&par.chunks[i].rows);
+    }
+
+    if (flags & JSINI_CSV_HEADER)
+        csv_template_clean(&keys);
+    csv_columns_clean(&columns);
+    pthread_mutex_destroy(&par.lock);
+    pthread_cond_destroy(&par.cond);
+    free(par.chunks);
+    free(workers);
+    free(threads);
+    return res;
+}
+
+static int csv_parse_file_parallel(const char *file, int flags, csv_select_t *select,
+                                   jsini_csv_filter_t *filter, jsini_jsonl_cb cb, void *user_data)
+{
+    struct stat st;
+    void *data;
+    int fd, res;
+
+    if ((fd = open(file, O_RDONLY)) < 0)
+        return JSINI_ERROR;
+
+    if (fstat(fd, &st) != 0)
+    {
+        close(fd);
+        return JSINI_ERROR;
+    }
+
+    if (st.st_size == 0)
+    {
+        close(fd);
+        return JSINI_OK;
+    }
+
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return JSINI_ERROR;
+
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    res = csv_parse_parallel((const char *)data, st.st_size, flags, select, filter, cb, user_data);
+    munmap(data, st.st_size);
+    return res;
+}
+
+#endif
+
+static int csv_reader_read_file(csv_reader_t *r, const char *file)
+{
+    FILE *fp;
+    char *buf;
+    size_t n;
+    int res = JSINI_OK;
+
+    if ((fp = fopen(file, "rb")) == NULL)
+        return JSINI_ERROR;
+
+    buf = (char *)xmalloc(CSV_CHUNK_SIZE);
+
+    while (res == JSINI_OK && (n = fread(buf, 1, CSV_CHUNK_SIZE, fp)) > 0)
+    {
+        res = csv_reader_feed(r, buf, n);
+    }
 
-            if (has_header && !headers)
-            {
-                headers = row;
-                continue;
-            }
+    if (res == JSINI_OK)
+        res = csv_reader_finish(r);
 
-            if (has_header)
-            {
-                jsini_object_t *obj = jsini_alloc_object();
-                uint32_t i;
-                for (i = 0; i < jsini_array_size(row); i++)
-                {
-                    if (i < jsini_array_size(headers))
-                    {
-                        jsini_value_t *hval = jsini_aget(headers, i);
-                        if (hval->type == JSINI_TSTRING)
-                        {
-                            jsini_string_t *hstr = (jsini_string_t *)hval;
-                            jsini_value_t *val = jsini_aget(row, i);
-
-                            if (val->type == JSINI_TSTRING)
-                            {
-                                jsini_string_t *vstr = (jsini_string_t *)val;
-                                jsini_set_string(obj, hstr->data.data, vstr->data.data);
-                            }
-                            else
-                            {
-                                jsini_set_null(obj, hstr->data.data);
-                            }
-                        }
-                    }
-                }
-                res = cb((jsini_value_t *)obj, user_data);
-                jsini_free_array(row);
-            }
-            else
-            {
-                res = cb((jsini_value_t *)row, user_data);
-            }
+    free(buf);
+    fclose(fp);
+    return res;
+}
 
-            if (res != JSINI_OK)
-                break;
-        }
-        else
+int jsini_parse_file_csv_filter(const char *file, int flags, const char *columns,
+                                jsini_csv_filter_t *filter, jsini_jsonl_cb cb, void *user_data)
+{
+    csv_reader_t reader;
+    csv_select_t select, *sel = NULL;
+    int res;
+
+    if (columns)
+    {
+        select.spec = columns;
+        select.keep = NULL;
+        select.size = 0;
+        sel = &select;
+        if (!(flags & JSINI_CSV_HEADER) && csv_select_resolve(sel, NULL) != JSINI_OK)
         {
-            // Error
-            res = JSINI_ERROR;
-            break;
+            free(select.keep);
+            return JSINI_ERROR;
         }
     }
+    if (filter && !(flags & JSINI_CSV_HEADER) && jsini_csv_filter_bind(filter, NULL) != JSINI_OK)
+    {
+        if (sel)
+            free(select.keep);
+        return JSINI_ERROR;
+    }
 
-    if (sb.size > 0 && res == JSINI_OK)
+#ifdef CSV_HAVE_PARALLEL
+    // Quote parity only works with a single quote character
+    if ((flags & JSINI_CSV_PARALLEL) && (flags & JSINI_CSV_DOUBLE_QUOTE))
     {
-        // Trailing data?
-        jsini_array_t *row = NULL;
-        int parse_res = try_parse_csv_record(sb.data, sb.size, flags, &row);
-        if (parse_res == JSINI_OK && jsini_array_size(row) > 0)
-        {
-            // Handle last row
-            if (has_header && headers)
-            {
-                jsini_object_t *obj = jsini_alloc_object();
-                uint32_t i;
-                for (i = 0; i < jsini_array_size(row); i++)
-                {
-                    if (i < jsini_array_size(headers))
-                    {
-                        jsini_value_t *hval = jsini_aget(headers, i);
-                        if (hval->type == JSINI_TSTRING)
-                        {
-                            jsini_string_t *hstr = (jsini_string_t *)hval;
-                            jsini_value_t *val = jsini_aget(row, i);
-                            if (val->type == JSINI_TSTRING)
-                            {
-                                jsini_string_t *vstr = (jsini_string_t *)val;
-                                jsini_set_string(obj, hstr->data.data, vstr->data.data);
-                            }
-                            else
-                            {
-                                jsini_set_null(obj, hstr->data.data);
-                            }
-                        }
-                    }
-                }
-                cb((jsini_value_t *)obj, user_data);
-                jsini_free_array(row);
-            }
-            else if (!has_header)
-            {
-                cb((jsini_value_t *)row, user_data);
-            }
-            else
-            {
-                jsini_free_array(row);
-            }
-        }
-        else if (row)
-        {
-            jsini_free_array(row);
-        }
+        res = csv_parse_file_parallel(file, flags, sel, filter, cb, user_data);
+        if (sel)
+            free(select.keep);
+        return res;
     }
+#endif
 
-    if (headers)
-        jsini_free_array(headers);
-    jsb_clean(&sb);
-    jsb_clean(&line_buf);
-    fclose(fp);
+    csv_reader_init(&reader, flags, cb, user_data);
+    reader.select = sel;
+    reader.filter = filter;
+    res = csv_reader_read_file(&reader, file);
+    csv_reader_clean(&reader);
+    if (sel)
+        free(select.keep);
     return res;
 }
 
+int jsini_parse_file_csv_select(const char *file, int flags, const char *columns,
+                                jsini_jsonl_cb cb, void *user_data)
+{
+    return jsini_parse_file_csv_filter(file, flags, columns, NULL, cb, user_data);
+}
+
+int jsini_parse_file_csv_ex(const char *file, int flags, jsini_jsonl_cb cb, void *user_data)
+{
+    return jsini_parse_file_csv_filter(file, flags, NULL, NULL, cb, user_data);
+}
+
 static int csv_collect_cb(jsini_value_t *val, void *user_data)
 {
     jsini_array_t *array = (jsini_array_t *)user_data;
@@ -286,6 +1952,125 @@ jsini_value_t *jsini_parse_file_csv(const char *file)
     return (jsini_value_t *)array;
 }
 
+/*
+ * Columns being filled from unkeyed records. They are created at the first
+ * record, each packed by the type of its first value, and only attached to
+ * the result at the end so that a repeated header name simply wins.
+ */
+typedef struct
+{
+    const csv_reader_t *reader;
+    jsa_t columns;
+} csv_columnar_t;
+
+static void csv_column_push(jsini_array_t *column, jsini_value_t *value)
+{
+    uint32_t i;
+
+    // An integer column becomes a number column at its first number
+    if (column->packed == JSINI_TINTEGER && value->type == JSINI_TNUMBER)
+    {
+        for (i = 0; i < column->data.size; i++)
+        {
+            double d = (double)(int64_t)column->data.item[i];
+            memcpy(&column->data.item[i], &d, sizeof(d));
+        }
+        column->packed = JSINI_TNUMBER;
+    }
+
+    if (column->packed == JSINI_TNUMBER && value->type == JSINI_TINTEGER)
+    {
+        jsini_push_number(column, (double)((jsini_integer_t *)value)->data);
+        jsini_free(value);
+        return;
+    }
+
+    jsini_push_value(column, value);
+}
+
+static void csv_columnar_create(csv_columnar_t *c, uint32_t count, jsini_array_t *row)
+{
+    uint32_t i;
+
+    for (i = 0; i < count; i++)
+    {
+        uint8_t type = row && i < jsini_array_size(row) ? jsini_aget(row, i)->type : JSINI_TNULL;
+        jsa_push(&c->columns, jsini_alloc_packed_array(type));
+    }
+}
+
+static int csv_columnar_cb(jsini_value_t *value, void *user_data)
+{
+    csv_columnar_t *c = (csv_columnar_t *)user_data;
+    jsini_array_t *row = (jsini_array_t *)value;
+    uint32_t i;
+
+    if (c->columns.size == 0)
+        csv_columnar_create(c, c->reader->headers ? jsini_array_size(c->reader->headers)
+                                                  : jsini_array_size(row), row);
+
+    for (i = 0; i < jsini_array_size(row); i++)
+    {
+        jsini_value_t *field = jsini_aget(row, i);
+        if (i < c->columns.size)
+            csv_column_push((jsini_array_t *)c->columns.item[i], field);
+        else
+            jsini_free(field);
+    }
+    // Missing trailing fields
+    for (; i < c->columns.size; i++)
+        jsini_push_null((jsini_array_t *)c->columns.item[i]);
+
+    jsini_array_resize(row, 0);
+    jsini_free_array(row);
+    return JSINI_OK;
+}
+
+jsini_value_t *jsini_parse_file_csv_columnar(const char *file, int flags)
+{
+    csv_reader_t reader;
+    csv_columnar_t columnar;
+    jsini_value_t *result = NULL;
+    uint32_t i;
+
+    csv_reader_init(&reader, flags, csv_columnar_cb, &columnar);
+    reader.keyed = 0;
+    columnar.reader = &reader;
+    jsa_init(&columnar.columns);
+
+    if (csv_reader_read_file(&reader, file) == JSINI_OK)
+    {
+        if (reader.headers)
+        {
+            jsini_object_t *obj = jsini_alloc_object();
+            if (columnar.columns.size == 0)
+                csv_columnar_create(&columnar, jsini_array_size(reader.headers), NULL);
+            for (i = 0; i < columnar.columns.size; i++)
+            {
+                jsini_string_t *name = (jsini_string_t *)jsini_aget(reader.headers, i);
+                jsini_set_value(obj, name->data.data, (jsini_value_t *)columnar.columns.item[i]);
+            }
+            result = (jsini_value_t *)obj;
+        }
+        else
+        {
+            jsini_array_t *array = jsini_alloc_array();
+            for (i = 0; i < columnar.columns.size; i++)
+                jsini_push_value(array, (jsini_value_t *)columnar.columns.item[i]);
+            result = (jsini_value_t *)array;
+        }
+    }
+    else
+    {
+        for (i = 0; i < columnar.columns.size; i++)
+            jsini_free((jsini_value_t *)columnar.columns.item[i]);
+    }
+
+    jsa_clean(&columnar.columns);
+    csv_reader_clean(&reader);
+    return result;
+}
+
 static void csv_append_string(jsb_t *sb, const char *s, char delimiter)
 {
     int needs_quote = 0;
@@ -324,286 +2109,244 @@ static void csv_append_string(jsb_t *sb, const char *s, char delimiter)
     }
 }
 
-int jsini_print_file_csv(const char *file, const jsini_value_t *value, char delimiter)
-{
-    if (value->type != JSINI_TARRAY)
-        return JSINI_ERROR;
+#define CSV_WRITE_FLUSH 65536
 
-    FILE *fp = fopen(file, "w");
-    if (!fp)
-        return JSINI_ERROR;
+/*
+ * Streaming writer. Lines are collected in `buf` and written out in blocks,
+ * so memory stays bounded by the longest row whatever the number of rows.
+ */
+struct jsini_csv_writer_t
+{
+    FILE *fp;
+    int owns_fp;
+    char delimiter;
+    jsb_t buf;
+    jsb_t tmp;                  // nested values as JSON text
+    jsini_array_t *columns;     // header names; NULL until set or seen
+    int header_done;
+    int error;
+};
 
-    jsini_array_t *arr = (jsini_array_t *)value;
-    if (jsini_array_size(arr) == 0)
+static void csv_writer_flush(jsini_csv_writer_t *w)
+{
+    if (w->buf.size > 0)
     {
-        fclose(fp);
-        return JSINI_OK;
+        if (fwrite(w->buf.data, 1, w->buf.size, w->fp) != w->buf.size)
+            w->error = 1;
+        jsb_clear(&w->buf);
     }
+}
+
+static void csv_writer_end_line(jsini_csv_writer_t *w)
+{
+    jsb_append_char(&w->buf, '\n');
+    if (w->buf.size >= CSV_WRITE_FLUSH)
+        csv_writer_flush(w);
+}
+
+static void csv_writer_header(jsini_csv_writer_t *w)
+{
+    uint32_t i;
 
-    jsini_value_t *first = jsini_aget(arr, 0);
-    jsini_array_t *headers = NULL;
+    w->header_done = 1;
+    if (!w->columns)
+        return;
 
-    if (first->type == JSINI_TOBJECT)
+    for (i = 0; i < jsini_array_size(w->columns); i++)
     {
-        headers = jsini_alloc_array();
-        jsini_object_t *obj = (jsini_object_t *)first;
-        uint32_t i;
-        for (i = 0; i < obj->keys.size; i++)
-        {
-            jsini_attr_t *attr = (jsini_attr_t *)obj->keys.item[i];
-            jsini_push_string(headers, attr->name->data.data, attr->name->data.size);
-        }
+        if (i > 0)
+            jsb_append_char(&w->buf, w->delimiter);
+        csv_append_string(&w->buf, jsini_aget_string(w->columns, i), w->delimiter);
+    }
+    csv_writer_end_line(w);
+}
 
-        jsb_t sb;
-        jsb_init(&sb);
-        for (i = 0; i < jsini_array_size(headers); i++)
-        {
-            if (i > 0)
-                jsb_append_char(&sb, delimiter);
-            jsini_string_t *h = (jsini_string_t *)jsini_aget(headers, i);
-            csv_append_string(&sb, h->data.data, delimiter);
-        }
-        jsb_append_char(&sb, '\n');
-        fwrite(sb.data, 1, sb.size, fp);
-        jsb_clean(&sb);
+// Null and undefined leave the cell empty; arrays and objects go in as JSON
+static void csv_writer_value(jsini_csv_writer_t *w, const jsini_value_t *v)
+{
+    switch (v->type)
+    {
+    case JSINI_TSTRING:
+        csv_append_string(&w->buf, ((const jsini_string_t *)v)->data.data, w->delimiter);
+        break;
+    case JSINI_TINTEGER:
+        jsb_printf(&w->buf, "%ld", ((const jsini_integer_t *)v)->data);
+        break;
+    case JSINI_TNUMBER:
+        jsb_printf(&w->buf, "%g", ((const jsini_number_t *)v)->data);
+        break;
+    case JSINI_TBOOL:
+        jsb_printf(&w->buf, "%s", ((const jsini_bool_t *)v)->data ? "true" : "false");
+        break;
+    case JSINI_TARRAY:
+    case JSINI_TOBJECT:
+        jsb_clear(&w->tmp);
+        jsini_stringify(v, &w->tmp, 0, 0);
+        csv_append_string(&w->buf, w->tmp.data, w->delimiter);
+        break;
     }
+}
+
+jsini_csv_writer_t *jsini_csv_writer_open(const char *file, char delimiter)
+{
+    jsini_csv_writer_t *w;
+    FILE *fp = file ? fopen(file, "w") : stdout;
+
+    if (!fp)
+        return NULL;
 
+    w = (jsini_csv_writer_t *)xmalloc(sizeof(jsini_csv_writer_t));
+    w->fp = fp;
+    w->owns_fp = file != NULL;
+    w->delimiter = delimiter;
+    jsb_init(&w->buf);
+    jsb_init(&w->tmp);
+    w->columns = NULL;
+    w->header_done = 0;
+    w->error = 0;
+    return w;
+}
+
+int jsini_csv_writer_columns(jsini_csv_writer_t *w, const jsini_array_t *names)
+{
     uint32_t i;
-    for (i = 0; i < jsini_array_size(arr); i++)
-    {
-        jsini_value_t *row_val = jsini_aget(arr, i);
-        jsb_t sb;
-        jsb_init(&sb);
 
-        if (headers && row_val->type == JSINI_TOBJECT)
-        {
-            jsini_object_t *obj = (jsini_object_t *)row_val;
-            uint32_t k;
-            for (k = 0; k < jsini_array_size(headers); k++)
-            {
-                if (k > 0)
-                    jsb_append_char(&sb, delimiter);
-                jsini_string_t *key = (jsini_string_t *)jsini_aget(headers, k);
-                jsini_value_t *v = jsini_get_value(obj, key->data.data);
-                if (v)
-                {
-                    if (v->type == JSINI_TSTRING)
-                    {
-                        csv_append_string(&sb, ((jsini_string_t *)v)->data.data, delimiter);
-                    }
-                    else if (v->type == JSINI_TINTEGER)
-                    {
-                        jsb_printf(&sb, "%ld", ((jsini_integer_t *)v)->data);
-                    }
-                    else if (v->type == JSINI_TNUMBER)
-                    {
-                        jsb_printf(&sb, "%g", ((jsini_number_t *)v)->data);
-                    }
-                    else if (v->type == JSINI_TBOOL)
-                    {
-                        jsb_printf(&sb, "%s", ((jsini_bool_t *)v)->data ? "true" : "false");
-                    }
-                }
-            }
-        }
-        else if (!headers && row_val->type == JSINI_TARRAY)
-        {
-            jsini_array_t *row_arr = (jsini_array_t *)row_val;
-            uint32_t k;
-            for (k = 0; k < jsini_array_size(row_arr); k++)
-            {
-                if (k > 0)
-                    jsb_append_char(&sb, delimiter);
-                jsini_value_t *v = jsini_aget(row_arr, k);
-                if (v->type == JSINI_TSTRING)
-                {
-                    csv_append_string(&sb, ((jsini_string_t *)v)->data.data, delimiter);
-                }
-                else if (v->type == JSINI_TINTEGER)
-                {
-                    jsb_printf(&sb, "%ld", ((jsini_integer_t *)v)->data);
-                }
-                else if (v->type == JSINI_TNUMBER)
-                {
-                    jsb_printf(&sb, "%g", ((jsini_number_t *)v)->data);
-                }
-                else if (v->type == JSINI_TBOOL)
-                {
-                    jsb_printf(&sb, "%s", ((jsini_bool_t *)v)->data ? "true" : "false");
-                }
-            }
-        }
+    if (w->header_done)
+        return JSINI_ERROR;
 
-        jsb_append_char(&sb, '\n');
-        fwrite(sb.data, 1, sb.size, fp);
-        jsb_clean(&sb);
+    if (w->columns)
+        jsini_free_array(w->columns);
+    w->columns = jsini_alloc_packed_array(JSINI_TSTRING);
+    for (i = 0; i < jsini_array_size(names); i++)
+    {
+        size_t size;
+        const char *name = jsini_array_get_string(names, i, &size);
+        jsini_push_string(w->columns, name ? name : "", name ? size : 0);
     }
-
-    if (headers)
-        jsini_free_array(headers);
-    fclose(fp);
     return JSINI_OK;
 }
 
-jsini_value_t *jsini_parse_string_csv(const char *s, uint32_t len)
+int jsini_csv_write_row(jsini_csv_writer_t *w, const jsini_value_t *row)
 {
-    jsini_array_t *root = jsini_alloc_array();
-    const char *p = s;
-    const char *end = s + len;
-    jsb_t sb;
-    jsb_init(&sb);
+    uint32_t i;
 
-    int flags = JSINI_CSV_DEFAULT;
-    int has_header = (flags & JSINI_CSV_HEADER) ? 1 : 0;
-    jsini_array_t *headers = NULL;
+    if (w->error)
+        return JSINI_ERROR;
 
-    while (p < end)
+    if (row->type == JSINI_TOBJECT)
     {
-        const char *line_start = p;
-        while (p < end && *p != '\n' && *p != '\r')
-        {
-            p++;
-        }
+        jsini_object_t *obj = (jsini_object_t *)row;
 
-        if (p < end && *p == '\r')
+        if (!w->columns && !w->header_done)
         {
-            p++;
-            if (p < end && *p == '\n')
+            w->columns = jsini_alloc_packed_array(JSINI_TSTRING);
+            for (i = 0; i < obj->keys.size; i++)
             {
-                p++;
+                const jsb_t *name = &((jsini_attr_t *)obj->keys.item[i])->name->data;
+                jsini_push_string(w->columns, name->data, name->size);
             }
         }
-        else if (p < end && *p == '\n')
+        if (!w->header_done)
+            csv_writer_header(w);
+
+        for (i = 0; w->columns && i < jsini_array_size(w->columns); i++)
         {
-            p++;
+            jsini_value_t *v = jsini_get_value(obj, jsini_aget_string(w->columns, i));
+            if (i > 0)
+                jsb_append_char(&w->buf, w->delimiter);
+            if (v)
+                csv_writer_value(w, v);
         }
+    }
+    else if (row->type == JSINI_TARRAY)
+    {
+        jsini_array_t *arr = (jsini_array_t *)row;
 
-        jsb_append(&sb, line_start, p - line_start);
-
-        jsini_array_t *row = NULL;
-        int parse_res = try_parse_csv_record(sb.data, sb.size, flags, &row);
+        if (!w->header_done)
+            csv_writer_header(w);
 
-        if (parse_res == JSINI_CSV_INCOMPLETE)
-        {
-            continue;
-        }
-        else if (parse_res == JSINI_OK)
+        for (i = 0; i < jsini_array_size(arr); i++)
         {
-            jsb_clear(&sb);
-            if (jsini_array_size(row) > 0)
-            {
-                if (has_header && !headers)
-                {
-                    headers = row;
-                }
-                else if (has_header)
-                {
-                    jsini_object_t *obj = jsini_alloc_object();
-                    uint32_t i;
-                    for (i = 0; i < jsini_array_size(row); i++)
-                    {
-                        if (i < jsini_array_size(headers))
-                        {
-                            jsini_value_t *hval = jsini_aget(headers, i);
-                            if (hval->type == JSINI_TSTRING)
-                            {
-                                jsini_string_t *hstr = (jsini_string_t *)hval;
-                                jsini_value_t *val = jsini_aget(row, i);
-
-                                if (val->type == JSINI_TSTRING)
-                                {
-                                    jsini_string_t *vstr = (jsini_string_t *)val;
-                                    jsini_set_string(obj, hstr->data.data, vstr->data.data);
-                                }
-                                else
-                                {
-                                    jsini_set_null(obj, hstr->data.data);
-                                }
-                            }
-                        }
-                    }
-                    jsini_push_value(root, (jsini_value_t *)obj);
-                    jsini_free_array(row);
-                }
-                else
-                {
-                    jsini_push_value(root, (jsini_value_t *)row);
-                }
-            }
+            if (i > 0)
+                jsb_append_char(&w->buf, w->delimiter);
+            if (arr->packed == JSINI_TBOOL)
+                jsb_printf(&w->buf, "%s", jsini_aget_bool(arr, i) ? "true" : "false");
+            else if (arr->packed == JSINI_TINTEGER)
+                jsb_printf(&w->buf, "%ld", jsini_aget_integer(arr, i));
+            else if (arr->packed == JSINI_TNUMBER)
+                jsb_printf(&w->buf, "%g", jsini_aget_number(arr, i));
+            else if (arr->packed == JSINI_TSTRING)
+                csv_append_string(&w->buf, jsini_aget_string(arr, i), w->delimiter);
             else
-            {
-                jsini_free_array(row);
-            }
-        }
-        else
-        {
-            if (row)
-                jsini_free_array(row);
-            jsini_free_array(root);
-            if (headers) jsini_free_array(headers);
-            jsb_clean(&sb);
-            return NULL;
+                csv_writer_value(w, (jsini_value_t *)arr->data.item[i]);
         }
     }
+    else
+    {
+        w->error = 1;
+        return JSINI_ERROR;
+    }
 
-    if (sb.size > 0)
+    csv_writer_end_line(w);
+    return w->error ? JSINI_ERROR : JSINI_OK;
+}
+
+int jsini_csv_writer_close(jsini_csv_writer_t *w)
+{
+    int res;
+
+    if (!w->header_done)
+        csv_writer_header(w);
+    csv_writer_flush(w);
+
+    if (w->owns_fp)
     {
-        jsini_array_t *row = NULL;
-        int parse_res = try_parse_csv_record(sb.data, sb.size, 0, &row);
-        if (parse_res == JSINI_OK)
-        {
-            if (jsini_array_size(row) > 0)
-            {
-                if (has_header && !headers)
-                {
-                    headers = row; // Last row is header? Unlikely but consistent logic
-                }
-                else if (has_header && headers)
-                {
-                    jsini_object_t *obj = jsini_alloc_object();
-                    uint32_t i;
-                    for (i = 0; i < jsini_array_size(row); i++)
-                    {
-                        if (i < jsini_array_size(headers))
-                        {
-                            jsini_value_t *hval = jsini_aget(headers, i);
-                            if (hval->type == JSINI_TSTRING)
-                            {
-                                jsini_string_t *hstr = (jsini_string_t *)hval;
-                                jsini_value_t *val = jsini_aget(row, i);
-                                if (val->type == JSINI_TSTRING)
-                                {
-                                    jsini_string_t *vstr = (jsini_string_t *)val;
-                                    jsini_set_string(obj, hstr->data.data, vstr->data.data);
-                                }
-                                else
-                                {
-                                    jsini_set_null(obj, hstr->data.data);
-                                }
-                            }
-                        }
-                    }
-                    jsini_push_value(root, (jsini_value_t *)obj);
-                    jsini_free_array(row);
-                }
-                else
-                {
-                    jsini_push_value(root, (jsini_value_t *)row);
-                }
-            }
-            else
-            {
-                jsini_free_array(row);
-            }
-        }
-        else if (row)
-        {
-            jsini_free_array(row);
-        }
+        if (fclose(w->fp) != 0)
+            w->error = 1;
+    }
+    else if (fflush(w->fp) != 0)
+    {
+        w->error = 1;
     }
 
-    if (headers)
-        jsini_free_array(headers);
-    jsb_clean(&sb);
+    res = w->error ? JSINI_ERROR : JSINI_OK;
+    if (w->columns)
+        jsini_free_array(w->columns);
+    jsb_clean(&w->buf);
+    jsb_clean(&w->tmp);
+    free(w);
+    return res;
+}
+
+int jsini_print_file_csv(const char *file, const jsini_value_t *value, char delimiter)
+{
+    jsini_array_t *arr = (jsini_array_t *)value;
+    jsini_csv_writer_t *w;
+    uint32_t i;
+    int res = JSINI_OK;
+
+    if (value->type != JSINI_TARRAY)
+        return JSINI_ERROR;
+
+    if ((w = jsini_csv_writer_open(file, delimiter)) == NULL)
+        return JSINI_ERROR;
+
+    for (i = 0; res == JSINI_OK && i < jsini_array_size(arr); i++)
+        res = jsini_csv_write_row(w, jsini_aget(arr, i));
+
+    // Closing reports an earlier failed row as well
+    return jsini_csv_writer_close(w);
+}
+
+jsini_value_t *jsini_parse_string_csv(const char *s, uint32_t len)
+{
+    jsini_array_t *root = jsini_alloc_array();
+    csv_reader_t reader;
+
+    csv_reader_init(&reader, JSINI_CSV_DEFAULT, csv_collect_cb, root);
+    csv_reader_feed(&reader, s, len);
+    csv_reader_finish(&reader);
+    csv_reader_clean(&reader);
+
     return (jsini_value_t *)root;
-}
\ No newline at end of file
+}
@@ -49,7 +49,7 @@ static jsini_string_t *jsini_read_section_header(jsl_t *lex) {
 
 static jsini_string_t *jsini_read_ini_bare_string(jsl_t *lex) {
     jsini_string_t *s = jsini_alloc_string(NULL, 0);
-    s->lineno = lex->lineno;
+    jsini_set_lineno(s, lex->lineno);
 
     while (lex->input != lex->input_end) {
         char c = *lex->input++;
@@ -11,15 +11,60 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef JSINI_COUNT_ALLOCS
+#define xmalloc jsini_counted_malloc
+#else
 #define xmalloc malloc
+#endif
 #define xfree free
 
 jsini_value_t *jsini_read_json(jsl_t *js);
 int jsl_decode_json_string(jsl_t *lex, jsb_t *s);;
 
+/*
+ * Reads a bool or number straight into an array that is packed or still
+ * empty, without allocating a node. Returns 0 and leaves the input alone for
+ * anything else.
+ */
+static int jsini_read_packed(jsl_t *lex, jsini_array_t *array) {
+#ifdef JSINI_HAVE_PACKED
+    const char *start = lex->input;
+    jsl_scalar_t scalar;
+
+    if (array->data.size > 0 && !array->packed) {
+        return 0;
+    }
+
+    if (!jsl_scan_primitive(lex, &scalar) || scalar.type == JSINI_TNULL) {
+        lex->input = start;
+        return 0;
+    }
+
+    if (array->data.size == 0) {
+        array->packed = scalar.type;
+    }
+
+    switch (scalar.type) {
+    case JSINI_TBOOL:
+        jsini_push_bool(array, (int) scalar.data.integer);
+        break;
+    case JSINI_TINTEGER:
+        jsini_push_integer(array, scalar.data.integer);
+        break;
+    default:
+        jsini_push_number(array, scalar.data.number);
+        break;
+    }
+
+    return 1;
+#else
+    return 0;
+#endif
+}
+
 static jsini_array_t *jsini_read_json_array(jsl_t *lex) {
     jsini_array_t *array = jsini_alloc_array();
-    array->lineno = lex->lineno;
+    jsini_set_lineno(array, lex->lineno);
 
     char array_open = *lex->input;
     char array_end;
@@ -52,11 +97,15 @@ static jsini_array_t *jsini_read_json_array(jsl_t *lex) {
             return array;
         }
 
+        if ((lex->options & JSINI_PACK_ARRAYS) && jsini_read_packed(lex, array)) {
+            continue;
+        }
+
         if ((value = jsini_read_json(lex)) == NULL) {
             goto fail;
         }
 
-        jsa_push(&array->data, value);
+        jsini_push_value(array, value);
     }
 
     lex->error = JSINI_ERROR_NOT_CLOSED;
@@ -67,18 +116,9 @@ fail:
     return NULL;
 }
 
-jsini_string_t *jsl_read_attr_name(jsl_t *lex) {
-    jsini_string_t *result = jsini_alloc_string(NULL, 0);
-    result->lineno = lex->lineno;
-
-    jsb_t *sb = &result->data;
-
+static int jsl_scan_attr_name(jsl_t *lex, jsb_t *sb) {
     if (*lex->input == '\'' || *lex->input == '"' || *lex->input == '`') {
-        if (jsl_decode_json_string(lex, sb) != JSINI_OK) {
-            jsini_free_string(result);
-            return NULL;
-        }
-        return result;
+        return jsl_decode_json_string(lex, sb);
     }
 
     while (lex->input != lex->input_end) {
@@ -88,7 +128,14 @@ jsini_string_t *jsl_read_attr_name(jsl_t *lex) {
         lex->input++;
     }
 
-    if (sb->size == 0) {
+    return sb->size > 0 ? JSINI_OK : JSINI_ERROR_NAME;
+}
+
+jsini_string_t *jsl_read_attr_name(jsl_t *lex) {
+    jsini_string_t *result = jsini_alloc_string(NULL, 0);
+    jsini_set_lineno(result, lex->lineno);
+
+    if (jsl_scan_attr_name(lex, &result->data) != JSINI_OK) {
         jsini_free_string(result);
         return NULL;
     }
@@ -135,15 +182,12 @@ static int jsl_read_env(jsl_t *lex, jsb_t *s) {
     return JSINI_OK;
 }
 
-static jsini_string_t *jsini_read_json_bare_string(jsl_t *lex) {
-    jsini_string_t *s = jsini_alloc_string(NULL, 0);
-    s->lineno = lex->lineno;
-
+static void jsl_scan_bare_string(jsl_t *lex, jsb_t *sb) {
     while (lex->input != lex->input_end) {
         char c = *lex->input++;
         if (c == '$' && lex->input < lex->input_end && *lex->input == '{') {
-            jsl_read_env(lex, &s->data);
-            return s;
+            jsl_read_env(lex, sb);
+            return;
         }
         if (c == ',' || isspace(c)) {
             break;
@@ -152,15 +196,20 @@ static jsini_string_t *jsini_read_json_bare_string(jsl_t *lex) {
             lex->input--;
             break;
         }
-        jsb_append_char(&s->data, c);
+        jsb_append_char(sb, c);
     }
+}
 
+jsini_string_t *jsl_read_bare_string(jsl_t *lex) {
+    jsini_string_t *s = jsini_alloc_string(NULL, 0);
+    jsini_set_lineno(s, lex->lineno);
+    jsl_scan_bare_string(lex, &s->data);
     return s;
 }
 
 static jsini_object_t *jsini_read_json_object(jsl_t *lex) {
     jsini_object_t *object = jsini_alloc_object();
-    object->lineno = lex->lineno;
+    jsini_set_lineno(object, lex->lineno);
 
     assert(*lex->input == '{');
 
@@ -187,11 +236,19 @@ static jsini_object_t *jsini_read_json_object(jsl_t *lex) {
             goto fail;
         }
 
-        attr = jsini_alloc_attr(object, name);
+        /* A repeated key keeps its first position and takes the last value */
+        if ((attr = (jsini_attr_t*) jsh_get(object->map, name->data.data)) != NULL) {
+            jsini_free_string(name);
+            jsini_free(attr->value);
+            attr->value = NULL;
+        }
+        else {
+            attr = jsini_alloc_attr(object, name);
+        }
 
         jsl_skip_space(lex, NULL);
 
-        if (*lex->input != ':' && *lex->input != '=') {
+        if (lex->input == lex->input_end || (*lex->input != ':' && *lex->input != '=')) {
             lex->error_char = ':';
             lex->error = JSINI_ERROR_SEPARATOR;
             goto fail;
@@ -234,7 +291,7 @@ jsini_value_t *jsini_read_json(jsl_t *lex) {
         return (jsini_value_t*)jsl_read_json_string(lex);
     default:
         if ((value = jsl_read_primitive(lex)) == NULL) {
-            value = (jsini_value_t*)jsini_read_json_bare_string(lex);
+            value = (jsini_value_t*)jsl_read_bare_string(lex);
         }
         break;
     }
@@ -242,6 +299,290 @@ jsini_value_t *jsini_read_json(jsl_t *lex) {
     return value;
 }
 
+static int jsl_read_events_object(jsl_t *lex, const jsl_handler_t *h, jsb_t *s, void *ud) {
+    int res;
+
+    lex->error_char = *lex->input++;
+    if ((res = h->begin_object(ud)) != JSINI_OK) {
+        return res;
+    }
+
+    while (lex->input < lex->input_end) {
+        jsl_skip_space(lex, ",");
+
+        if (lex->input == lex->input_end) {
+            break;
+        }
+
+        if (*lex->input == '}') {
+            lex->input++;
+            return h->end_object(ud);
+        }
+
+        jsb_clear(s);
+        if (jsl_scan_attr_name(lex, s) != JSINI_OK) {
+            return (lex->error = JSINI_ERROR_NAME);
+        }
+        if ((res = h->key(ud, s->data, s->size)) != JSINI_OK) {
+            return res;
+        }
+
+        jsl_skip_space(lex, NULL);
+
+        if (lex->input == lex->input_end || (*lex->input != ':' && *lex->input != '=')) {
+            lex->error_char = ':';
+            return (lex->error = JSINI_ERROR_SEPARATOR);
+        }
+
+        lex->input++;
+
+        /* Perl style hash */
+        jsl_skip_space(lex, ">");
+
+        if ((res = jsl_read_events(lex, h, s, ud)) != JSINI_OK) {
+            return res;
+        }
+    }
+
+    return (lex->error = JSINI_ERROR_NOT_CLOSED);
+}
+
+static int jsl_read_events_array(jsl_t *lex, const jsl_handler_t *h, jsb_t *s, void *ud) {
+    char array_end = *lex->input == '(' ? ')' : ']';
+    int res;
+
+    lex->error_char = *lex->input++;
+    if ((res = h->begin_array(ud)) != JSINI_OK) {
+        return res;
+    }
+
+    while (lex->input < lex->input_end) {
+        jsl_skip_space(lex, ",");
+
+        if (lex->input == lex->input_end) {
+            break;
+        }
+
+        if (*lex->input == array_end) {
+            lex->input++;
+            return h->end_array(ud);
+        }
+
+        if ((res = jsl_read_events(lex, h, s, ud)) != JSINI_OK) {
+            return res;
+        }
+    }
+
+    return (lex->error = JSINI_ERROR_NOT_CLOSED);
+}
+
+int jsl_read_events(jsl_t *lex, const jsl_handler_t *h, jsb_t *s, void *ud) {
+    jsl_scalar_t scalar;
+
+    jsl_skip_space(lex, NULL);
+
+    if (lex->input >= lex->input_end) {
+        return (lex->error = JSINI_ERROR_EOF);
+    }
+
+    switch (*lex->input) {
+    case '{':
+        return jsl_read_events_object(lex, h, s, ud);
+    case '[':
+    case '(':
+        return jsl_read_events_array(lex, h, s, ud);
+    case '"':
+    case '\'':
+    case '`':
+        jsb_clear(s);
+        if (jsl_decode_json_string(lex, s) != JSINI_OK) {
+            return lex->error;
+        }
+        return h->string(ud, s->data, s->size);
+    default:
+        if (jsl_scan_primitive(lex, &scalar)) {
+            return h->scalar(ud, &scalar);
+        }
+        jsb_clear(s);
+        jsl_scan_bare_string(lex, s);
+        return h->string(ud, s->data, s->size);
+    }
+}
+
+static int jsl_skip_string(jsl_t *lex) {
+    char quote = *lex->input++;
+
+    while (lex->input < lex->input_end) {
+        char c = *lex->input++;
+        if (c == quote) {
+            return JSINI_OK;
+        }
+        if (c == '\\' && lex->input < lex->input_end) {
+            lex->input++;
+        }
+    }
+    return (lex->error = JSINI_ERROR_EOF);
+}
+
+// Moves past a member name and its separator, leaving the input at the value
+static int jsl_skip_attr_name(jsl_t *lex, jsb_t *s, int decode) {
+    const char *start = lex->input;
+
+    if (decode) {
+        jsb_clear(s);
+        if (jsl_scan_attr_name(lex, s) != JSINI_OK) {
+            return (lex->error = JSINI_ERROR_NAME);
+        }
+    } else if (*lex->input == '\'' || *lex->input == '"' || *lex->input == '`') {
+        if (jsl_skip_string(lex) != JSINI_OK) {
+            return lex->error;
+        }
+    } else {
+        while (lex->input != lex->input_end && (isalnum(*lex->input) || *lex->input == '_')) {
+            lex->input++;
+        }
+        if (lex->input == start) {
+            return (lex->error = JSINI_ERROR_NAME);
+        }
+    }
+
+    jsl_skip_space(lex, NULL);
+
+    if (lex->input == lex->input_end || (*lex->input != ':' && *lex->input != '=')) {
+        lex->error_char = ':';
+        return (lex->error = JSINI_ERROR_SEPARATOR);
+    }
+
+    lex->input++;
+
+    /* Perl style hash */
+    jsl_skip_space(lex, ">");
+    return JSINI_OK;
+}
+
+static int jsl_skip_container(jsl_t *lex, jsb_t *s) {
+    char open = *lex->input;
+    char close = open == '{' ? '}' : open == '(' ? ')' : ']';
+
+    lex->error_char = *lex->input++;
+
+    while (lex->input < lex->input_end) {
+        jsl_skip_space(lex, ",");
+
+        if (lex->input == lex->input_end) {
+            break;
+        }
+
+        if (*lex->input == close) {
+            lex->input++;
+            return JSINI_OK;
+        }
+
+        if (open == '{' && jsl_skip_attr_name(lex, s, 0) != JSINI_OK) {
+            return lex->error;
+        }
+
+        if (jsl_skip_value(lex, s) != JSINI_OK) {
+            return lex->error;
+        }
+    }
+
+    return (lex->error = JSINI_ERROR_NOT_CLOSED);
+}
+
+int jsl_skip_value(jsl_t *lex, jsb_t *s) {
+    jsl_scalar_t scalar;
+
+    jsl_skip_space(lex, NULL);
+
+    if (lex->input >= lex->input_end) {
+        return (lex->error = JSINI_ERROR_EOF);
+    }
+
+    switch (*lex->input) {
+    case '{':
+    case '[':
+    case '(':
+        return jsl_skip_container(lex, s);
+    case '"':
+    case '\'':
+    case '`':
+        return jsl_skip_string(lex);
+    default:
+        if (!jsl_scan_primitive(lex, &scalar)) {
+            jsb_clear(s);
+            jsl_scan_bare_string(lex, s);
+        }
+        return JSINI_OK;
+    }
+}
+
+/*
+ * Moves to the value of member `key` of the object at the input. The whole
+ * object is skipped first, since a repeated key keeps its last value when the
+ * object is parsed.
+ */
+static int jsl_find_attr(jsl_t *lex, const char *key, size_t size, jsb_t *s) {
+    jsl_t found;
+    int matched = 0;
+
+    lex->error_char = *lex->input++;
+
+    while (lex->input < lex->input_end) {
+        jsl_skip_space(lex, ",");
+
+        if (lex->input == lex->input_end) {
+            break;
+        }
+
+        if (*lex->input == '}') {
+            lex->input++;
+            if (matched) {
+                *lex = found;
+            }
+            return matched;
+        }
+
+        if (jsl_skip_attr_name(lex, s, 1) != JSINI_OK) {
+            return lex->error;
+        }
+
+        if (s->size == size && memcmp(s->data, key, size) == 0) {
+            found = *lex;
+            matched = 1;
+        }
+
+        if (jsl_skip_value(lex, s) != JSINI_OK) {
+            return lex->error;
+        }
+    }
+
+    return (lex->error = JSINI_ERROR_NOT_CLOSED);
+}
+
+int jsl_find_path(jsl_t *lex, const char *path, jsb_t *s) {
+    while (1) {
+        size_t size = strcspn(path, "./");
+        int res;
+
+        jsl_skip_space(lex, NULL);
+
+        if (lex->input >= lex->input_end || *lex->input != '{') {
+            return 0;
+        }
+
+        if ((res = jsl_find_attr(lex, path, size, s)) != 1) {
+            return res;
+        }
+
+        if (path[size] == '\0') {
+            return 1;
+        }
+
+        path += size + 1;
+    }
+}
+
 static int jsini_read_json_utf8(jsl_t *lex, int offset, jsb_t *s) {
     int32_t c;
     int32_t m = json_unescape_unicode(lex->input + offset, lex->input_end, &c);
@@ -321,7 +662,7 @@ int jsl_decode_json_string(jsl_t *lex, jsb_t *s) {
 
 jsini_string_t *jsl_read_json_string(jsl_t *lex) {
     jsini_string_t *s = jsini_alloc_string(NULL, 0);
-    s->lineno = lex->lineno;
+    jsini_set_lineno(s, lex->lineno);
     if (jsl_decode_json_string(lex, &s->data) != JSINI_OK) {
         jsini_free_string(s);
         return NULL;
@@ -330,15 +671,19 @@ jsini_string_t *jsl_read_json_string(jsl_t *lex) {
 }
 
 jsini_value_t *jsini_parse_string(const char *s, uint32_t len) {
+    return jsini_parse_string_ex(s, len, JSINI_COMMENT);
+}
+
+jsini_value_t *jsini_parse_string_ex(const char *s, uint32_t len, int options) {
     jsini_value_t *res;
     jsl_t lex;
-    jsl_init(&lex, s, len, JSINI_COMMENT);
+    jsl_init(&lex, s, len, options);
     res = jsini_read_json(&lex);
     if (!res) jsini_write_error(&lex, stderr);
     jsl_skip_space(&lex, NULL);
     if (lex.input < lex.input_end) {
         fprintf(stderr, "WARNING: Unexpected character '%c' at line %zu\n",
-                *lex.input, lex.lineno + 1);
+                *lex.input, jsl_lineno(&lex) + 1);
     }
     return res;
 }
@@ -364,10 +709,14 @@ jsini_value_t *jsini_parse_string_jsonl(const char *s, uint32_t len) {
 }
 
 jsini_value_t *jsini_parse_file(const char *file) {
+    return jsini_parse_file_ex(file, JSINI_COMMENT);
+}
+
+jsini_value_t *jsini_parse_file_ex(const char *file, int options) {
     jsini_value_t *result = NULL;
     jsb_t *sb = jsb_create();
     if (jsb_load(sb, file) == JSB_OK) {
-        result = jsini_parse_string(sb->data, sb->size);
+        result = jsini_parse_string_ex(sb->data, sb->size, options);
     }
     jsb_free(sb);
     return result;
@@ -390,42 +739,122 @@ jsini_value_t *jsini_parse_file_jsonl(const char *file) {
     return (jsini_value_t *)array;
 }
 
+static int jsonl_parse_line(const char *line, size_t size, jsini_jsonl_cb cb, void *user_data) {
+    jsl_t lex;
+    jsl_init(&lex, line, size, JSINI_COMMENT);
+
+    while (lex.input < lex.input_end) {
+        jsl_skip_space(&lex, NULL);
+        if (lex.input >= lex.input_end) break;
+
+        jsini_value_t *val = jsini_read_json(&lex);
+        if (!val) {
+            jsini_write_error(&lex, stderr);
+            return JSINI_ERROR;
+        }
+
+        int res = cb(val, user_data);
+        if (res != JSINI_OK) {
+            return res;
+        }
+    }
+    return JSINI_OK;
+}
+
 int jsini_parse_file_jsonl_ex(const char *file, jsini_jsonl_cb cb, void *user_data) {
-    FILE *fp = fopen(file, "r");
+    FILE *fp = fopen(file, "rb");
     if (!fp) return JSINI_ERROR;
 
-    jsb_t sb;
-    jsb_init(&sb);
+    jsb_reader_t reader;
+    jsb_reader_init(&reader, fp);
 
+    const char *line;
+    size_t size;
     int res = JSINI_OK;
 
-    while (jsb_getline(&sb, fp) == JSB_OK) {
-        jsl_t lex;
-        jsl_init(&lex, sb.data, sb.size, JSINI_COMMENT);
+    while (res == JSINI_OK && jsb_reader_getline(&reader, &line, &size) == JSB_OK) {
+        res = jsonl_parse_line(line, size, cb, user_data);
+    }
+
+    jsb_reader_clean(&reader);
+    fclose(fp);
+    return res;
+}
 
-        while (lex.input < lex.input_end) {
-            jsl_skip_space(&lex, NULL);
-            if (lex.input >= lex.input_end) break;
+int jsini_parse_string_jsonl_ex(const char *s, size_t len, jsini_jsonl_cb cb, void *user_data) {
+    const char *end = s + len;
+    int res = JSINI_OK;
 
-            jsini_value_t *val = jsini_read_json(&lex);
-            if (!val) {
-                jsini_write_error(&lex, stderr);
-                res = JSINI_ERROR;
-                goto done;
-            }
-            
-            if ((res = cb(val, user_data)) != JSINI_OK) {
-                goto done;
-            }
-        }
+    while (res == JSINI_OK && s < end) {
+        const char *nl = (const char *)memchr(s, '\n', end - s);
+        size_t size = nl ? (size_t)(nl - s) + 1 : (size_t)(end - s);
+        res = jsonl_parse_line(s, size, cb, user_data);
+        s += size;
     }
+    return res;
+}
 
-done:
-    jsb_clean(&sb);
+static int jsonl_select_line(const char *line, size_t size, const char *path, jsb_t *s,
+                             jsini_jsonl_cb cb, void *user_data) {
+    jsini_value_t *val = NULL;
+    int found;
+    jsl_t lex;
+    jsl_init(&lex, line, size, JSINI_COMMENT);
+
+    jsl_skip_space(&lex, NULL);
+    if (lex.input >= lex.input_end) return JSINI_OK;
+
+    if ((found = jsl_find_path(&lex, path, s)) < 0
+            || (found && (val = jsini_read_json(&lex)) == NULL)) {
+        jsini_write_error(&lex, stderr);
+        return JSINI_ERROR;
+    }
+
+    return cb(val, user_data);
+}
+
+int jsini_select_file_jsonl(const char *file, const char *path, jsini_jsonl_cb cb,
+        void *user_data) {
+    FILE *fp = fopen(file, "rb");
+    if (!fp) return JSINI_ERROR;
+
+    jsb_reader_t reader;
+    jsb_reader_init(&reader, fp);
+
+    const char *line;
+    size_t size;
+    int res = JSINI_OK;
+    jsb_t s;
+    jsb_init(&s);
+
+    while (res == JSINI_OK && jsb_reader_getline(&reader, &line, &size) == JSB_OK) {
+        res = jsonl_select_line(line, size, path, &s, cb, user_data);
+    }
+
+    jsb_clean(&s);
+    jsb_reader_clean(&reader);
     fclose(fp);
     return res;
 }
 
+int jsini_select_string_jsonl(const char *s, size_t len, const char *path, jsini_jsonl_cb cb,
+        void *user_data) {
+    const char *end = s + len;
+    int res = JSINI_OK;
+    jsb_t scratch;
+    jsb_init(&scratch);
+
+    while (res == JSINI_OK && s < end) {
+        const char *nl = (const char *)memchr(s, '\n', end - s);
+        size_t size = nl ? (size_t)(nl - s) + 1 : (size_t)(end - s);
+        res = jsonl_select_line(s, size, path, &scratch, cb, user_data);
+        s += size;
+    }
+
+    jsb_clean(&scratch);
+    return res;
+}
+
 void jsini_write_string(jsb_t *sb, jsb_t *s, int options) {
     const char *p = s->data;
     const char *q = s->data + s->size;
@@ -467,7 +896,7 @@ void jsini_write_string(jsb_t *sb, jsb_t *s, int options) {
             } else if ((c & 0x80) && (options & JSINI_ESCAPE_UNICODE)) {
                 int32_t ch, n;
                 if ((n = decode_utf8(p, &ch)) > 0) {
-                    char buf[12];
+                    char buf[13];
                     p += n - 1;
                     n = json_escape_unicode(ch, buf);
                     jsb_append(sb, buf, n);
@@ -483,8 +912,6 @@ void jsini_write_string(jsb_t *sb, jsb_t *s, int options) {
     jsb_append_char(sb, '"');
 }
 
-void jsini_stringify_real(const jsini_value_t *, jsb_t *, int, int, int);
-
 #define SHIFT(b,n,t) do{int i;for(i=0;i<(n)*(t);i++)jsb_append_char(b,' ');}while(0)
 
 static void strattr(jsb_t *sb, const jsini_attr_t *attr, int options,
@@ -496,6 +923,41 @@ static void strattr(jsb_t *sb, const jsini_attr_t *attr, int options,
     jsini_stringify_real(attr->value, sb, options, level, indent);
 }
 
+static void strpacked(jsb_t *sb, const jsini_array_t *array, int options,
+        int level, int indent) {
+    uint32_t i;
+    for (i = 0; i < array->data.size; i++) {
+        JSA_TYPE item = array->data.item[i];
+        if (i > 0) {
+            jsb_append_char(sb, ',');
+            if ((options & JSINI_PRETTY_PRINT)!= 0) jsb_append_char(sb, '\n');
+        }
+        else if ((options & JSINI_PRETTY_PRINT) != 0) {
+            jsb_append_char(sb, '\n');
+        }
+        if ((options & JSINI_PRETTY_PRINT) != 0) SHIFT(sb, level + 1, indent);
+        if (array->packed == JSINI_TSTRING) {
+            jsb_t s;
+            s.data = (char *) jsini_array_get_string(array, i, &s.size);
+            s.alloc_size = s.size;
+            jsini_write_string(sb, &s, options);
+        } else if (array->packed == JSINI_TBOOL) {
+            jsb_printf(sb, "%s", item ? "true" : "false");
+        } else if (array->packed == JSINI_TINTEGER) {
+            jsb_printf(sb, "%ld", (int64_t) item);
+        } else {
+            uint64_t bits = (uint64_t) item;
+            double d;
+            memcpy(&d, &bits, sizeof(d));
+            jsb_printf(sb, "%g", d);
+        }
+    }
+    if (i > 0 && (options & JSINI_PRETTY_PRINT) != 0) {
+        jsb_append_char(sb, '\n');
+        SHIFT(sb, level, indent);
+    }
+}
+
 static int attrcmp(const void *a, const void *b) {
     jsini_attr_t *a1 = *((jsini_attr_t **) a);
     jsini_attr_t *a2 = *((jsini_attr_t **) b);
@@ -598,7 +1060,10 @@ void jsini_stringify_real(const jsini_value_t *value, jsb_t *sb, int options,
         break;
     case JSINI_TARRAY:
         jsb_append_char(sb, '[');
-        {
+        if (((jsini_array_t *) value)->packed) {
+            strpacked(sb, (jsini_array_t *) value, options, level, indent);
+        }
+        else {
             jsini_array_t *array = (jsini_array_t *) value;
             uint32_t i, n = 0;
             for (i = 0; i < array->data.size; i++) {
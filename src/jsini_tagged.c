@@ -0,0 +1,623 @@
+/*
+ * Copyright (c) Weidong Fang
+ */
+
+#include "jsini.h"
+
+#ifdef JSINI_TAGGED_VALUES
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef JSINI_COUNT_ALLOCS
+#define xmalloc jsini_counted_malloc
+#else
+#define xmalloc malloc
+#endif
+#define xfree free
+
+#define TAG_WIDE        0   // heap jsini_integer_t for integers beyond 48 bits
+#define TAG_NULL        1
+#define TAG_BOOL        2
+#define TAG_INTEGER     3
+#define TAG_STRING      4
+#define TAG_ARRAY       5
+#define TAG_OBJECT      6
+#define TAG_UNDEFINED   7
+
+#define PAYLOAD_MASK    0x0000ffffffffffffULL
+#define CANONICAL_NAN   0x7ff8000000000000ULL
+
+#define tag_of(v)       ((int) (((v) >> 48) & 7))
+#define payload_of(v)   ((v) & PAYLOAD_MASK)
+#define pointer_of(v)   ((void *) (uintptr_t) payload_of(v))
+
+typedef struct {
+    jsa_t  items;       // jsini_tval_t
+} tarray_t;
+
+typedef struct {
+    jsa_t  keys;        // jsini_tattr_t* in insertion order
+    jsh_t *map;
+} tobject_t;
+
+static jsini_tval_t box_pointer(int tag, const void *p) {
+    uint64_t bits = (uint64_t) (uintptr_t) p;
+    assert((bits & ~PAYLOAD_MASK) == 0);
+    return JSINI_TVAL_MAKE(tag, bits);
+}
+
+static tarray_t *as_array(jsini_tval_t v) {
+    return !jsini_tval_is_double(v) && tag_of(v) == TAG_ARRAY ?
+            (tarray_t *) pointer_of(v) : NULL;
+}
+
+static tobject_t *as_object(jsini_tval_t v) {
+    return !jsini_tval_is_double(v) && tag_of(v) == TAG_OBJECT ?
+            (tobject_t *) pointer_of(v) : NULL;
+}
+
+jsini_tval_t jsini_tval_bool(int value) {
+    return value ? JSINI_TVAL_TRUE : JSINI_TVAL_FALSE;
+}
+
+jsini_tval_t jsini_tval_integer(int64_t value) {
+    if (value >= -((int64_t) 1 << 47) && value < ((int64_t) 1 << 47)) {
+        return JSINI_TVAL_MAKE(TAG_INTEGER, (uint64_t) value & PAYLOAD_MASK);
+    }
+    return box_pointer(TAG_WIDE, jsini_alloc_integer(value));
+}
+
+jsini_tval_t jsini_tval_number(double value) {
+    uint64_t bits;
+    if (value != value) {
+        return CANONICAL_NAN;
+    }
+    memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+jsini_tval_t jsini_tval_string(const char *data, size_t length) {
+    return box_pointer(TAG_STRING, jsini_alloc_string(data, length));
+}
+
+jsini_tval_t jsini_tval_array() {
+    tarray_t *array = (tarray_t *) xmalloc(sizeof(tarray_t));
+    jsa_init(&array->items);
+    return box_pointer(TAG_ARRAY, array);
+}
+
+jsini_tval_t jsini_tval_object() {
+    tobject_t *object = (tobject_t *) xmalloc(sizeof(tobject_t));
+    jsa_init(&object->keys);
+    object->map = jsh_create_simple(0, 0);
+    return box_pointer(TAG_OBJECT, object);
+}
+
+void jsini_tval_free(jsini_tval_t v) {
+    uint32_t i;
+
+    if (jsini_tval_is_double(v)) {
+        return;
+    }
+
+    switch (tag_of(v)) {
+    case TAG_WIDE:
+        xfree(pointer_of(v));
+        break;
+    case TAG_STRING:
+        jsini_free_string((jsini_string_t *) pointer_of(v));
+        break;
+    case TAG_ARRAY: {
+            tarray_t *array = (tarray_t *) pointer_of(v);
+            for (i = 0; i < array->items.size; i++) {
+                jsini_tval_free(array->items.item[i]);
+            }
+            jsa_clean(&array->items);
+            xfree(array);
+        }
+        break;
+    case TAG_OBJECT: {
+            tobject_t *object = (tobject_t *) pointer_of(v);
+            for (i = 0; i < object->keys.size; i++) {
+                jsini_tattr_t *attr = (jsini_tattr_t *) object->keys.item[i];
+                jsini_free_string(attr->name);
+                jsini_tval_free(attr->value);
+                xfree(attr);
+            }
+            jsh_destroy(object->map);
+            jsa_clean(&object->keys);
+            xfree(object);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+uint8_t jsini_tval_type(jsini_tval_t v) {
+    if (jsini_tval_is_double(v)) {
+        return JSINI_TNUMBER;
+    }
+
+    switch (tag_of(v)) {
+    case TAG_WIDE:
+    case TAG_INTEGER:
+        return JSINI_TINTEGER;
+    case TAG_NULL:
+        return JSINI_TNULL;
+    case TAG_BOOL:
+        return JSINI_TBOOL;
+    case TAG_STRING:
+        return JSINI_TSTRING;
+    case TAG_ARRAY:
+        return JSINI_TARRAY;
+    case TAG_OBJECT:
+        return JSINI_TOBJECT;
+    default:
+        return JSINI_UNDEFINED;
+    }
+}
+
+int jsini_tval_get_bool(jsini_tval_t v) {
+    return v == JSINI_TVAL_TRUE;
+}
+
+int64_t jsini_tval_get_integer(jsini_tval_t v) {
+    if (jsini_tval_is_double(v)) {
+        return (int64_t) jsini_tval_get_number(v);
+    }
+
+    switch (tag_of(v)) {
+    case TAG_INTEGER:
+        return ((int64_t) (v << 16)) >> 16;
+    case TAG_WIDE:
+        return ((jsini_integer_t *) pointer_of(v))->data;
+    default:
+        return 0;
+    }
+}
+
+double jsini_tval_get_number(jsini_tval_t v) {
+    if (jsini_tval_is_double(v)) {
+        double d;
+        memcpy(&d, &v, sizeof(d));
+        return d;
+    }
+    return (double) jsini_tval_get_integer(v);
+}
+
+const jsb_t *jsini_tval_get_string(jsini_tval_t v) {
+    if (!jsini_tval_is_double(v) && tag_of(v) == TAG_STRING) {
+        return &((jsini_string_t *) pointer_of(v))->data;
+    }
+    return NULL;
+}
+
+uint32_t jsini_tval_size(jsini_tval_t v) {
+    tarray_t *array;
+    tobject_t *object;
+
+    if ((array = as_array(v)) != NULL) {
+        return array->items.size;
+    }
+    if ((object = as_object(v)) != NULL) {
+        return object->keys.size;
+    }
+    return 0;
+}
+
+jsini_tval_t jsini_tval_aget(jsini_tval_t v, uint32_t i) {
+    tarray_t *array = as_array(v);
+    if (array == NULL || i >= array->items.size) {
+        return JSINI_TVAL_UNDEFINED;
+    }
+    return array->items.item[i];
+}
+
+int jsini_tval_push(jsini_tval_t v, jsini_tval_t value) {
+    tarray_t *array = as_array(v);
+    if (array == NULL) {
+        return JSINI_ERROR;
+    }
+    jsa_push(&array->items, value);
+    return JSINI_OK;
+}
+
+static void tobject_put(tobject_t *object, jsini_string_t *name,
+        jsini_tval_t value) {
+    jsini_tattr_t *attr = (jsini_tattr_t *) jsh_get(object->map, name->data.data);
+
+    if (attr != NULL) {
+        jsini_free_string(name);
+        jsini_tval_free(attr->value);
+        attr->value = value;
+        return;
+    }
+
+    attr = (jsini_tattr_t *) xmalloc(sizeof(jsini_tattr_t));
+    attr->name = name;
+    attr->value = value;
+    jsa_push(&object->keys, attr);
+    jsh_put(object->map, name->data.data, attr);
+}
+
+jsini_tval_t jsini_tval_get(jsini_tval_t v, const char *key) {
+    tobject_t *object = as_object(v);
+    jsini_tattr_t *attr;
+
+    if (object == NULL
+            || (attr = (jsini_tattr_t *) jsh_get(object->map, key)) == NULL) {
+        return JSINI_TVAL_UNDEFINED;
+    }
+    return attr->value;
+}
+
+int jsini_tval_set(jsini_tval_t v, const char *key, jsini_tval_t value) {
+    tobject_t *object = as_object(v);
+    if (object == NULL) {
+        return JSINI_ERROR;
+    }
+    tobject_put(object, jsini_alloc_string(key, strlen(key)), value);
+    return JSINI_OK;
+}
+
+const jsini_tattr_t *jsini_tval_attr(jsini_tval_t v, uint32_t i) {
+    tobject_t *object = as_object(v);
+    if (object == NULL || i >= object->keys.size) {
+        return NULL;
+    }
+    return (const jsini_tattr_t *) object->keys.item[i];
+}
+
+static jsini_tval_t read_tval(jsl_t *lex);
+
+static jsini_tval_t read_array(jsl_t *lex) {
+    jsini_tval_t array = jsini_tval_array();
+    char array_end = *lex->input == '(' ? ')' : ']';
+
+    lex->error_char = *lex->input++;
+
+    while (lex->input < lex->input_end) {
+        jsini_tval_t value;
+
+        jsl_skip_space(lex, ",");
+
+        if (lex->input == lex->input_end) {
+            break;
+        }
+
+        if (*lex->input == array_end) {
+            lex->input++;
+            return array;
+        }
+
+        if ((value = read_tval(lex)) == JSINI_TVAL_UNDEFINED) {
+            goto fail;
+        }
+
+        jsa_push(&as_array(array)->items, value);
+    }
+
+    lex->error = JSINI_ERROR_NOT_CLOSED;
+
+fail:
+    jsini_tval_free(array);
+    return JSINI_TVAL_UNDEFINED;
+}
+
+static jsini_tval_t read_object(jsl_t *lex) {
+    jsini_tval_t object = jsini_tval_object();
+
+    lex->error_char = *lex->input++;
+
+    while (lex->input < lex->input_end) {
+        jsini_string_t *name;
+        jsini_tval_t value;
+
+        jsl_skip_space(lex, ",");
+
+        if (lex->input == lex->input_end) {
+            break;
+        }
+
+        if (*lex->input == '}') {
+            lex->input++;
+            return object;
+        }
+
+        if ((name = jsl_read_attr_name(lex)) == NULL) {
+            lex->error = JSINI_ERROR_NAME;
+            goto fail;
+        }
+
+        jsl_skip_space(lex, NULL);
+
+        if (*lex->input != ':' && *lex->input != '=') {
+            jsini_free_string(name);
+            lex->error_char = ':';
+            lex->error = JSINI_ERROR_SEPARATOR;
+            goto fail;
+        }
+
+        lex->input++;
+
+        /* Perl style hash */
+        jsl_skip_space(lex, ">");
+
+        if ((value = read_tval(lex)) == JSINI_TVAL_UNDEFINED) {
+            jsini_free_string(name);
+            goto fail;
+        }
+
+        tobject_put(as_object(object), name, value);
+    }
+
+    lex->error = JSINI_ERROR_NOT_CLOSED;
+
+fail:
+    jsini_tval_free(object);
+    return JSINI_TVAL_UNDEFINED;
+}
+
+static jsini_tval_t read_tval(jsl_t *lex) {
+    jsini_string_t *s;
+    jsl_scalar_t scalar;
+
+    jsl_skip_space(lex, NULL);
+
+    if (lex->input >= lex->input_end) {
+        if (lex->error == JSINI_OK) {
+            lex->error = JSINI_ERROR_EOF;
+        }
+        return JSINI_TVAL_UNDEFINED;
+    }
+
+    switch (*lex->input) {
+    case '{':
+        return read_object(lex);
+    case '[':
+    case '(':
+        return read_array(lex);
+    case '"':
+    case '\'':
+    case '`':
+        s = jsl_read_json_string(lex);
+        return s ? box_pointer(TAG_STRING, s) : JSINI_TVAL_UNDEFINED;
+    default:
+        break;
+    }
+
+    if (jsl_scan_primitive(lex, &scalar)) {
+        switch (scalar.type) {
+        case JSINI_TBOOL:
+            return jsini_tval_bool((int) scalar.data.integer);
+        case JSINI_TINTEGER:
+            return jsini_tval_integer(scalar.data.integer);
+        case JSINI_TNUMBER:
+            return jsini_tval_number(scalar.data.number);
+        default:
+            return JSINI_TVAL_NULL;
+        }
+    }
+
+    return box_pointer(TAG_STRING, jsl_read_bare_string(lex));
+}
+
+jsini_tval_t jsini_tval_parse_string(const char *s, uint32_t len, int options) {
+    jsini_tval_t res;
+    jsl_t lex;
+    jsl_init(&lex, s, len, options);
+    res = read_tval(&lex);
+    if (res == JSINI_TVAL_UNDEFINED) jsini_write_error(&lex, stderr);
+    jsl_skip_space(&lex, NULL);
+    if (lex.input < lex.input_end) {
+        fprintf(stderr, "WARNING: Unexpected character '%c' at line %zu\n",
+                *lex.input, jsl_lineno(&lex) + 1);
+    }
+    return res;
+}
+
+#define SHIFT(b,n,t) do{int i;for(i=0;i<(n)*(t);i++)jsb_append_char(b,' ');}while(0)
+
+static int tattrcmp(const void *a, const void *b) {
+    jsini_tattr_t *a1 = *((jsini_tattr_t **) a);
+    jsini_tattr_t *a2 = *((jsini_tattr_t **) b);
+    return strcmp(a1->name->data.data, a2->name->data.data);
+}
+
+static void stringify(jsini_tval_t v, jsb_t *sb, int options, int level,
+        int indent) {
+    int pretty = (options & JSINI_PRETTY_PRINT) != 0;
+    uint32_t i, n = 0;
+
+    switch (jsini_tval_type(v)) {
+    case JSINI_TNULL:
+        jsb_append(sb, "null", 4);
+        break;
+    case JSINI_TBOOL:
+        jsb_printf(sb, "%s", jsini_tval_get_bool(v) ? "true" : "false");
+        break;
+    case JSINI_TINTEGER:
+        jsb_printf(sb, "%ld", jsini_tval_get_integer(v));
+        break;
+    case JSINI_TNUMBER:
+        jsb_printf(sb, "%g", jsini_tval_get_number(v));
+        break;
+    case JSINI_TSTRING:
+        jsini_write_string(sb, &((jsini_string_t *) pointer_of(v))->data, options);
+        break;
+    case JSINI_TARRAY: {
+            tarray_t *array = as_array(v);
+            jsb_append_char(sb, '[');
+            for (i = 0; i < array->items.size; i++) {
+                jsini_tval_t item = array->items.item[i];
+                if (item == JSINI_TVAL_UNDEFINED) {
+                    continue;
+                }
+                if (n++ > 0) {
+                    jsb_append_char(sb, ',');
+                }
+                if (pretty) {
+                    jsb_append_char(sb, '\n');
+                    SHIFT(sb, level + 1, indent);
+                }
+                stringify(item, sb, options, level + 1, indent);
+            }
+            if (n > 0 && pretty) {
+                jsb_append_char(sb, '\n');
+                SHIFT(sb, level, indent);
+            }
+            jsb_append_char(sb, ']');
+        }
+        break;
+    case JSINI_TOBJECT: {
+            tobject_t *object = as_object(v);
+            jsa_t keys;
+            jsa_init(&keys);
+            for (i = 0; i < object->keys.size; i++) {
+                jsini_tattr_t *attr = (jsini_tattr_t *) object->keys.item[i];
+                if (attr->value != JSINI_TVAL_UNDEFINED) {
+                    jsa_push(&keys, attr);
+                }
+            }
+            if (options & JSINI_SORT_KEYS) {
+                qsort(keys.item, keys.size, sizeof(keys.item[0]), tattrcmp);
+            }
+            jsb_append_char(sb, '{');
+            for (i = 0; i < keys.size; i++) {
+                jsini_tattr_t *attr = (jsini_tattr_t *) keys.item[i];
+                if (i > 0) {
+                    jsb_append_char(sb, ',');
+                }
+                if (pretty) {
+                    jsb_append_char(sb, '\n');
+                    SHIFT(sb, level + 1, indent);
+                }
+                jsini_write_string(sb, &attr->name->data, options);
+                jsb_append_char(sb, ':');
+                if (pretty) jsb_append_char(sb, ' ');
+                stringify(attr->value, sb, options, level + 1, indent);
+            }
+            if (keys.size > 0 && pretty) {
+                jsb_append_char(sb, '\n');
+                SHIFT(sb, level, indent);
+            }
+            jsb_append_char(sb, '}');
+            jsa_clean(&keys);
+        }
+        break;
+    default:
+        jsb_append(sb, "undefined", sizeof("undefined") - 1);
+        break;
+    }
+}
+
+void jsini_tval_stringify(jsini_tval_t v, jsb_t *sb, int options, int indent) {
+    stringify(v, sb, options, 0, indent);
+}
+
+jsini_tval_t jsini_tval_from_value(const jsini_value_t *value) {
+    uint32_t i;
+
+    switch (value->type) {
+    case JSINI_TNULL:
+        return JSINI_TVAL_NULL;
+    case JSINI_TBOOL:
+        return jsini_tval_bool(((const jsini_bool_t *) value)->data);
+    case JSINI_TINTEGER:
+        return jsini_tval_integer(((const jsini_integer_t *) value)->data);
+    case JSINI_TNUMBER:
+        return jsini_tval_number(((const jsini_number_t *) value)->data);
+    case JSINI_TSTRING: {
+            const jsb_t *sb = &((const jsini_string_t *) value)->data;
+            return jsini_tval_string(sb->data, sb->size);
+        }
+    case JSINI_TARRAY: {
+            const jsini_array_t *array = (const jsini_array_t *) value;
+            jsini_tval_t result = jsini_tval_array();
+            jsa_t *items = &as_array(result)->items;
+            for (i = 0; i < array->data.size; i++) {
+                switch (array->packed) {
+                case JSINI_TBOOL:
+                    jsa_push(items, jsini_tval_bool(jsini_array_get_bool(array, i)));
+                    break;
+                case JSINI_TINTEGER:
+                    jsa_push(items, jsini_tval_integer(jsini_array_get_integer(array, i)));
+                    break;
+                case JSINI_TNUMBER:
+                    jsa_push(items, jsini_tval_number(jsini_array_get_number(array, i)));
+                    break;
+                case JSINI_TSTRING: {
+                        size_t size;
+                        const char *s = jsini_array_get_string(array, i, &size);
+                        jsa_push(items, jsini_tval_string(s, size));
+                    }
+                    break;
+                default:
+                    jsa_push(items, jsini_tval_from_value(
+                            (const jsini_value_t *) array->data.item[i]));
+                    break;
+                }
+            }
+            return result;
+        }
+    case JSINI_TOBJECT: {
+            const jsini_object_t *object = (const jsini_object_t *) value;
+            jsini_tval_t result = jsini_tval_object();
+            for (i = 0; i < object->keys.size; i++) {
+                const jsini_attr_t *attr = (const jsini_attr_t *) object->keys.item[i];
+                const jsb_t *name = &attr->name->data;
+                tobject_put(as_object(result),
+                        jsini_alloc_string(name->data, name->size),
+                        jsini_tval_from_value(attr->value));
+            }
+            return result;
+        }
+    default:
+        return JSINI_TVAL_UNDEFINED;
+    }
+}
+
+jsini_value_t *jsini_tval_to_value(jsini_tval_t v) {
+    uint32_t i;
+
+    switch (jsini_tval_type(v)) {
+    case JSINI_TNULL:
+        return jsini_alloc_null();
+    case JSINI_TBOOL:
+        return (jsini_value_t *) jsini_alloc_bool(jsini_tval_get_bool(v));
+    case JSINI_TINTEGER:
+        return (jsini_value_t *) jsini_alloc_integer(jsini_tval_get_integer(v));
+    case JSINI_TNUMBER:
+        return (jsini_value_t *) jsini_alloc_number(jsini_tval_get_number(v));
+    case JSINI_TSTRING: {
+            const jsb_t *sb = jsini_tval_get_string(v);
+            return (jsini_value_t *) jsini_alloc_string(sb->data, sb->size);
+        }
+    case JSINI_TARRAY: {
+            tarray_t *array = as_array(v);
+            jsini_array_t *result = jsini_alloc_array();
+            for (i = 0; i < array->items.size; i++) {
+                jsini_push_value(result, jsini_tval_to_value(array->items.item[i]));
+            }
+            return (jsini_value_t *) result;
+        }
+    case JSINI_TOBJECT: {
+            tobject_t *object = as_object(v);
+            jsini_object_t *result = jsini_alloc_object();
+            for (i = 0; i < object->keys.size; i++) {
+                jsini_tattr_t *attr = (jsini_tattr_t *) object->keys.item[i];
+                const jsb_t *name = &attr->name->data;
+                jsini_alloc_attr(result, jsini_alloc_string(name->data, name->size))
+                        ->value = jsini_tval_to_value(attr->value);
+            }
+            return (jsini_value_t *) result;
+        }
+    default:
+        return jsini_alloc_undefined();
+    }
+}
+
+#endif
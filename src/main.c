@@ -9,25 +9,1192 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <string.h>
+#include <time.h>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_PARALLEL_STATS
+#define HAVE_PIPELINE
+#define HAVE_ATOMIC_REPLACE
+#define HAVE_GETRUSAGE
+#endif
 
 typedef struct {
-    jsini_key_stats_map_t *stats;
+    jsini_key_stats_collector_t *collector;
     size_t line_count;
+    int quiet;              // no progress lines, for worker threads
 } stats_context_t;
 
+static void stats_progress(stats_context_t *ctx) {
+    ctx->line_count++;
+    if (!ctx->quiet && ctx->line_count % 1000 == 0) {
+        fprintf(stderr, "Processed %zu lines\n", ctx->line_count);
+    }
+}
+
 static int stats_callback(jsini_value_t *value, void *user_data) {
     stats_context_t *ctx = (stats_context_t *)user_data;
-    jsini_collect_key_stats(value, ctx->stats);
+    jsini_key_stats_collector_add(ctx->collector, value);
     jsini_free(value);
+    stats_progress(ctx);
+    return JSINI_OK;
+}
 
-    ctx->line_count++;
-    if (ctx->line_count % 1000 == 0) {
-        fprintf(stderr, "Processed %zu lines\n", ctx->line_count);
+/*
+ * Counts JSONL lines straight from the lexer, without building values.
+ */
+static int stats_add_lines(stats_context_t *ctx, const char *s, size_t len) {
+    const char *end = s + len;
+
+    while (s < end) {
+        const char *nl = (const char *)memchr(s, '\n', end - s);
+        size_t size = nl ? (size_t)(nl - s) + 1 : (size_t)(end - s);
+        int n = jsini_key_stats_collector_add_json(ctx->collector, s, size);
+        if (n < 0) {
+            return JSINI_ERROR;
+        }
+        while (n-- > 0) {
+            stats_progress(ctx);
+        }
+        s += size;
+    }
+    return JSINI_OK;
+}
+
+#ifdef HAVE_PARALLEL_STATS
+
+// Maps a file read-only; an empty file gives NULL data and JSINI_OK
+static int stats_map_file(const char *file, const char **data, size_t *size) {
+    struct stat st;
+    int fd;
+
+    *data = NULL;
+    *size = 0;
+    if ((fd = open(file, O_RDONLY)) < 0) return JSINI_ERROR;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return JSINI_ERROR;
+    }
+    if (st.st_size == 0) {
+        close(fd);
+        return JSINI_OK;
+    }
+    *data = (const char *)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (*data == (const char *)MAP_FAILED) {
+        *data = NULL;
+        return JSINI_ERROR;
+    }
+    *size = st.st_size;
+    return JSINI_OK;
+}
+
+static void stats_unmap_file(const char *data, size_t size) {
+    if (data) munmap((void *)data, size);
+}
+
+#define STATS_MIN_SLICE (1 << 20)
+
+typedef struct {
+    const char *start;
+    const char *end;
+    stats_context_t ctx;
+    int threaded;           // runs on its own thread, to be joined
+    int res;
+} stats_slice_t;
+
+static void *stats_slice_run(void *arg) {
+    stats_slice_t *slice = (stats_slice_t *)arg;
+    slice->res = stats_add_lines(&slice->ctx, slice->start, slice->end - slice->start);
+    return NULL;
+}
+
+/*
+ * Collects key statistics of a JSONL file on one thread per CPU. The file
+ * is mapped and cut into slices at line ends; each thread has its own
+ * collector, and they are flushed into `stats` at the end. A slice whose
+ * thread cannot be started runs on the calling thread. After a parse error
+ * the other slices still count, so the caller must not report the stats.
+ */
+static int collect_jsonl_stats_parallel(const char *file, uint32_t flags,
+                                        stats_context_t *total,
+                                        jsini_key_stats_map_t *stats) {
+    const char *data, *end;
+    size_t size;
+    stats_slice_t *slices;
+    pthread_t *threads;
+    long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, n, res = JSINI_OK;
+
+    if (stats_map_file(file, &data, &size) != JSINI_OK) return JSINI_ERROR;
+    if (size == 0) return JSINI_OK;
+    madvise((void *)data, size, MADV_SEQUENTIAL);
+
+    end = data + size;
+
+    n = (int)(size / STATS_MIN_SLICE);
+    if (n > nproc) n = (int)nproc;
+    if (n < 1) n = 1;
+
+    slices = (stats_slice_t *)calloc(n, sizeof(stats_slice_t));
+    threads = (pthread_t *)malloc(n * sizeof(pthread_t));
+    for (i = 0; i < n; i++) {
+        const char *p = data + size / n * i;
+        if (i > 0) {
+            const char *nl = (const char *)memchr(p, '\n', end - p);
+            p = nl ? nl + 1 : end;
+            if (p < slices[i - 1].start) p = slices[i - 1].start;
+            slices[i - 1].end = p;
+        }
+        slices[i].start = p;
+        slices[i].end = end;
+        slices[i].ctx.collector = jsini_key_stats_collector_create_ex(flags);
+        slices[i].ctx.quiet = 1;
+    }
+    for (i = 0; i < n; i++) {
+        slices[i].threaded = pthread_create(&threads[i], NULL, stats_slice_run,
+                                            &slices[i]) == 0;
+        if (!slices[i].threaded) stats_slice_run(&slices[i]);
+    }
+
+    for (i = 0; i < n; i++) {
+        if (slices[i].threaded) pthread_join(threads[i], NULL);
+        if (slices[i].res != JSINI_OK) res = slices[i].res;
+        jsini_key_stats_collector_flush(slices[i].ctx.collector, stats);
+        jsini_key_stats_collector_free(slices[i].ctx.collector);
+        total->line_count += slices[i].ctx.line_count;
+    }
+
+    free(slices);
+    free(threads);
+    stats_unmap_file(data, size);
+    return res;
+}
+
+#else
+
+static int stats_map_file(const char *file, const char **data, size_t *size) {
+    jsb_t sb;
+
+    jsb_init(&sb);
+    if (jsb_load(&sb, file) != JSB_OK) {
+        jsb_clean(&sb);
+        return JSINI_ERROR;
+    }
+    *data = sb.data;
+    *size = sb.size;
+    return JSINI_OK;
+}
+
+static void stats_unmap_file(const char *data, size_t size) {
+    free((void *)data);
+}
+
+static int collect_jsonl_stats(const char *file, stats_context_t *ctx) {
+    FILE *fp = fopen(file, "rb");
+    jsb_reader_t reader;
+    const char *line;
+    size_t size;
+    int res = JSINI_OK;
+
+    if (!fp) return JSINI_ERROR;
+    jsb_reader_init(&reader, fp);
+    while (res == JSINI_OK && jsb_reader_getline(&reader, &line, &size) == JSB_OK) {
+        res = stats_add_lines(ctx, line, size);
+    }
+    jsb_reader_clean(&reader);
+    fclose(fp);
+    return res;
+}
+
+#endif
+
+/*
+ * Sampling for --stats on large JSONL files: a reservoir of N random
+ * lines, every Nth line, or the lines after N random byte offsets. The
+ * first two find every line end but only parse the sample; seeking only
+ * reads the sampled lines. The line after a random offset is picked with
+ * a chance proportional to the length of the line before it, which does
+ * not bias the sample unless line lengths depend on their neighbours.
+ */
+#define STATS_SAMPLE_RESERVOIR  1
+#define STATS_SAMPLE_EVERY      2
+#define STATS_SAMPLE_SEEK       3
+
+typedef struct {
+    int mode;
+    size_t count;
+    uint64_t random;        // xorshift64* state
+} stats_sample_t;
+
+typedef struct {
+    size_t offset;
+    size_t size;
+} stats_line_t;
+
+// "N" keeps a reservoir of N lines, "every:N" and "seek:N" the other modes
+static int stats_parse_sample(const char *spec, stats_sample_t *sample) {
+    char *end;
+
+    sample->mode = STATS_SAMPLE_RESERVOIR;
+    if (strncmp(spec, "every:", 6) == 0) {
+        sample->mode = STATS_SAMPLE_EVERY;
+        spec += 6;
+    } else if (strncmp(spec, "seek:", 5) == 0) {
+        sample->mode = STATS_SAMPLE_SEEK;
+        spec += 5;
+    }
+    sample->count = strtoul(spec, &end, 10);
+    sample->random = 0x9e3779b97f4a7c15ULL;
+    return *spec && !*end && sample->count > 0 ? JSINI_OK : JSINI_ERROR;
+}
+
+static uint64_t stats_random(stats_sample_t *sample) {
+    uint64_t x = sample->random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    sample->random = x;
+    return x * 0x2545f4914f6cdd1dULL;
+}
+
+static int compare_sampled_lines(const void *a, const void *b) {
+    size_t o1 = ((const stats_line_t *)a)->offset;
+    size_t o2 = ((const stats_line_t *)b)->offset;
+    return o1 < o2 ? -1 : o1 > o2;
+}
+
+// Resizes `lines` to `n` entries; on failure reports it and leaves `lines` alone
+static stats_line_t *stats_resize_lines(stats_line_t *lines, size_t n) {
+    stats_line_t *resized = NULL;
+
+    if (n <= SIZE_MAX / sizeof(stats_line_t)) {
+        resized = (stats_line_t *)realloc(lines, n * sizeof(stats_line_t));
+    }
+    if (!resized) {
+        fprintf(stderr, "Out of memory for a sample of %zu lines\n", n);
+    }
+    return resized;
+}
+
+/*
+ * The reservoir grows with the lines seen, so it never holds more than
+ * min(N, lines) entries, and seeking draws at most one offset per byte.
+ */
+static int collect_jsonl_stats_sampled(const char *file, stats_sample_t *sample,
+                                       stats_context_t *ctx) {
+    const char *data, *end, *p;
+    stats_line_t *lines = NULL, *grown;
+    size_t size, count = 0, total = 0, alloc = 0, i;
+    int res = JSINI_OK;
+
+    if (stats_map_file(file, &data, &size) != JSINI_OK) return JSINI_ERROR;
+    end = data + size;
+
+    if (sample->mode == STATS_SAMPLE_SEEK) {
+        size_t bytes = 0, n = sample->count < size ? sample->count : size;
+#ifdef HAVE_PARALLEL_STATS
+        if (data) madvise((void *)data, size, MADV_RANDOM);
+#endif
+        if (n > 0 && (lines = stats_resize_lines(NULL, n)) == NULL) {
+            stats_unmap_file(data, size);
+            return JSINI_ERROR;
+        }
+        for (i = 0; i < n; i++) {
+            lines[i].offset = stats_random(sample) % size;
+        }
+        if (n > 0) {
+            qsort(lines, n, sizeof(stats_line_t), compare_sampled_lines);
+        }
+        for (i = 0; i < n && res == JSINI_OK; i++) {
+            // The line starting after the first newline at or after the byte
+            // before the offset; offset 0 is the first line
+            const char *nl;
+            size_t len;
+
+            p = data;
+            if (lines[i].offset > 0) {
+                nl = (const char *)memchr(data + lines[i].offset - 1, '\n',
+                                          size - lines[i].offset + 1);
+                if (!nl || nl + 1 == end) continue;
+                p = nl + 1;
+            }
+            nl = (const char *)memchr(p, '\n', end - p);
+            len = nl ? (size_t)(nl - p) + 1 : (size_t)(end - p);
+            bytes += len;
+            res = stats_add_lines(ctx, p, len);
+            count++;
+        }
+        if (count > 0) {
+            fprintf(stderr, "Sampled %zu lines at random offsets, about %.0f in the file\n",
+                    count, (double)size * count / bytes);
+        }
+    } else {
+        for (p = data; p < end && res == JSINI_OK; total++) {
+            const char *nl = (const char *)memchr(p, '\n', end - p);
+            size_t len = nl ? (size_t)(nl - p) + 1 : (size_t)(end - p);
+
+            if (sample->mode == STATS_SAMPLE_EVERY) {
+                if (total % sample->count == 0) {
+                    res = stats_add_lines(ctx, p, len);
+                    count++;
+                }
+            } else {
+                // Algorithm R: line `total` replaces a random slot with
+                // probability count / (total + 1)
+                size_t slot = total;
+                if (total >= sample->count) {
+                    slot = (size_t)(stats_random(sample) % (total + 1));
+                } else if (total == alloc) {
+                    alloc = alloc ? alloc * 2 : 1024;
+                    if (alloc > sample->count) alloc = sample->count;
+                    if ((grown = stats_resize_lines(lines, alloc)) == NULL) {
+                        res = JSINI_ERROR;
+                        break;
+                    }
+                    lines = grown;
+                }
+                if (slot < sample->count) {
+                    lines[slot].offset = p - data;
+                    lines[slot].size = len;
+                }
+            }
+            p += len;
+        }
+
+        if (sample->mode == STATS_SAMPLE_RESERVOIR && res == JSINI_OK) {
+            count = total < sample->count ? total : sample->count;
+            if (count > 0) {
+                qsort(lines, count, sizeof(stats_line_t), compare_sampled_lines);
+            }
+            for (i = 0; i < count && res == JSINI_OK; i++) {
+                res = stats_add_lines(ctx, data + lines[i].offset, lines[i].size);
+            }
+        }
+        if (res == JSINI_OK) {
+            fprintf(stderr, "Sampled %zu of %zu lines\n", count, total);
+        }
+    }
+
+    free(lines);
+    stats_unmap_file(data, size);
+    return res;
+}
+
+static void print_key_stats(jsini_value_t *value, uint32_t flags, int max_level,
+                            double min_ratio) {
+    jsini_key_stats_map_t *stats = jsh_create_simple(0, 0);
+    jsini_key_stats_collector_t *collector = jsini_key_stats_collector_create_ex(flags);
+
+    jsini_key_stats_collector_add(collector, value);
+    jsini_key_stats_collector_flush(collector, stats);
+    jsini_key_stats_collector_free(collector);
+    jsini_print_key_stats(stdout, stats, max_level, min_ratio);
+    jsini_free_key_stats_map(stats);
+}
+
+typedef struct {
+    jsini_csv_writer_t *writer;
+    long scan;              // records whose keys make up the header, 0 for all
+    jsini_array_t *pending; // records held back until the header is known
+    jsini_array_t *columns;
+    jsh_t *seen;
+} csv_convert_t;
+
+static void csv_convert_keys(csv_convert_t *ctx, const jsini_value_t *value) {
+    const jsini_object_t *obj = (const jsini_object_t *)value;
+    uint32_t i;
+
+    if (value->type != JSINI_TOBJECT) return;
+
+    for (i = 0; i < obj->keys.size; i++) {
+        const jsini_string_t *name = ((jsini_attr_t *)obj->keys.item[i])->name;
+        if (!jsh_exists(ctx->seen, name->data.data)) {
+            jsini_string_t *copy = jsini_alloc_string(name->data.data, name->data.size);
+            jsini_push(ctx->columns, copy);
+            jsh_put(ctx->seen, copy->data.data, copy);
+        }
+    }
+}
+
+static int csv_convert_header(csv_convert_t *ctx) {
+    uint32_t i;
+    int res = jsini_csv_writer_columns(ctx->writer, ctx->columns);
+
+    for (i = 0; res == JSINI_OK && i < jsini_array_size(ctx->pending); i++) {
+        res = jsini_csv_write_row(ctx->writer, jsini_aget(ctx->pending, i));
+    }
+    jsini_free_array(ctx->pending);
+    ctx->pending = NULL;
+    return res;
+}
+
+static int csv_scan_callback(jsini_value_t *value, void *user_data) {
+    csv_convert_keys((csv_convert_t *)user_data, value);
+    jsini_free(value);
+    return JSINI_OK;
+}
+
+static int csv_write_callback(jsini_value_t *value, void *user_data) {
+    csv_convert_t *ctx = (csv_convert_t *)user_data;
+    int res;
+
+    if (ctx->pending) {
+        csv_convert_keys(ctx, value);
+        jsini_push_value(ctx->pending, value);
+        if ((long)jsini_array_size(ctx->pending) >= ctx->scan) {
+            return csv_convert_header(ctx);
+        }
+        return JSINI_OK;
+    }
+
+    res = jsini_csv_write_row(ctx->writer, value);
+    jsini_free(value);
+    return res;
+}
+
+/*
+ * Converts JSONL to CSV one record at a time. The header is the union of the
+ * keys of the first `scan` records in order of appearance; with a scan of 0
+ * the file is read twice and every record contributes. Stops at the first
+ * line that does not parse or row that can't be written.
+ */
+static int convert_jsonl_to_csv(const char *file, const char *output, long scan) {
+    csv_convert_t ctx;
+    int res, write_res;
+
+    if ((ctx.writer = jsini_csv_writer_open(output, ',')) == NULL) {
+        fprintf(stderr, "Can't open %s (%s)\n", output, strerror(errno));
+        return 1;
+    }
+    ctx.scan = scan;
+    ctx.pending = scan > 0 ? jsini_alloc_array() : NULL;
+    ctx.columns = jsini_alloc_array();
+    ctx.seen = jsh_create_simple(0, 0);
+
+    if (scan == 0) {
+        res = jsini_parse_file_jsonl_ex(file, csv_scan_callback, &ctx);
+        if (res == JSINI_OK) {
+            res = jsini_csv_writer_columns(ctx.writer, ctx.columns);
+        }
+    } else {
+        res = JSINI_OK;
+    }
+    if (res == JSINI_OK) {
+        res = jsini_parse_file_jsonl_ex(file, csv_write_callback, &ctx);
+    }
+    if (ctx.pending) {
+        if (res == JSINI_OK) {
+            res = csv_convert_header(&ctx);
+        } else {
+            jsini_free_array(ctx.pending);
+        }
+    }
+
+    write_res = jsini_csv_writer_close(ctx.writer);
+    if (write_res != JSINI_OK) {
+        fprintf(stderr, "Can't write %s\n", output ? output : "stdout");
+    }
+    jsh_destroy(ctx.seen);
+    jsini_free_array(ctx.columns);
+    return res == JSINI_OK && write_res == JSINI_OK ? 0 : 1;
+}
+
+typedef struct {
+    FILE *fp;
+    jsb_t sb;
+} jsonl_writer_t;
+
+static int jsonl_write_callback(jsini_value_t *value, void *user_data) {
+    jsonl_writer_t *ctx = (jsonl_writer_t *)user_data;
+
+    jsb_clear(&ctx->sb);
+    jsini_stringify(value, &ctx->sb, 0, 0);
+    jsb_append_char(&ctx->sb, '\n');
+    jsini_free(value);
+    return fwrite(ctx->sb.data, 1, ctx->sb.size, ctx->fp) == ctx->sb.size ? JSINI_OK : JSINI_ERROR;
+}
+
+#ifndef HAVE_PIPELINE
+static int jsonl_select_callback(jsini_value_t *value, void *user_data) {
+    if (value) {
+        return jsonl_write_callback(value, user_data);
+    }
+    fputs("null\n", ((jsonl_writer_t *)user_data)->fp);
+    return JSINI_OK;
+}
+#endif
+
+static int convert_csv_to_jsonl(const char *file, const char *output, const char *columns,
+                                jsini_csv_filter_t *filter) {
+    jsonl_writer_t ctx;
+    int res;
+
+    ctx.fp = output ? fopen(output, "w") : stdout;
+    if (!ctx.fp) {
+        fprintf(stderr, "Can't open %s (%s)\n", output, strerror(errno));
+        return 1;
+    }
+    jsb_init(&ctx.sb);
+    res = jsini_parse_file_csv_filter(file, JSINI_CSV_DEFAULT, columns, filter,
+                                      jsonl_write_callback, &ctx);
+    jsb_clean(&ctx.sb);
+    if (output ? fclose(ctx.fp) != 0 : fflush(ctx.fp) != 0 || ferror(ctx.fp)) {
+        fprintf(stderr, "Can't write %s\n", output ? output : "stdout");
+        res = JSINI_ERROR;
+    }
+    return res == JSINI_OK ? 0 : 1;
+}
+
+#ifdef HAVE_PIPELINE
+
+#define PIPE_BATCH_BYTES (1 << 20)
+#define PIPE_BATCH_RECORDS 4096
+
+enum { PIPE_FREE, PIPE_FILLED, PIPE_DONE };
+
+typedef struct {
+    int state;
+    int options;
+    const char *key;        // path selected from each record, or NULL
+    jsb_t input;            // whole JSONL lines
+    jsb_t output;           // formatted records, comma separated
+    size_t count;
+    int res;
+} pipe_batch_t;
+
+/*
+ * Batch i lives in slot i % slots. The reader fills free slots in order,
+ * workers take filled batches in order and finish them in any order, and
+ * the writer prints finished batches in order and frees their slots.
+ */
+typedef struct {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pipe_batch_t *batches;
+    size_t slots;
+    size_t filled;          // batches handed to the workers
+    size_t taken;           // batches taken by a worker
+    int done;               // the reader is finished
+    int failed;
+    size_t count;           // records written
+    pipe_batch_t *current;  // batch being filled
+} pipe_t;
+
+static pipe_batch_t *pipe_next_batch(pipe_t *pipe) {
+    pipe_batch_t *batch = &pipe->batches[pipe->filled % pipe->slots];
+    int failed;
+
+    pthread_mutex_lock(&pipe->lock);
+    while (batch->state != PIPE_FREE && !pipe->failed) {
+        pthread_cond_wait(&pipe->changed, &pipe->lock);
+    }
+    failed = pipe->failed;
+    pthread_mutex_unlock(&pipe->lock);
+
+    if (failed) return NULL;
+    jsb_clear(&batch->input);
+    jsb_clear(&batch->output);
+    batch->count = 0;
+    return pipe->current = batch;
+}
+
+static void pipe_submit(pipe_t *pipe) {
+    pthread_mutex_lock(&pipe->lock);
+    pipe->current->state = PIPE_FILLED;
+    pipe->filled++;
+    pthread_cond_broadcast(&pipe->changed);
+    pthread_mutex_unlock(&pipe->lock);
+    pipe->current = NULL;
+}
+
+// jsb_t grows by what is appended; batch buffers double instead
+static void pipe_reserve(jsb_t *sb, size_t size) {
+    if (sb->size + size + 1 > sb->alloc_size) {
+        jsb_alloc(sb, 2 * (sb->size + size + 1));
+    }
+}
+
+// Formats a record as an item of the top-level array
+static int pipe_format_callback(jsini_value_t *value, void *user_data) {
+    pipe_batch_t *batch = (pipe_batch_t *)user_data;
+    int pretty = (batch->options & JSINI_PRETTY_PRINT) != 0;
+
+    pipe_reserve(&batch->output, 4096);
+    if (batch->count++ > 0) {
+        jsb_append(&batch->output, pretty ? ",\n" : ",", pretty ? 2 : 1);
     }
+    if (pretty) {
+        jsb_append(&batch->output, "  ", 2);
+    }
+    jsini_stringify_real(value, &batch->output, batch->options, 1, 2);
+    jsini_free(value);
+    return JSINI_OK;
+}
+
+// Formats the value selected from a record as a line of its own
+static int pipe_select_callback(jsini_value_t *value, void *user_data) {
+    pipe_batch_t *batch = (pipe_batch_t *)user_data;
 
+    pipe_reserve(&batch->output, 4096);
+    if (value) {
+        jsini_stringify(value, &batch->output, 0, 0);
+        jsini_free(value);
+    } else {
+        jsb_append(&batch->output, "null", 4);
+    }
+    jsb_append_char(&batch->output, '\n');
+    batch->count++;
     return JSINI_OK;
 }
 
+/*
+ * CSV records are formatted by the reader that built them: a value freed on
+ * another thread than the one that allocated it costs more than formatting.
+ */
+static int pipe_csv_callback(jsini_value_t *value, void *user_data) {
+    pipe_t *pipe = (pipe_t *)user_data;
+
+    if (!pipe->current && !pipe_next_batch(pipe)) {
+        jsini_free(value);
+        return JSINI_ERROR;
+    }
+    pipe_format_callback(value, pipe->current);
+    if (pipe->current->count >= PIPE_BATCH_RECORDS) {
+        pipe_submit(pipe);
+    }
+    return JSINI_OK;
+}
+
+static void *pipe_worker_run(void *arg) {
+    pipe_t *pipe = (pipe_t *)arg;
+    pipe_batch_t *batch;
+
+    while (1) {
+        pthread_mutex_lock(&pipe->lock);
+        while (pipe->taken == pipe->filled && !pipe->done) {
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        }
+        if (pipe->taken == pipe->filled) {
+            pthread_mutex_unlock(&pipe->lock);
+            return NULL;
+        }
+        batch = &pipe->batches[pipe->taken++ % pipe->slots];
+        pthread_mutex_unlock(&pipe->lock);
+
+        if (batch->key) {
+            batch->res = jsini_select_string_jsonl(batch->input.data, batch->input.size,
+                                                   batch->key, pipe_select_callback, batch);
+        } else {
+            batch->res = jsini_parse_string_jsonl_ex(batch->input.data, batch->input.size,
+                                                     pipe_format_callback, batch);
+        }
+
+        pthread_mutex_lock(&pipe->lock);
+        batch->state = PIPE_DONE;
+        pthread_cond_broadcast(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+}
+
+static void *pipe_writer_run(void *arg) {
+    pipe_t *pipe = (pipe_t *)arg;
+    size_t seq;
+
+    for (seq = 0; ; seq++) {
+        pipe_batch_t *batch = &pipe->batches[seq % pipe->slots];
+        int pretty = (batch->options & JSINI_PRETTY_PRINT) != 0;
+
+        pthread_mutex_lock(&pipe->lock);
+        while (batch->state != PIPE_DONE && !(pipe->done && seq == pipe->filled)) {
+            pthread_cond_wait(&pipe->changed, &pipe->lock);
+        }
+        if (batch->state != PIPE_DONE || batch->res != JSINI_OK) {
+            if (batch->state == PIPE_DONE) {
+                pipe->failed = 1;
+                pthread_cond_broadcast(&pipe->changed);
+            }
+            pthread_mutex_unlock(&pipe->lock);
+            return NULL;
+        }
+        pthread_mutex_unlock(&pipe->lock);
+
+        if (batch->key) {
+            fwrite(batch->output.data, 1, batch->output.size, stdout);
+        } else if (batch->count > 0) {
+            if (pipe->count == 0) {
+                fputs(pretty ? "[\n" : "[", stdout);
+            } else {
+                fputs(pretty ? ",\n" : ",", stdout);
+            }
+            fwrite(batch->output.data, 1, batch->output.size, stdout);
+        }
+        pipe->count += batch->count;
+
+        pthread_mutex_lock(&pipe->lock);
+        batch->state = PIPE_FREE;
+        pthread_cond_broadcast(&pipe->changed);
+        pthread_mutex_unlock(&pipe->lock);
+    }
+}
+
+/*
+ * Prints a JSONL or CSV file as one array without loading it: this thread
+ * reads batches of records, one worker per CPU parses and formats the JSONL
+ * ones, and a writer thread prints them in order. The output is the same as
+ * that of jsini_print() on the whole array; a parse error stops it where it
+ * is. With a `key`, the value at that path of each JSONL record is printed
+ * on a line instead, null when there is none.
+ */
+static int print_records(const char *file, int parse_csv, const char *key, int options) {
+    pipe_t pipe;
+    pthread_t writer, *workers;
+    long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    int i, n = nproc > 1 ? (int)nproc : 1;
+    int started, writing, res = JSINI_OK;
+    FILE *fp;
+
+    if ((fp = fopen(file, "rb")) == NULL) {
+        fprintf(stderr, "Can't open %s (%s)\n", file, strerror(errno));
+        return 1;
+    }
+
+    memset(&pipe, 0, sizeof(pipe));
+    pthread_mutex_init(&pipe.lock, NULL);
+    pthread_cond_init(&pipe.changed, NULL);
+    pipe.slots = 2 * n + 2;
+    pipe.batches = (pipe_batch_t *)calloc(pipe.slots, sizeof(pipe_batch_t));
+    for (i = 0; i < (int)pipe.slots; i++) {
+        pipe.batches[i].options = options;
+        pipe.batches[i].key = key;
+        jsb_init(&pipe.batches[i].input);
+        jsb_init(&pipe.batches[i].output);
+    }
+
+    workers = (pthread_t *)malloc(n * sizeof(pthread_t));
+    for (started = 0; started < n; started++) {
+        if (pthread_create(&workers[started], NULL, pipe_worker_run, &pipe) != 0) break;
+    }
+    writing = started == n && pthread_create(&writer, NULL, pipe_writer_run, &pipe) == 0;
+
+    if (!writing) {
+        // The workers that did start see no batches and stop
+        fprintf(stderr, "Can't start threads to print %s\n", file);
+        fclose(fp);
+        pthread_mutex_lock(&pipe.lock);
+        pipe.failed = 1;
+        pthread_mutex_unlock(&pipe.lock);
+    } else if (parse_csv) {
+        fclose(fp);
+        res = jsini_parse_file_csv_ex(file, JSINI_CSV_DEFAULT, pipe_csv_callback, &pipe);
+    } else {
+        jsb_reader_t reader;
+        const char *line;
+        size_t size;
+
+        jsb_reader_init(&reader, fp);
+        while (jsb_reader_getline(&reader, &line, &size) == JSB_OK) {
+            if (!pipe.current && !pipe_next_batch(&pipe)) break;
+            pipe_reserve(&pipe.current->input, size);
+            jsb_append(&pipe.current->input, line, size);
+            if (pipe.current->input.size >= PIPE_BATCH_BYTES) {
+                pipe_submit(&pipe);
+            }
+        }
+        jsb_reader_clean(&reader);
+        fclose(fp);
+    }
+    if (pipe.current) {
+        pipe_submit(&pipe);
+    }
+
+    pthread_mutex_lock(&pipe.lock);
+    pipe.done = 1;
+    if (res != JSINI_OK) pipe.failed = 1;
+    pthread_cond_broadcast(&pipe.changed);
+    pthread_mutex_unlock(&pipe.lock);
+
+    for (i = 0; i < started; i++) {
+        pthread_join(workers[i], NULL);
+    }
+    if (writing) {
+        pthread_join(writer, NULL);
+    }
+
+    if (!pipe.failed && !key) {
+        if (pipe.count == 0) {
+            fputs("[]", stdout);
+        } else {
+            fputs((options & JSINI_PRETTY_PRINT) != 0 ? "\n]" : "]", stdout);
+        }
+    }
+
+    for (i = 0; i < (int)pipe.slots; i++) {
+        jsb_clean(&pipe.batches[i].input);
+        jsb_clean(&pipe.batches[i].output);
+    }
+    free(pipe.batches);
+    free(workers);
+    pthread_cond_destroy(&pipe.changed);
+    pthread_mutex_destroy(&pipe.lock);
+    return pipe.failed ? 1 : 0;
+}
+
+#endif
+
+#ifdef HAVE_ATOMIC_REPLACE
+
+#define REPLACE_BLOCK (1 << 20)
+
+// Whether `file` holds exactly the `size` bytes of `data`
+static int file_equals(const char *file, const char *data, size_t size) {
+    FILE *fp = fopen(file, "rb");
+    char *block = (char *)malloc(REPLACE_BLOCK);
+    size_t n, offset = 0;
+    int equal = fp != NULL;
+
+    while (equal && (n = fread(block, 1, REPLACE_BLOCK, fp)) > 0) {
+        equal = offset + n <= size && memcmp(block, data + offset, n) == 0;
+        offset += n;
+    }
+    if (fp) fclose(fp);
+    free(block);
+    return equal && offset == size;
+}
+
+static int write_all(int fd, const char *data, size_t size) {
+    while (size > 0) {
+        ssize_t n = write(fd, data, size < REPLACE_BLOCK ? size : REPLACE_BLOCK);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return JSINI_ERROR;
+        }
+        data += n;
+        size -= n;
+    }
+    return JSINI_OK;
+}
+
+/*
+ * Replaces `file` with the printed value. The text goes to a temporary file
+ * in the same directory, which is synced and renamed over the original, so
+ * a crash leaves one version or the other whole; a file that already holds
+ * the text is not written at all. A symbolic link is followed and its
+ * target replaced, keeping the permissions of the original, and its owner
+ * and group where this user may set them. The new file is a new inode, so
+ * other hard links to the original keep the old content.
+ */
+static int replace_file(const char *file, const jsini_value_t *value, int options) {
+    char *path = realpath(file, NULL);
+    char *temp = NULL;
+    struct stat st;
+    jsb_t sb;
+    int fd, res = 1;
+
+    jsb_init(&sb);
+    if (!path || stat(path, &st) != 0) {
+        fprintf(stderr, "Can't open %s (%s)\n", file, strerror(errno));
+        goto done;
+    }
+
+    jsini_stringify(value, &sb, options, 2);
+    if (file_equals(path, sb.data, sb.size)) {
+        res = 0;
+        goto done;
+    }
+
+    temp = (char *)malloc(strlen(path) + sizeof(".XXXXXX"));
+    sprintf(temp, "%s.XXXXXX", path);
+    if ((fd = mkstemp(temp)) < 0) {
+        fprintf(stderr, "Can't create %s (%s)\n", temp, strerror(errno));
+        goto done;
+    }
+    // The owner is set first, since changing it may clear set-id bits
+    if ((fchown(fd, st.st_uid, st.st_gid) != 0 && errno != EPERM)
+            || fchmod(fd, st.st_mode & 07777) != 0
+            || write_all(fd, sb.data, sb.size) != JSINI_OK || fsync(fd) != 0) {
+        fprintf(stderr, "Can't write %s (%s)\n", temp, strerror(errno));
+        close(fd);
+        unlink(temp);
+        goto done;
+    }
+    if (close(fd) != 0 || rename(temp, path) != 0) {
+        fprintf(stderr, "Can't replace %s (%s)\n", file, strerror(errno));
+        unlink(temp);
+        goto done;
+    }
+
+    // Make the rename itself durable
+    *strrchr(path, '/') = '\0';
+    if ((fd = open(*path ? path : "/", O_RDONLY)) >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    res = 0;
+
+done:
+    jsb_clean(&sb);
+    free(temp);
+    free(path);
+    return res;
+}
+
+#else
+
+static int replace_file(const char *file, const jsini_value_t *value, int options) {
+    FILE *fp = fopen(file, "w");
+    if (!fp) {
+        fprintf(stderr, "Can't open %s (%s)\n", file, strerror(errno));
+        return 1;
+    }
+    jsini_print(fp, value, options);
+    fclose(fp);
+    return 0;
+}
+
+#endif
+
+#define BENCH_MAX_PHASES 10
+
+#ifdef _WIN32
+#define BENCH_NULL_DEVICE "NUL"
+#else
+#define BENCH_NULL_DEVICE "/dev/null"
+#endif
+
+typedef struct {
+    const char *name;
+    size_t bytes;           // handled by one run, 0 when not meaningful
+    size_t records;
+    size_t allocations;     // in the last run
+    double *seconds;        // of each run
+} bench_phase_t;
+
+typedef struct {
+    int runs;
+    int run;
+    int count;
+    double start;
+    size_t allocations;     // library allocations at bench_begin()
+    bench_phase_t phases[BENCH_MAX_PHASES];
+} bench_t;
+
+static double bench_now(void) {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#else
+    timespec_get(&ts, TIME_UTC);
+#endif
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void bench_begin(bench_t *b) {
+#ifdef JSINI_COUNT_ALLOCS
+    b->allocations = jsini_alloc_count();
+#endif
+    b->start = bench_now();
+}
+
+// Records the time since bench_begin() as phase `name` of the current run
+static void bench_end(bench_t *b, const char *name, size_t bytes, size_t records) {
+    double seconds = bench_now() - b->start;
+    bench_phase_t *phase = NULL;
+    int i;
+
+#ifdef JSINI_COUNT_ALLOCS
+    size_t allocations = jsini_alloc_count() - b->allocations;
+#endif
+    for (i = 0; i < b->count && !phase; i++) {
+        if (strcmp(b->phases[i].name, name) == 0) phase = &b->phases[i];
+    }
+    if (!phase) {
+        if (b->count == BENCH_MAX_PHASES) return;
+        phase = &b->phases[b->count++];
+        phase->name = name;
+        phase->seconds = (double *)calloc(b->runs, sizeof(double));
+    }
+    phase->seconds[b->run] = seconds;
+    phase->bytes = bytes;
+    phase->records = records;
+#ifdef JSINI_COUNT_ALLOCS
+    phase->allocations = allocations;
+#endif
+}
+
+static int compare_seconds(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void bench_report(bench_t *b, const char *file, const char *format, size_t bytes) {
+    jsini_object_t *report = jsini_alloc_object();
+    jsini_array_t *phases = jsini_alloc_array();
+    int i, k;
+
+    jsini_set_string(report, "file", file);
+    jsini_set_string(report, "format", format);
+    jsini_set_integer(report, "bytes", bytes);
+    jsini_set_integer(report, "runs", b->runs);
+#ifdef HAVE_GETRUSAGE
+    {
+        struct rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+        jsini_set_integer(report, "peak_rss_kb", usage.ru_maxrss / 1024);
+#else
+        jsini_set_integer(report, "peak_rss_kb", usage.ru_maxrss);
+#endif
+    }
+#endif
+
+    for (i = 0; i < b->count; i++) {
+        bench_phase_t *phase = &b->phases[i];
+        jsini_object_t *item = jsini_alloc_object();
+        double median, sum = 0;
+
+        qsort(phase->seconds, b->runs, sizeof(double), compare_seconds);
+        for (k = 0; k < b->runs; k++) sum += phase->seconds[k];
+        median = b->runs % 2 ? phase->seconds[b->runs / 2]
+                             : (phase->seconds[b->runs / 2 - 1] + phase->seconds[b->runs / 2]) / 2;
+
+        jsini_set_string(item, "name", phase->name);
+        jsini_set_number(item, "min_s", phase->seconds[0]);
+        jsini_set_number(item, "median_s", median);
+        jsini_set_number(item, "mean_s", sum / b->runs);
+        if (phase->bytes > 0) {
+            jsini_set_integer(item, "bytes", phase->bytes);
+            if (median > 0) jsini_set_number(item, "mb_per_s", phase->bytes / 1e6 / median);
+        }
+        if (phase->records > 0) {
+            jsini_set_integer(item, "records", phase->records);
+            if (median > 0) {
+                jsini_set_integer(item, "records_per_s", (int64_t)(phase->records / median + 0.5));
+            }
+        }
+#ifdef JSINI_COUNT_ALLOCS
+        jsini_set_integer(item, "allocations", phase->allocations);
+#endif
+        jsini_push(phases, item);
+        free(phase->seconds);
+    }
+    jsini_set(report, "phases", phases);
+
+    jsini_print(stdout, (jsini_value_t *)report, JSINI_PRETTY_PRINT);
+    fputc('\n', stdout);
+    jsini_free((jsini_value_t *)report);
+}
+
+static int bench_collect_callback(jsini_value_t *value, void *user_data) {
+    jsini_push_value((jsini_array_t *)user_data, value);
+    return JSINI_OK;
+}
+
+static int bench_count_callback(jsini_value_t *value, void *user_data) {
+    if (value) {
+        (*(size_t *)user_data)++;
+        jsini_free(value);
+    }
+    return JSINI_OK;
+}
+
+/*
+ * Runs every phase a file goes through `runs` times: reading, parsing,
+ * compact, pretty and sorted stringify, selecting `key`, writing CSV and
+ * freeing. Prints the timings of each phase as JSON.
+ */
+static int run_bench(const char *file, int parse_jsonl, int parse_csv, const char *key,
+                     int runs) {
+    static const struct {
+        const char *name;
+        int options;
+    } styles[] = {
+        { "stringify", 0 },
+        { "stringify_pretty", JSINI_PRETTY_PRINT },
+        { "stringify_sorted", JSINI_SORT_KEYS },
+    };
+    bench_t b;
+    jsb_t data, out;
+    size_t bytes = 0;
+    int i;
+
+    memset(&b, 0, sizeof(b));
+    b.runs = runs;
+
+    for (b.run = 0; b.run < runs; b.run++) {
+        jsini_value_t *value;
+        size_t records, found = 0;
+        int res = JSINI_OK;
+
+        jsb_init(&data);
+        bench_begin(&b);
+        if (jsb_load(&data, file) != JSB_OK) {
+            fprintf(stderr, "Can't read %s (%s)\n", file, strerror(errno));
+            jsb_clean(&data);
+            return 1;
+        }
+        bench_end(&b, "read", data.size, 0);
+        bytes = data.size;
+
+        bench_begin(&b);
+        if (parse_jsonl) {
+            value = (jsini_value_t *)jsini_alloc_array();
+            res = jsini_parse_string_jsonl_ex(data.data, data.size, bench_collect_callback, value);
+        } else if (parse_csv) {
+            value = jsini_parse_string_csv(data.data, data.size);
+        } else {
+            value = jsini_parse_string_ex(data.data, data.size, JSINI_COMMENT);
+        }
+        records = value && value->type == JSINI_TARRAY
+                      ? jsini_array_size((jsini_array_t *)value) : 1;
+        bench_end(&b, "parse", data.size, records);
+
+        if (!value || res != JSINI_OK) {
+            fprintf(stderr, "Can't parse %s\n", file);
+            if (value) jsini_free(value);
+            jsb_clean(&data);
+            return 1;
+        }
+
+        for (i = 0; i < (int)(sizeof(styles) / sizeof(styles[0])); i++) {
+            jsb_init(&out);
+            bench_begin(&b);
+            jsini_stringify(value, &out, styles[i].options, 2);
+            bench_end(&b, styles[i].name, out.size, records);
+            jsb_clean(&out);
+        }
+
+        if (key) {
+            bench_begin(&b);
+            if (parse_jsonl) {
+                jsini_select_string_jsonl(data.data, data.size, key, bench_count_callback, &found);
+            } else {
+                found = jsini_select((jsini_object_t *)value, key) != NULL;
+            }
+            bench_end(&b, "select", parse_jsonl ? data.size : 0, found);
+        }
+
+        if (parse_jsonl || parse_csv) {
+            bench_begin(&b);
+            jsini_print_file_csv(BENCH_NULL_DEVICE, value, ',');
+            bench_end(&b, "write_csv", 0, records);
+        }
+
+        bench_begin(&b);
+        jsini_free(value);
+        bench_end(&b, "free", 0, records);
+        jsb_clean(&data);
+    }
+
+    bench_report(&b, file, parse_jsonl ? "jsonl" : parse_csv ? "csv" : "json", bytes);
+    return 0;
+}
+
 int main(int argc, char **argv) {
     int print_options = 0;
     int parse_ini = 0;
@@ -35,9 +1202,17 @@ int main(int argc, char **argv) {
     int parse_csv = 0;
     int replace = 0;
     int print_stats = 0;
+    uint32_t stats_flags = 0;
+    stats_sample_t sample = { 0 };
     int max_level = -1;  // -1 means unlimited
     double min_ratio = 0.0;  // 0.0 means no minimum
     const char *key = NULL;
+    const char *to = NULL;
+    const char *output = NULL;
+    const char *columns = NULL;  // CSV columns to read, NULL for all
+    jsini_csv_filter_t *filter = NULL;
+    long scan = 1;
+    int bench_runs = 0;
 
     while (1) {
        static struct option options[] = {
@@ -53,12 +1228,18 @@ int main(int argc, char **argv) {
            {"sort",        no_argument,        0, 'S'},
            {"replace",     no_argument,        0, 'r'},
            {"stats",       no_argument,        0, 's'},
+           {"profile",     no_argument,        0, 'P'},
+           {"sample",      required_argument,  0, 'R'},
            {"level",       required_argument,  0, 'l'},
            {"min-ratio",   required_argument,  0, 'm'},
+           {"scan",        required_argument,  0, 'n'},
+           {"columns",     required_argument,  0, 'C'},
+           {"where",       required_argument,  0, 'w'},
+           {"bench",       required_argument,  0, 'B'},
            {0, 0, 0, 0}
        };
 
-       static const char *opts = "af:g:k:iLct:o:prSsl:m:";
+       static const char *opts = "aB:f:g:k:iLcC:t:o:pPR:rSsl:m:n:w:";
 
        int n = 0;
        int c = getopt_long (argc, argv, opts, options, &n);
@@ -69,6 +1250,12 @@ int main(int argc, char **argv) {
        case 'a':
            print_options |= JSINI_SORT_KEYS;
            break;
+       case 'B':
+           if ((bench_runs = atoi(optarg)) <= 0) {
+               fprintf(stderr, "Invalid bench runs: %s\n", optarg);
+               return 1;
+           }
+           break;
        case 'f':
            break;
        case 'i':
@@ -84,8 +1271,10 @@ int main(int argc, char **argv) {
            key = optarg;
            break;
        case 't':
+           to = optarg;
            break;
        case 'o':
+           output = optarg;
            break;
        case 'p':
            print_options |= JSINI_PRETTY_PRINT;
@@ -99,12 +1288,36 @@ int main(int argc, char **argv) {
        case 's':
            print_stats = 1;
            break;
+       case 'P':
+           print_stats = 1;
+           stats_flags |= JSINI_STATS_VALUES;
+           break;
+       case 'R':
+           if (stats_parse_sample(optarg, &sample) != JSINI_OK) {
+               fprintf(stderr, "Invalid sample: %s\n", optarg);
+               return 1;
+           }
+           print_stats = 1;
+           break;
        case 'l':
            max_level = atoi(optarg);
            break;
        case 'm':
            min_ratio = atof(optarg);
            break;
+       case 'n':
+           scan = atol(optarg);
+           break;
+       case 'C':
+           columns = optarg;
+           break;
+       case 'w':
+           if (filter) jsini_csv_filter_free(filter);
+           if ((filter = jsini_csv_filter_compile(optarg)) == NULL) {
+               fprintf(stderr, "Invalid filter: %s\n", optarg);
+               return 1;
+           }
+           break;
        default:
            return 1;
        }
@@ -113,21 +1326,73 @@ int main(int argc, char **argv) {
     if (optind < argc) {
         const char *file = argv[optind++];
 
+        if (to && parse_jsonl && strcmp(to, "csv") == 0) {
+            return convert_jsonl_to_csv(file, output, scan);
+        }
+        if (to && parse_csv && strcmp(to, "jsonl") == 0) {
+            int res = convert_csv_to_jsonl(file, output, columns, filter);
+            if (filter) jsini_csv_filter_free(filter);
+            return res;
+        }
+
+        if (bench_runs > 0) {
+            return run_bench(file, parse_jsonl, parse_csv, key, bench_runs);
+        }
+
+        if (sample.mode && !parse_jsonl) {
+            fprintf(stderr, "--sample needs --jsonl\n");
+            return 1;
+        }
+
         if (print_stats && (parse_jsonl || parse_csv)) {
             jsini_key_stats_map_t *stats = jsh_create_simple(0, 0);
-            stats_context_t ctx = { stats, 0 };
-            if (parse_jsonl) {
-                jsini_parse_file_jsonl_ex(file, stats_callback, &ctx);
+            stats_context_t ctx = { jsini_key_stats_collector_create_ex(stats_flags), 0, 0 };
+            int res;
+            if (sample.mode) {
+                res = collect_jsonl_stats_sampled(file, &sample, &ctx);
+            } else if (parse_jsonl) {
+#ifdef HAVE_PARALLEL_STATS
+                res = collect_jsonl_stats_parallel(file, stats_flags, &ctx, stats);
+#else
+                res = collect_jsonl_stats(file, &ctx);
+#endif
             } else {
-                jsini_parse_file_csv_ex(file, JSINI_CSV_DEFAULT, stats_callback, &ctx);
+                res = jsini_parse_file_csv_filter(file, JSINI_CSV_DEFAULT, columns, filter,
+                                                  stats_callback, &ctx);
             }
-            if (ctx.line_count > 0) {
-                fprintf(stderr, "Total: %zu lines processed\n", ctx.line_count);
+            jsini_key_stats_collector_flush(ctx.collector, stats);
+            jsini_key_stats_collector_free(ctx.collector);
+            // Partial stats would depend on how the file was sliced
+            if (res == JSINI_OK) {
+                if (ctx.line_count > 0) {
+                    fprintf(stderr, "Total: %zu lines processed\n", ctx.line_count);
+                }
+                jsini_print_key_stats_ex(stdout, stats, max_level, min_ratio,
+                                         sample.mode ? JSINI_STATS_SAMPLED : 0);
+            } else {
+                fprintf(stderr, "Can't collect stats from %s\n", file);
             }
-            jsini_print_key_stats(stdout, stats, max_level, min_ratio);
             jsini_free_key_stats_map(stats);
-            return 0;
+            if (filter) jsini_csv_filter_free(filter);
+            return res == JSINI_OK ? 0 : 1;
+        }
+
+#ifdef HAVE_PIPELINE
+        if ((parse_jsonl || parse_csv) && !print_stats && !replace && !(key && parse_csv)) {
+            return print_records(file, parse_csv, key, print_options);
+        }
+#else
+        if (parse_jsonl && key && !print_stats) {
+            jsonl_writer_t ctx;
+            int res;
+
+            ctx.fp = stdout;
+            jsb_init(&ctx.sb);
+            res = jsini_select_file_jsonl(file, key, jsonl_select_callback, &ctx);
+            jsb_clean(&ctx.sb);
+            return res == JSINI_OK ? 0 : 1;
         }
+#endif
 
         jsini_value_t *value = parse_ini
                                  ? jsini_parse_file_ini(file)
@@ -139,23 +1404,17 @@ int main(int argc, char **argv) {
         if (value != NULL)
         {
             if (print_stats) {
-                jsini_key_stats_map_t *stats = jsh_create_simple(0, 0);
-                jsini_collect_key_stats(value, stats);
-                jsini_print_key_stats(stdout, stats, max_level, min_ratio);
-                jsini_free_key_stats_map(stats);
+                print_key_stats(value, stats_flags, max_level, min_ratio);
             }
             else if (key) {
                 jsini_print(stdout, jsini_select((jsini_object_t*)value, key), 0);
             }
             else {
                 if (replace) {
-                    FILE *fp = fopen(file, "w");
-                    if (!fp) {
-                        fprintf(stderr, "Can't open %s (%s)\n", file, strerror(errno));
+                    if (replace_file(file, value, print_options) != 0) {
+                        jsini_free(value);
                         return 1;
                     }
-                    jsini_print(fp, value, print_options);
-                    fclose(fp);
                 }
                 else {
                     jsini_print(stdout, value, print_options);
@@ -176,10 +1435,7 @@ int main(int argc, char **argv) {
                                          : jsini_parse_string(sb->data, sb->size);
       if (value != NULL) {
           if (print_stats) {
-              jsini_key_stats_map_t *stats = jsh_create_simple(0, 0);
-              jsini_collect_key_stats(value, stats);
-              jsini_print_key_stats(stdout, stats, max_level, min_ratio);
-              jsini_free_key_stats_map(stats);
+              print_key_stats(value, stats_flags, max_level, min_ratio);
           }
           else {
               jsini_print(stdout, value, print_options);
@@ -1,9 +1,18 @@
+#include <math.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "jsini.h"
 
+#ifdef JSINI_COUNT_ALLOCS
+#define xmalloc jsini_counted_malloc
+#define xcalloc jsini_counted_calloc
+#define xrealloc jsini_counted_realloc
+#else
 #define xmalloc malloc
+#define xcalloc calloc
+#define xrealloc realloc
+#endif
 #define xfree free
 
 static jsini_key_stats_t* get_or_create_stats(jsini_key_stats_map_t* stats, const char* key) {
@@ -15,75 +24,862 @@ static jsini_key_stats_t* get_or_create_stats(jsini_key_stats_map_t* stats, cons
     return entry;
 }
 
-static void jsini_collect_key_stats_internal(jsini_value_t* value, jsini_key_stats_map_t* stats,
-                                             const char* current_path);
-
-static void jsini_collect_key_stats_from_object(jsini_object_t* obj, jsini_key_stats_map_t* stats,
-                                                const char* current_path) {
-    jsini_key_stats_t* entry = get_or_create_stats(stats, current_path);
-    entry->object_count++;
-
+static void add_key_frequency(jsini_key_stats_t* entry, const char* key, int count) {
     if (!entry->key_frequencies) {
         entry->key_frequencies = jsh_create_simple(32, 0);
     }
+    // Stored counts are never zero, so zero means the key is new
+    int frequency = jsh_get_int(entry->key_frequencies, key);
+    if (frequency == 0) {
+        jsh_put_int(entry->key_frequencies, strdup(key), count);
+    } else {
+        jsh_put_int(entry->key_frequencies, key, frequency + count);
+    }
+}
 
-    const jsh_iterator_t* it;
-    for (it = jsh_first(obj->map); it; it = jsh_next(obj->map, it)) {
-        const char* key = jsini_iter_key(it);
-        jsini_value_t* val = jsini_iter_value(it);
-
-        // Update frequency for the local key
-        int count = jsh_get_int(entry->key_frequencies, key);
-        if (count == 0 && !jsh_exists(entry->key_frequencies, key)) {
-            jsh_put_int(entry->key_frequencies, strdup(key), 1);
+/*
+ * Value profiles. Scalars are hashed with a tag of their type, so "1" and 1
+ * count as different values. The hashes feed an exact set until it holds
+ * JSINI_STATS_SPARSE values and HyperLogLog registers after that; the top
+ * values are tracked with the space-saving algorithm, where a new value
+ * takes over the smallest counter and inherits its count as error.
+ */
+#define STATS_REGISTERS (1u << JSINI_STATS_HLL_BITS)
+
+typedef struct {
+    uint8_t type;
+    int64_t integer;    // also the bool
+    double number;
+    const char* data;   // string
+    size_t size;
+} stats_scalar_t;
+
+// FNV-1a with a final mix, since HyperLogLog needs well spread high bits
+static uint64_t stats_hash(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* p = (const unsigned char*)data;
+    uint64_t h = 0xcbf29ce484222325ull ^ seed;
+    for (size_t i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ull;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
+
+static uint64_t stats_scalar_hash(const stats_scalar_t* v) {
+    switch (v->type) {
+    case JSINI_TSTRING:
+        return stats_hash(v->data, v->size, v->type);
+    case JSINI_TNUMBER:
+        return stats_hash(&v->number, sizeof(v->number), v->type);
+    default:
+        return stats_hash(&v->integer, sizeof(v->integer), v->type);
+    }
+}
+
+static void stats_scalar_text(const stats_scalar_t* v, char* text) {
+    switch (v->type) {
+    case JSINI_TNULL:
+        strcpy(text, "null");
+        break;
+    case JSINI_TBOOL:
+        strcpy(text, v->integer ? "true" : "false");
+        break;
+    case JSINI_TINTEGER:
+        snprintf(text, JSINI_STATS_TOP_TEXT, "%lld", (long long)v->integer);
+        break;
+    case JSINI_TNUMBER:
+        snprintf(text, JSINI_STATS_TOP_TEXT, "%g", v->number);
+        break;
+    default: {
+        // Quoted, cut at a character boundary when too long
+        size_t n = v->size, i;
+        int cut = n > JSINI_STATS_TOP_TEXT - 3;
+        if (cut) {
+            n = JSINI_STATS_TOP_TEXT - 6;
+            while (n > 0 && ((unsigned char)v->data[n] & 0xc0) == 0x80) n--;
+        }
+        text[0] = '"';
+        for (i = 0; i < n; i++) {
+            text[i + 1] = (unsigned char)v->data[i] < 0x20 ? ' ' : v->data[i];
+        }
+        strcpy(text + n + 1, cut ? "...\"" : "\"");
+        break;
+    }
+    }
+}
+
+static void stats_register_add(uint8_t* registers, uint64_t hash) {
+    uint32_t index = (uint32_t)(hash >> (64 - JSINI_STATS_HLL_BITS));
+    uint64_t rest = hash << JSINI_STATS_HLL_BITS;
+    uint8_t rank = 1;
+    while (rank <= 64 - JSINI_STATS_HLL_BITS && !(rest & 0x8000000000000000ull)) {
+        rest <<= 1;
+        rank++;
+    }
+    if (registers[index] < rank) {
+        registers[index] = rank;
+    }
+}
+
+static void stats_use_registers(jsini_value_stats_t* vs) {
+    vs->registers = (uint8_t*)xcalloc(STATS_REGISTERS, 1);
+    for (uint32_t i = 0; i < vs->sparse_count; i++) {
+        stats_register_add(vs->registers, vs->sparse[i]);
+    }
+    xfree(vs->sparse);
+    vs->sparse = NULL;
+    vs->sparse_count = 0;
+    vs->sparse_alloc = 0;
+}
+
+static void stats_distinct_add(jsini_value_stats_t* vs, uint64_t hash) {
+    if (!vs->registers) {
+        for (uint32_t i = 0; i < vs->sparse_count; i++) {
+            if (vs->sparse[i] == hash) return;
+        }
+        if (vs->sparse_count < JSINI_STATS_SPARSE) {
+            if (vs->sparse_count == vs->sparse_alloc) {
+                vs->sparse_alloc = vs->sparse_alloc ? vs->sparse_alloc * 2 : 4;
+                vs->sparse = (uint64_t*)xrealloc(vs->sparse, vs->sparse_alloc * sizeof(uint64_t));
+            }
+            vs->sparse[vs->sparse_count++] = hash;
+            return;
+        }
+        stats_use_registers(vs);
+    }
+    stats_register_add(vs->registers, hash);
+}
+
+static void stats_top_add(jsini_value_stats_t* vs, const stats_scalar_t* v, uint64_t hash) {
+    jsini_top_value_t* top = NULL;
+    for (uint32_t i = 0; i < vs->top_count; i++) {
+        if (vs->top[i].hash == hash) {
+            vs->top[i].count++;
+            return;
+        }
+        if (!top || vs->top[i].count < top->count) {
+            top = &vs->top[i];
+        }
+    }
+    if (vs->top_count < JSINI_STATS_TOP_K) {
+        top = &vs->top[vs->top_count++];
+        top->count = 1;
+        top->error = 0;
+    } else {
+        top->error = top->count;
+        top->count++;
+    }
+    top->hash = hash;
+    stats_scalar_text(v, top->text);
+}
+
+static void stats_add_scalar(jsini_value_stats_t* vs, const stats_scalar_t* v) {
+    uint64_t hash = stats_scalar_hash(v);
+
+    vs->type_counts[v->type]++;
+    if (v->type == JSINI_TINTEGER || v->type == JSINI_TNUMBER) {
+        double d = v->type == JSINI_TINTEGER ? (double)v->integer : v->number;
+        if (vs->number_count == 0 || d < vs->number_min) vs->number_min = d;
+        if (vs->number_count == 0 || d > vs->number_max) vs->number_max = d;
+        vs->number_sum += d;
+        vs->number_count++;
+    } else if (v->type == JSINI_TSTRING) {
+        uint32_t bucket = 0;
+        for (size_t n = v->size; n && bucket < JSINI_STATS_LENGTHS - 1; n >>= 1) {
+            bucket++;
+        }
+        vs->lengths[bucket]++;
+        if (vs->string_count == 0 || v->size < vs->length_min) vs->length_min = v->size;
+        if (vs->string_count == 0 || v->size > vs->length_max) vs->length_max = v->size;
+        vs->length_sum += v->size;
+        vs->string_count++;
+    }
+    stats_distinct_add(vs, hash);
+    stats_top_add(vs, v, hash);
+}
+
+// Arrays and objects are only counted; the collector walks their contents
+static void stats_profile(jsini_value_stats_t* vs, const jsini_value_t* value) {
+    stats_scalar_t v;
+
+    v.type = value->type;
+    v.integer = 0;
+    switch (value->type) {
+    case JSINI_TNULL:
+        break;
+    case JSINI_TBOOL:
+        v.integer = ((const jsini_bool_t*)value)->data != 0;
+        break;
+    case JSINI_TINTEGER:
+        v.integer = ((const jsini_integer_t*)value)->data;
+        break;
+    case JSINI_TNUMBER:
+        v.number = ((const jsini_number_t*)value)->data;
+        break;
+    case JSINI_TSTRING:
+        v.data = ((const jsini_string_t*)value)->data.data;
+        v.size = ((const jsini_string_t*)value)->data.size;
+        break;
+    case JSINI_TARRAY:
+    case JSINI_TOBJECT:
+        vs->type_counts[value->type]++;
+        return;
+    default:
+        return;
+    }
+    stats_add_scalar(vs, &v);
+}
+
+static void stats_profile_packed(jsini_value_stats_t* vs, const jsini_array_t* arr) {
+    stats_scalar_t v;
+
+    v.type = arr->packed;
+    v.integer = 0;
+    for (uint32_t i = 0; i < jsini_array_size(arr); i++) {
+        switch (arr->packed) {
+        case JSINI_TBOOL:
+            v.integer = jsini_aget_bool(arr, i) != 0;
+            break;
+        case JSINI_TINTEGER:
+            v.integer = jsini_aget_integer(arr, i);
+            break;
+        case JSINI_TNUMBER:
+            v.number = jsini_aget_number(arr, i);
+            break;
+        default:
+            v.data = jsini_array_get_string(arr, i, &v.size);
+            break;
+        }
+        stats_add_scalar(vs, &v);
+    }
+}
+
+jsini_value_stats_t* jsini_alloc_value_stats() {
+    return (jsini_value_stats_t*)xcalloc(1, sizeof(jsini_value_stats_t));
+}
+
+void jsini_free_value_stats(jsini_value_stats_t* vs) {
+    xfree(vs->sparse);
+    xfree(vs->registers);
+    xfree(vs);
+}
+
+static int compare_top_values(const void* a, const void* b) {
+    const jsini_top_value_t* t1 = (const jsini_top_value_t*)a;
+    const jsini_top_value_t* t2 = (const jsini_top_value_t*)b;
+    if (t1->count != t2->count) {
+        return t1->count < t2->count ? 1 : -1;
+    }
+    return strcmp(t1->text, t2->text);
+}
+
+static size_t stats_top_floor(const jsini_value_stats_t* vs) {
+    size_t floor = 0;
+    if (vs->top_count == JSINI_STATS_TOP_K) {
+        floor = vs->top[0].count;
+        for (uint32_t i = 1; i < vs->top_count; i++) {
+            if (vs->top[i].count < floor) floor = vs->top[i].count;
+        }
+    }
+    return floor;
+}
+
+/*
+ * A value missing from a full sketch may have occurred as often as its
+ * smallest counter, which is added to both its count and its error.
+ */
+static void stats_merge_top(jsini_value_stats_t* dst, const jsini_value_stats_t* src) {
+    jsini_top_value_t merged[2 * JSINI_STATS_TOP_K];
+    size_t dst_floor = stats_top_floor(dst);
+    size_t src_floor = stats_top_floor(src);
+    uint32_t n = 0, i, j;
+
+    for (i = 0; i < dst->top_count; i++) {
+        merged[n] = dst->top[i];
+        for (j = 0; j < src->top_count && src->top[j].hash != dst->top[i].hash; j++);
+        if (j < src->top_count) {
+            merged[n].count += src->top[j].count;
+            merged[n].error += src->top[j].error;
         } else {
-            jsh_put_int(entry->key_frequencies, key, count + 1);
+            merged[n].count += src_floor;
+            merged[n].error += src_floor;
         }
+        n++;
+    }
+    for (j = 0; j < src->top_count; j++) {
+        for (i = 0; i < dst->top_count && dst->top[i].hash != src->top[j].hash; i++);
+        if (i == dst->top_count) {
+            merged[n] = src->top[j];
+            merged[n].count += dst_floor;
+            merged[n].error += dst_floor;
+            n++;
+        }
+    }
+
+    qsort(merged, n, sizeof(merged[0]), compare_top_values);
+    dst->top_count = n < JSINI_STATS_TOP_K ? n : JSINI_STATS_TOP_K;
+    memcpy(dst->top, merged, dst->top_count * sizeof(merged[0]));
+}
 
-        // Build child path: current_path + "." + key
-        size_t path_len = strlen(current_path) + strlen(key) + 2;
-        char* child_path = (char*)xmalloc(path_len);
-        sprintf(child_path, "%s.%s", current_path, key);
+void jsini_merge_value_stats(jsini_value_stats_t* dst, const jsini_value_stats_t* src) {
+    uint32_t i;
 
-        jsini_collect_key_stats_internal(val, stats, child_path);
-        xfree(child_path);
+    for (i = 0; i <= JSINI_TOBJECT; i++) {
+        dst->type_counts[i] += src->type_counts[i];
+    }
+    if (src->number_count > 0) {
+        if (dst->number_count == 0 || src->number_min < dst->number_min) dst->number_min = src->number_min;
+        if (dst->number_count == 0 || src->number_max > dst->number_max) dst->number_max = src->number_max;
+        dst->number_sum += src->number_sum;
+        dst->number_count += src->number_count;
+    }
+    if (src->string_count > 0) {
+        if (dst->string_count == 0 || src->length_min < dst->length_min) dst->length_min = src->length_min;
+        if (dst->string_count == 0 || src->length_max > dst->length_max) dst->length_max = src->length_max;
+        dst->length_sum += src->length_sum;
+        dst->string_count += src->string_count;
+        for (i = 0; i < JSINI_STATS_LENGTHS; i++) {
+            dst->lengths[i] += src->lengths[i];
+        }
+    }
+
+    if (src->registers) {
+        if (!dst->registers) {
+            stats_use_registers(dst);
+        }
+        for (i = 0; i < STATS_REGISTERS; i++) {
+            if (dst->registers[i] < src->registers[i]) dst->registers[i] = src->registers[i];
+        }
+    } else {
+        for (i = 0; i < src->sparse_count; i++) {
+            stats_distinct_add(dst, src->sparse[i]);
+        }
     }
+
+    stats_merge_top(dst, src);
 }
 
-static void jsini_collect_key_stats_from_array(jsini_array_t* arr, jsini_key_stats_map_t* stats,
-                                               const char* current_path) {
-    size_t size = jsini_array_size(arr);
-    for (size_t i = 0; i < size; i++) {
-        // Elements in an array share the same path context as the array itself
-        // (We treat the array as a transparent container for the objects' schema)
-        jsini_collect_key_stats_internal(jsini_aget(arr, i), stats, current_path);
+double jsini_value_stats_distinct(const jsini_value_stats_t* vs) {
+    double m = STATS_REGISTERS, sum = 0, estimate;
+    uint32_t zeros = 0;
+
+    if (!vs->registers) return vs->sparse_count;
+
+    for (uint32_t i = 0; i < STATS_REGISTERS; i++) {
+        sum += ldexp(1.0, -vs->registers[i]);
+        if (vs->registers[i] == 0) zeros++;
     }
+    estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    // Linear counting is more accurate while many registers are empty
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * log(m / zeros);
+    }
+    return estimate;
 }
 
-static void jsini_collect_key_stats_internal(jsini_value_t* value, jsini_key_stats_map_t* stats,
-                                             const char* current_path) {
+/*
+ * Paths are interned as nodes: node 0 is the root and every other node is a
+ * (parent node, key id) pair found through an open-addressing table, so a
+ * key costs one string probe and one integer probe. Dotted path strings are
+ * only built when the counts are flushed into a key stats map.
+ */
+#define STATS_ROOT 0
+
+typedef struct {
+    uint32_t parent;
+    uint32_t key;
+    size_t frequency;   // occurrences of the key in objects at the parent path
+    size_t objects;     // objects seen at this path
+    jsini_value_stats_t* values;
+} stats_node_t;
+
+// An object or array open in jsini_key_stats_collector_add_json()
+typedef struct {
+    uint32_t node;      // path of the container
+    uint32_t child;     // path of its next value: the last key, or the array itself
+} stats_frame_t;
+
+struct jsini_key_stats_collector {
+    uint32_t flags;
+    jsh_t* key_ids;     // key -> id + 1
+    jsa_t key_names;    // id -> key
+    stats_node_t* nodes;
+    uint32_t node_count;
+    uint32_t node_alloc;
+    uint64_t* edges;    // ((uint64_t)parent << 32 | key) + 1, 0 when free
+    uint32_t* edge_nodes;
+    uint32_t edge_mask;
+    stats_frame_t* frames;
+    uint32_t depth;
+    uint32_t frame_alloc;
+    jsb_t scratch;
+    jsb_t staged;       // events of the JSON value being read
+};
+
+static uint32_t stats_add_node(jsini_key_stats_collector_t* c, uint32_t parent, uint32_t key) {
+    if (c->node_count == c->node_alloc) {
+        c->node_alloc = c->node_alloc ? c->node_alloc * 2 : 64;
+        c->nodes = (stats_node_t*)xrealloc(c->nodes, c->node_alloc * sizeof(stats_node_t));
+    }
+    stats_node_t* node = &c->nodes[c->node_count];
+    node->parent = parent;
+    node->key = key;
+    node->frequency = 0;
+    node->objects = 0;
+    node->values = NULL;
+    return c->node_count++;
+}
+
+static uint32_t stats_edge_slot(const jsini_key_stats_collector_t* c, uint64_t edge) {
+    uint32_t i = (uint32_t)((edge * 0x9E3779B97F4A7C15ull) >> 32) & c->edge_mask;
+    while (c->edges[i] && c->edges[i] != edge) {
+        i = (i + 1) & c->edge_mask;
+    }
+    return i;
+}
+
+static void stats_grow_edges(jsini_key_stats_collector_t* c) {
+    uint64_t* edges = c->edges;
+    uint32_t* nodes = c->edge_nodes;
+    uint32_t size = c->edge_mask + 1;
+
+    c->edge_mask = size * 2 - 1;
+    c->edges = (uint64_t*)xcalloc(size * 2, sizeof(uint64_t));
+    c->edge_nodes = (uint32_t*)xmalloc(size * 2 * sizeof(uint32_t));
+    for (uint32_t i = 0; i < size; i++) {
+        if (edges[i]) {
+            uint32_t slot = stats_edge_slot(c, edges[i]);
+            c->edges[slot] = edges[i];
+            c->edge_nodes[slot] = nodes[i];
+        }
+    }
+    xfree(edges);
+    xfree(nodes);
+}
+
+static uint32_t stats_child(jsini_key_stats_collector_t* c, uint32_t parent, const char* name,
+                            size_t size) {
+    uint32_t key = (uint32_t)jsh_get_int(c->key_ids, name);
+    if (key == 0) {
+        char* copy = (char*)xmalloc(size + 1);
+        memcpy(copy, name, size + 1);
+        jsa_push(&c->key_names, copy);
+        key = c->key_names.size;
+        jsh_put_int(c->key_ids, copy, key);
+    }
+
+    uint64_t edge = ((uint64_t)parent << 32 | (key - 1)) + 1;
+    uint32_t slot = stats_edge_slot(c, edge);
+    if (!c->edges[slot]) {
+        // Keep the table at most half full
+        if (c->node_count >= (c->edge_mask + 1) / 2) {
+            stats_grow_edges(c);
+            slot = stats_edge_slot(c, edge);
+        }
+        c->edges[slot] = edge;
+        c->edge_nodes[slot] = stats_add_node(c, parent, key - 1);
+    }
+    return c->edge_nodes[slot];
+}
+
+static jsini_value_stats_t* stats_node_values(jsini_key_stats_collector_t* c, uint32_t node) {
+    if (!c->nodes[node].values) {
+        c->nodes[node].values = jsini_alloc_value_stats();
+    }
+    return c->nodes[node].values;
+}
+
+static void stats_collect(jsini_key_stats_collector_t* c, jsini_value_t* value, uint32_t node) {
     if (!value) return;
 
-    switch (value->type) {
-        case JSINI_TOBJECT:
-            jsini_collect_key_stats_from_object((jsini_object_t*)value, stats, current_path);
+    if (c->flags & JSINI_STATS_VALUES) {
+        stats_profile(stats_node_values(c, node), value);
+    }
+
+    if (value->type == JSINI_TOBJECT) {
+        jsini_object_t* obj = (jsini_object_t*)value;
+        c->nodes[node].objects++;
+        for (uint32_t i = 0; i < obj->keys.size; i++) {
+            jsini_attr_t* attr = (jsini_attr_t*)obj->keys.item[i];
+            uint32_t child = stats_child(c, node, attr->name->data.data, attr->name->data.size);
+            c->nodes[child].frequency++;
+            stats_collect(c, attr->value, child);
+        }
+    }
+    else if (value->type == JSINI_TARRAY) {
+        // Elements share the path of the array; packed arrays hold no objects
+        jsini_array_t* arr = (jsini_array_t*)value;
+        if (arr->packed) {
+            if (c->flags & JSINI_STATS_VALUES) {
+                stats_profile_packed(stats_node_values(c, node), arr);
+            }
+            return;
+        }
+        for (uint32_t i = 0; i < arr->data.size; i++) {
+            stats_collect(c, (jsini_value_t*)arr->data.item[i], node);
+        }
+    }
+}
+
+jsini_key_stats_collector_t* jsini_key_stats_collector_create() {
+    return jsini_key_stats_collector_create_ex(0);
+}
+
+jsini_key_stats_collector_t* jsini_key_stats_collector_create_ex(uint32_t flags) {
+    jsini_key_stats_collector_t* c =
+        (jsini_key_stats_collector_t*)xmalloc(sizeof(jsini_key_stats_collector_t));
+    c->flags = flags;
+    c->key_ids = jsh_create_simple(32, 0);
+    jsa_init(&c->key_names);
+    c->nodes = NULL;
+    c->node_count = 0;
+    c->node_alloc = 0;
+    c->edge_mask = 63;
+    c->edges = (uint64_t*)xcalloc(64, sizeof(uint64_t));
+    c->edge_nodes = (uint32_t*)xmalloc(64 * sizeof(uint32_t));
+    c->frames = NULL;
+    c->depth = 0;
+    c->frame_alloc = 0;
+    jsb_init(&c->scratch);
+    jsb_init(&c->staged);
+    stats_add_node(c, STATS_ROOT, 0);
+    return c;
+}
+
+void jsini_key_stats_collector_add(jsini_key_stats_collector_t* c, jsini_value_t* value) {
+    stats_collect(c, value, STATS_ROOT);
+}
+
+/*
+ * Lexer events walk the same nodes as stats_collect(): a frame is pushed
+ * for every open container, and a value belongs to the child path of the
+ * innermost one, or to the root at the top level.
+ */
+static uint32_t stats_event_node(const jsini_key_stats_collector_t* c) {
+    return c->depth > 0 ? c->frames[c->depth - 1].child : STATS_ROOT;
+}
+
+static void stats_event_push(jsini_key_stats_collector_t* c, uint32_t node) {
+    if (c->depth == c->frame_alloc) {
+        c->frame_alloc = c->frame_alloc ? c->frame_alloc * 2 : 16;
+        c->frames = (stats_frame_t*)xrealloc(c->frames, c->frame_alloc * sizeof(stats_frame_t));
+    }
+    c->frames[c->depth].node = node;
+    c->frames[c->depth].child = node;
+    c->depth++;
+}
+
+static void stats_event_type(jsini_key_stats_collector_t* c, uint32_t node, uint8_t type) {
+    if (c->flags & JSINI_STATS_VALUES) {
+        stats_node_values(c, node)->type_counts[type]++;
+    }
+}
+
+static int stats_begin_object(void* user_data) {
+    jsini_key_stats_collector_t* c = (jsini_key_stats_collector_t*)user_data;
+    uint32_t node = stats_event_node(c);
+    c->nodes[node].objects++;
+    stats_event_type(c, node, JSINI_TOBJECT);
+    stats_event_push(c, node);
+    return JSINI_OK;
+}
+
+static int stats_key(void* user_data, const char* name, size_t size) {
+    jsini_key_stats_collector_t* c = (jsini_key_stats_collector_t*)user_data;
+    stats_frame_t* frame = &c->frames[c->depth - 1];
+    frame->child = stats_child(c, frame->node, name, size);
+    c->nodes[frame->child].frequency++;
+    return JSINI_OK;
+}
+
+static int stats_begin_array(void* user_data) {
+    jsini_key_stats_collector_t* c = (jsini_key_stats_collector_t*)user_data;
+    uint32_t node = stats_event_node(c);
+    stats_event_type(c, node, JSINI_TARRAY);
+    stats_event_push(c, node);
+    return JSINI_OK;
+}
+
+static int stats_end(void* user_data) {
+    jsini_key_stats_collector_t* c = (jsini_key_stats_collector_t*)user_data;
+    c->depth--;
+    return JSINI_OK;
+}
+
+static int stats_scalar(void* user_data, const jsl_scalar_t* scalar) {
+    jsini_key_stats_collector_t* c = (jsini_key_stats_collector_t*)user_data;
+    if (c->flags & JSINI_STATS_VALUES) {
+        stats_scalar_t v;
+        v.type = scalar->type;
+        v.integer = 0;
+        if (scalar->type == JSINI_TNUMBER) {
+            v.number = scalar->data.number;
+        } else if (scalar->type != JSINI_TNULL) {
+            v.integer = scalar->data.integer;
+        }
+        stats_add_scalar(stats_node_values(c, stats_event_node(c)), &v);
+    }
+    return JSINI_OK;
+}
+
+static int stats_string(void* user_data, const char* data, size_t size) {
+    jsini_key_stats_collector_t* c = (jsini_key_stats_collector_t*)user_data;
+    if (c->flags & JSINI_STATS_VALUES) {
+        stats_scalar_t v;
+        v.type = JSINI_TSTRING;
+        v.data = data;
+        v.size = size;
+        stats_add_scalar(stats_node_values(c, stats_event_node(c)), &v);
+    }
+    return JSINI_OK;
+}
+
+/*
+ * The events of a value are staged and only replayed into the counts once
+ * the whole value has parsed, so a broken record leaves no trace. An event
+ * is a tag byte, followed for keys, scalars and strings by a size and that
+ * many bytes plus a NUL.
+ */
+static int stats_stage(jsini_key_stats_collector_t* c, char tag, const void* data, size_t size) {
+    jsb_t* sb = &c->staged;
+    size_t need = sb->size + 1 + sizeof(size) + size + 2;
+
+    // jsb only grows to fit, so double it for long records
+    if (need > sb->alloc_size &&
+        jsb_alloc(sb, need > 2 * sb->alloc_size ? need : 2 * sb->alloc_size) != JSB_OK) {
+        return JSINI_ERROR;
+    }
+    sb->data[sb->size++] = tag;
+    if (tag == 'k' || tag == 's' || tag == 't') {
+        memcpy(sb->data + sb->size, &size, sizeof(size));
+        memcpy(sb->data + sb->size + sizeof(size), data, size);
+        sb->size += sizeof(size) + size;
+        sb->data[sb->size++] = '\0';
+    }
+    sb->data[sb->size] = '\0';
+    return JSINI_OK;
+}
+
+static int stage_begin_object(void* user_data) {
+    return stats_stage((jsini_key_stats_collector_t*)user_data, 'o', NULL, 0);
+}
+
+static int stage_key(void* user_data, const char* name, size_t size) {
+    return stats_stage((jsini_key_stats_collector_t*)user_data, 'k', name, size);
+}
+
+static int stage_begin_array(void* user_data) {
+    return stats_stage((jsini_key_stats_collector_t*)user_data, 'a', NULL, 0);
+}
+
+static int stage_end(void* user_data) {
+    return stats_stage((jsini_key_stats_collector_t*)user_data, 'e', NULL, 0);
+}
+
+// Scalars only feed value profiles
+static int stage_scalar(void* user_data, const jsl_scalar_t* scalar) {
+    jsini_key_stats_collector_t* c = (jsini_key_stats_collector_t*)user_data;
+    if (c->flags & JSINI_STATS_VALUES) {
+        return stats_stage(c, 's', scalar, sizeof(*scalar));
+    }
+    return JSINI_OK;
+}
+
+static int stage_string(void* user_data, const char* data, size_t size) {
+    jsini_key_stats_collector_t* c = (jsini_key_stats_collector_t*)user_data;
+    if (c->flags & JSINI_STATS_VALUES) {
+        return stats_stage(c, 't', data, size);
+    }
+    return JSINI_OK;
+}
+
+static const jsl_handler_t stats_stage_handler = {
+    stage_begin_object, stage_key, stage_end,
+    stage_begin_array, stage_end,
+    stage_scalar, stage_string
+};
+
+static void stats_replay(jsini_key_stats_collector_t* c) {
+    const char* p = c->staged.data;
+    const char* end = p + c->staged.size;
+
+    c->depth = 0;
+    while (p < end) {
+        char tag = *p++;
+        const char* data = p;
+        size_t size = 0;
+
+        if (tag == 'k' || tag == 's' || tag == 't') {
+            memcpy(&size, p, sizeof(size));
+            data = p + sizeof(size);
+            p = data + size + 1;
+        }
+        switch (tag) {
+        case 'o':
+            stats_begin_object(c);
             break;
-        case JSINI_TARRAY:
-            jsini_collect_key_stats_from_array((jsini_array_t*)value, stats, current_path);
+        case 'k':
+            stats_key(c, data, size);
             break;
+        case 'a':
+            stats_begin_array(c);
+            break;
+        case 'e':
+            stats_end(c);
+            break;
+        case 's': {
+            jsl_scalar_t scalar;
+            memcpy(&scalar, data, sizeof(scalar));
+            stats_scalar(c, &scalar);
+            break;
+        }
         default:
+            stats_string(c, data, size);
             break;
+        }
+    }
+}
+
+int jsini_key_stats_collector_add_json(jsini_key_stats_collector_t* c, const char* s, size_t len) {
+    jsl_t lex;
+    int count = 0, res;
+
+    jsl_init(&lex, s, len, JSINI_COMMENT);
+    while (lex.input < lex.input_end) {
+        jsl_skip_space(&lex, NULL);
+        if (lex.input >= lex.input_end) break;
+
+        jsb_clear(&c->staged);
+        if ((res = jsl_read_events(&lex, &stats_stage_handler, &c->scratch, c)) != JSINI_OK) {
+            // A staging failure is out of memory, not a syntax error
+            if (lex.error != JSINI_OK) {
+                jsini_write_error(&lex, stderr);
+            }
+            return res;
+        }
+        stats_replay(c);
+        count++;
     }
+    return count;
+}
+
+void jsini_key_stats_collector_flush(jsini_key_stats_collector_t* c, jsini_key_stats_map_t* stats) {
+    // Only nodes that held objects or values become map entries, and nodes
+    // come after their parents, so one pass builds their paths and a second
+    // adds keys
+    jsini_key_stats_t** entries =
+        (jsini_key_stats_t**)xmalloc(c->node_count * sizeof(jsini_key_stats_t*));
+    size_t* offsets = (size_t*)xmalloc(c->node_count * sizeof(size_t));
+    jsb_t paths, path;
+
+    jsb_init(&paths);
+    jsb_init(&path);
+    for (uint32_t i = 0; i < c->node_count; i++) {
+        const stats_node_t* node = &c->nodes[i];
+        entries[i] = NULL;
+        if (node->objects == 0 && !node->values) continue;
+
+        offsets[i] = paths.size;
+        if (i == STATS_ROOT) {
+            jsb_append(&paths, "root", 5);
+        } else {
+            jsb_clear(&path);
+            jsb_printf(&path, "%s.%s", paths.data + offsets[node->parent],
+                       (const char*)c->key_names.item[node->key]);
+            jsb_append(&paths, path.data, path.size + 1);
+        }
+
+        jsini_key_stats_t* entry = get_or_create_stats(stats, paths.data + offsets[i]);
+        entry->object_count += node->objects;
+        if (node->objects > 0 && !entry->key_frequencies) {
+            entry->key_frequencies = jsh_create_simple(32, 0);
+        }
+        if (node->values) {
+            if (!entry->values) {
+                entry->values = jsini_alloc_value_stats();
+            }
+            jsini_merge_value_stats(entry->values, node->values);
+        }
+        entries[i] = entry;
+    }
+    jsb_clean(&path);
+
+    for (uint32_t i = 1; i < c->node_count; i++) {
+        const stats_node_t* node = &c->nodes[i];
+        if (node->frequency > 0) {
+            add_key_frequency(entries[node->parent],
+                              (const char*)c->key_names.item[node->key], (int)node->frequency);
+        }
+    }
+
+    jsb_clean(&paths);
+    xfree(offsets);
+    xfree(entries);
+}
+
+static void free_key(void* key, void* value) {
+    free(key);
+}
+
+void jsini_key_stats_collector_free(jsini_key_stats_collector_t* c) {
+    for (uint32_t i = 0; i < c->node_count; i++) {
+        if (c->nodes[i].values) {
+            jsini_free_value_stats(c->nodes[i].values);
+        }
+    }
+    jsh_free_ex(c->key_ids, free_key);
+    jsa_clean(&c->key_names);
+    jsb_clean(&c->scratch);
+    jsb_clean(&c->staged);
+    xfree(c->frames);
+    xfree(c->nodes);
+    xfree(c->edges);
+    xfree(c->edge_nodes);
+    xfree(c);
 }
 
 void jsini_collect_key_stats(jsini_value_t* value, jsini_key_stats_map_t* stats) {
-    jsini_collect_key_stats_internal(value, stats, "root");
+    jsini_key_stats_collector_t* c = jsini_key_stats_collector_create();
+    jsini_key_stats_collector_add(c, value);
+    jsini_key_stats_collector_flush(c, stats);
+    jsini_key_stats_collector_free(c);
+}
+
+void jsini_merge_key_stats(jsini_key_stats_map_t* dst, jsini_key_stats_map_t* src) {
+    const jsh_iterator_t* it;
+    for (it = jsh_first(src); it; it = jsh_next(src, it)) {
+        jsini_key_stats_t* from = (jsini_key_stats_t*)it->value;
+        jsini_key_stats_t* to = get_or_create_stats(dst, (const char*)it->key);
+        to->object_count += from->object_count;
+        if (from->values) {
+            if (!to->values) {
+                to->values = jsini_alloc_value_stats();
+            }
+            jsini_merge_value_stats(to->values, from->values);
+        }
+
+        if (!from->key_frequencies) continue;
+        if (!to->key_frequencies) {
+            to->key_frequencies = jsh_create_simple(32, 0);
+        }
+
+        const jsh_iterator_t* kt;
+        for (kt = jsh_first(from->key_frequencies); kt; kt = jsh_next(from->key_frequencies, kt)) {
+            const char* key = (const char*)kt->key;
+            add_key_frequency(to, key, jsh_get_int(from->key_frequencies, key));
+        }
+    }
 }
 
 jsini_key_stats_t* jsini_alloc_key_stats() {
     jsini_key_stats_t* stats = (jsini_key_stats_t*)xmalloc(sizeof(jsini_key_stats_t));
     stats->object_count = 0;
     stats->key_frequencies = NULL;
+    stats->values = NULL;
     return stats;
 }
 
@@ -92,15 +888,14 @@ static void free_stats_entry(void* key, void* value) {
     jsini_free_key_stats((jsini_key_stats_t*)value);
 }
 
-static void free_key(void* key, void* value) {
-    free(key);
-}
-
 void jsini_free_key_stats(jsini_key_stats_t* stats) {
     jsh_t* ht = stats->key_frequencies;
     if (ht) {
         jsh_free_ex(ht, free_key);
     }
+    if (stats->values) {
+        jsini_free_value_stats(stats->values);
+    }
     xfree(stats);
 }
 
@@ -125,8 +920,91 @@ static int compare_strings(const void* a, const void* b) {
     return strcmp(s1, s2);
 }
 
+static void print_value_stats(FILE* out, const jsini_value_stats_t* vs, const char* prefix) {
+    static const char* type_names[] = {
+        "null", "bool", "integer", "number", "string", "array", "object"
+    };
+    jsini_top_value_t top[JSINI_STATS_TOP_K];
+    const char* sep = "";
+    size_t floor;
+    uint32_t i, n;
+
+    fprintf(out, "%s  types:", prefix);
+    for (i = 0; i <= JSINI_TOBJECT; i++) {
+        if (vs->type_counts[i] > 0) {
+            fprintf(out, "%s %s %zu", sep, type_names[i], vs->type_counts[i]);
+            sep = ",";
+        }
+    }
+    fprintf(out, "\n");
+
+    if (vs->number_count > 0) {
+        fprintf(out, "%s  numbers: min %g, max %g, mean %g\n", prefix, vs->number_min,
+                vs->number_max, vs->number_sum / vs->number_count);
+    }
+
+    if (vs->string_count > 0) {
+        fprintf(out, "%s  lengths: min %zu, max %zu, mean %.1f,", prefix, vs->length_min,
+                vs->length_max, (double)vs->length_sum / vs->string_count);
+        for (i = 0; i < JSINI_STATS_LENGTHS; i++) {
+            size_t low = i ? (size_t)1 << (i - 1) : 0;
+            size_t high = i ? ((size_t)1 << i) - 1 : 0;
+            if (vs->lengths[i] == 0) continue;
+            if (i == JSINI_STATS_LENGTHS - 1) {
+                fprintf(out, " %zu+:%zu", low, vs->lengths[i]);
+            } else if (low == high) {
+                fprintf(out, " %zu:%zu", low, vs->lengths[i]);
+            } else {
+                fprintf(out, " %zu-%zu:%zu", low, high, vs->lengths[i]);
+            }
+        }
+        fprintf(out, "\n");
+    }
+
+    if (vs->registers) {
+        fprintf(out, "%s  distinct: ~%.0f\n", prefix, jsini_value_stats_distinct(vs));
+    } else if (vs->sparse_count > 0) {
+        fprintf(out, "%s  distinct: %u\n", prefix, vs->sparse_count);
+    }
+
+    // Only values known to repeat and to be more frequent than any value
+    // without a counter; the rest would be noise on high cardinality paths
+    floor = stats_top_floor(vs);
+    memcpy(top, vs->top, vs->top_count * sizeof(top[0]));
+    qsort(top, vs->top_count, sizeof(top[0]), compare_top_values);
+    for (i = n = 0; i < vs->top_count; i++) {
+        size_t lower = top[i].count - top[i].error;
+        if (lower < 2 || lower <= floor) continue;
+        if (n++ == 0) {
+            fprintf(out, "%s  top:", prefix);
+        } else {
+            fprintf(out, ",");
+        }
+        if (top[i].error > 0) {
+            fprintf(out, " %s %zu-%zu", top[i].text, top[i].count - top[i].error, top[i].count);
+        } else {
+            fprintf(out, " %s %zu", top[i].text, top[i].count);
+        }
+    }
+    if (n > 0) {
+        fprintf(out, "\n");
+    }
+}
+
+// 95% Wilson score interval of a ratio observed in n trials
+static void wilson_interval(double ratio, size_t n, double* low, double* high) {
+    const double z = 1.96;
+    double p = ratio > 1.0 ? 1.0 : ratio;
+    double d = 1.0 + z * z / n;
+    double center = (p + z * z / (2.0 * n)) / d;
+    double half = z * sqrt(p * (1.0 - p) / n + z * z / (4.0 * n * n)) / d;
+    *low = center - half < 0.0 ? 0.0 : center - half;
+    *high = center + half > 1.0 ? 1.0 : center + half;
+}
+
 static void print_stats_tree(FILE* out, jsini_key_stats_map_t* stats, const char* current_path,
-                             char* prefix, int current_level, int max_level, double min_ratio) {
+                             char* prefix, int current_level, int max_level, double min_ratio,
+                             uint32_t options) {
     jsini_key_stats_t* entry = (jsini_key_stats_t*)jsh_get(stats, current_path);
     if (!entry || !entry->key_frequencies) return;
 
@@ -162,17 +1040,29 @@ static void print_stats_tree(FILE* out, jsini_key_stats_map_t* stats, const char
         fprintf(out, "%s%s── %s", prefix, is_last ? "└" : "├", fe->key);
 
         double percentage = ratio * 100.0;
-        fprintf(out, " (freq %d, %.1f%%)\n", fe->frequency, percentage);
+        if (options & JSINI_STATS_SAMPLED) {
+            double low, high;
+            wilson_interval(ratio, entry->object_count, &low, &high);
+            fprintf(out, " (freq %d, %.1f%%, 95%% CI %.1f-%.1f%%)\n", fe->frequency, percentage,
+                    low * 100.0, high * 100.0);
+        } else {
+            fprintf(out, " (freq %d, %.1f%%)\n", fe->frequency, percentage);
+        }
 
         // Build child path to look up in the global stats map
         size_t child_path_len = strlen(current_path) + strlen(fe->key) + 2;
         char* child_path = (char*)xmalloc(child_path_len);
         sprintf(child_path, "%s.%s", current_path, fe->key);
 
-        if (jsh_exists(stats, child_path)) {
-            char* new_prefix = (char*)xmalloc(prefix_len + 5);
+        jsini_key_stats_t* child = (jsini_key_stats_t*)jsh_get(stats, child_path);
+        if (child) {
+            char* new_prefix = (char*)xmalloc(prefix_len + sizeof("│   "));
             sprintf(new_prefix, "%s%s   ", prefix, is_last ? " " : "│");
-            print_stats_tree(out, stats, child_path, new_prefix, current_level + 1, max_level, min_ratio);
+            if (child->values) {
+                print_value_stats(out, child->values, new_prefix);
+            }
+            print_stats_tree(out, stats, child_path, new_prefix, current_level + 1, max_level,
+                             min_ratio, options);
             xfree(new_prefix);
         }
 
@@ -184,14 +1074,23 @@ static void print_stats_tree(FILE* out, jsini_key_stats_map_t* stats, const char
 }
 
 void jsini_print_key_stats(FILE* out, jsini_key_stats_map_t* stats, int max_level, double min_ratio) {
+    jsini_print_key_stats_ex(out, stats, max_level, min_ratio, 0);
+}
+
+void jsini_print_key_stats_ex(FILE* out, jsini_key_stats_map_t* stats, int max_level,
+                              double min_ratio, uint32_t options) {
     if (!stats) return;
 
     jsini_key_stats_t* root_entry = (jsini_key_stats_t*)jsh_get(stats, "root");
     if (!root_entry) return;
 
-    fprintf(out, ". (root, %zu objects)\n", root_entry->object_count);
+    fprintf(out, ". (root, %zu objects%s)\n", root_entry->object_count,
+            (options & JSINI_STATS_SAMPLED) ? " sampled" : "");
+    if (root_entry->values) {
+        print_value_stats(out, root_entry->values, "");
+    }
     char prefix[1] = "";
-    print_stats_tree(out, stats, "root", prefix, 0, max_level, min_ratio);
+    print_stats_tree(out, stats, "root", prefix, 0, max_level, min_ratio, options);
 }
 
 void jsini_free_key_stats_map(jsini_key_stats_map_t* stats) {
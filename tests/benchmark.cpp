@@ -1,53 +1,461 @@
-#include <iostream>
+/*
+ * Benchmarks of the public entry points over generated corpora.
+ *
+ *   jsini_bench [--scale N] [filter]
+ *
+ * The corpora come from a fixed seed, so runs are comparable across
+ * builds. Each benchmark is warmed up, then run until it has both enough
+ * samples and enough time; the median and p99 of the samples are printed
+ * with the throughput at the median.
+ */
+
+#include <algorithm>
 #include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <vector>
+
 #include "jsini.hpp"
 
-extern "C" {
-    #include "jsini.h"
+#define WARMUP_RUNS 3
+#define MIN_RUNS 10
+#define MAX_RUNS 1000
+#define MIN_SECONDS 0.5
+
+#ifdef _WIN32
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+typedef std::chrono::steady_clock Clock;
+
+static const char *filter = nullptr;
+
+template <class Run, class Teardown>
+static void bench(const char *name, size_t bytes, Run run, Teardown teardown) {
+    std::vector<double> times;
+    double total = 0;
+
+    if (filter && !strstr(name, filter)) return;
+
+    for (int i = 0; i < WARMUP_RUNS; i++) {
+        run();
+        teardown();
+    }
+    while (times.size() < MIN_RUNS || (total < MIN_SECONDS && times.size() < MAX_RUNS)) {
+        Clock::time_point start = Clock::now();
+        run();
+        std::chrono::duration<double> elapsed = Clock::now() - start;
+        teardown();
+        times.push_back(elapsed.count());
+        total += elapsed.count();
+    }
+
+    std::sort(times.begin(), times.end());
+    size_t n = times.size();
+    double median = n % 2 ? times[n / 2] : (times[n / 2 - 1] + times[n / 2]) / 2;
+    double p99 = times[std::min(n - 1, (size_t)std::ceil(n * 0.99) - 1)];
+
+    printf("%-28s %6zu %12.3f %12.3f", name, n, median * 1e3, p99 * 1e3);
+    if (bytes > 0 && median > 0) {
+        printf(" %10.1f", bytes / 1e6 / median);
+    }
+    printf("\n");
+}
+
+template <class Run>
+static void bench(const char *name, size_t bytes, Run run) {
+    bench(name, bytes, run, [] {});
 }
 
-int main() {
-    const int N = 100000;
-    std::string json = "[";
-    for (int i = 0; i < N; ++i) {
-        json += std::to_string(i);
-        if (i < N - 1) json += ",";
+// Deterministic inputs of every shape the library reads
+class Corpus {
+public:
+    explicit Corpus(size_t scale) : scale_(scale) {}
+
+    // Integers and doubles in one flat array
+    std::string numbers() {
+        std::string s = "[";
+        char buf[32];
+        for (size_t i = 0; i < 200000 * scale_; i++) {
+            if (i > 0) s += ',';
+            if (i % 2) {
+                snprintf(buf, sizeof(buf), "%d", (int)(next() % 2000001) - 1000000);
+            } else {
+                snprintf(buf, sizeof(buf), "%.6g", (double)(next() % 1000000) / 997);
+            }
+            s += buf;
+        }
+        return s + "]";
+    }
+
+    // An array of log records dominated by free text
+    std::string logs() {
+        static const char *levels[] = { "debug", "info", "warn", "error" };
+        std::string s = "[";
+        char buf[160];
+        for (size_t i = 0; i < 10000 * scale_; i++) {
+            snprintf(buf, sizeof(buf),
+                     "%s\n{\"ts\": %zu, \"level\": \"%s\", \"host\": \"web-%02u\", "
+                     "\"path\": \"/api/v1/items/%u\", \"status\": %u, \"latency_ms\": %.3f, \"msg\": \"",
+                     i > 0 ? "," : "", 1700000000 + i, levels[next() % 4],
+                     (unsigned)(next() % 32), (unsigned)(next() % 100000),
+                     next() % 10 ? 200u : 500u, (double)(next() % 100000) / 1000);
+            s += buf;
+            s += sentence(8 + next() % 24);
+            s += "\"}";
+        }
+        return s + "\n]";
+    }
+
+    // One record per line, all of the same shape
+    std::string jsonl() {
+        static const char *events[] = { "view", "click", "purchase", "signup" };
+        std::string s;
+        char buf[256];
+        for (size_t i = 0; i < 20000 * scale_; i++) {
+            snprintf(buf, sizeof(buf),
+                     "{\"id\": %zu, \"user\": {\"name\": \"user%u\", \"tags\": [\"t%u\", \"t%u\"]}, "
+                     "\"event\": \"%s\", \"props\": {\"x\": %u, \"y\": %.2f, \"ok\": %s}}\n",
+                     i, (unsigned)(next() % 5000), (unsigned)(next() % 10), (unsigned)(next() % 10),
+                     events[next() % 4], (unsigned)(next() % 1000), (double)(next() % 10000) / 100,
+                     next() % 2 ? "true" : "false");
+            s += buf;
+        }
+        return s;
+    }
+
+    // Objects nested `depth` deep with `fanout` members each
+    std::string config(int depth, int fanout) {
+        std::string s;
+        nest(s, depth, fanout);
+        return s;
+    }
+
+    // A wide table with numbers, words and quoted fields
+    std::string csv(size_t columns) {
+        std::string s;
+        char buf[32];
+        for (size_t c = 0; c < columns; c++) {
+            snprintf(buf, sizeof(buf), "%sc%zu", c > 0 ? "," : "", c);
+            s += buf;
+        }
+        s += '\n';
+        for (size_t r = 0; r < 2000 * scale_; r++) {
+            for (size_t c = 0; c < columns; c++) {
+                if (c > 0) s += ',';
+                switch (c % 3) {
+                case 0:
+                    snprintf(buf, sizeof(buf), "%u", (unsigned)(next() % 100000));
+                    s += buf;
+                    break;
+                case 1:
+                    s += word();
+                    break;
+                default:
+                    s += "\"" + word() + ", \"\"" + word() + "\"\"\"";
+                    break;
+                }
+            }
+            s += '\n';
+        }
+        return s;
+    }
+
+    // Strings mixing multi-byte UTF-8 with \u escapes
+    std::string unicode() {
+        static const char *pieces[] = {
+            "h\xc3\xa9llo w\xc3\xb6rld", "\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e",
+            "\xd0\xbf\xd1\x80\xd0\xb8\xd0\xb2\xd0\xb5\xd1\x82", "\xf0\x9f\x98\x80",
+            "\\u00e9\\u4e2d\\u6587", "plain ascii",
+        };
+        std::string s = "[";
+        for (size_t i = 0; i < 20000 * scale_; i++) {
+            s += i > 0 ? ",\"" : "\"";
+            for (int k = 0; k < 4; k++) {
+                s += pieces[next() % 6];
+                s += ' ';
+            }
+            s += '"';
+        }
+        return s + "]";
+    }
+
+    std::string ini() {
+        std::string s;
+        char buf[96];
+        for (size_t i = 0; i < 500 * scale_; i++) {
+            snprintf(buf, sizeof(buf), "[section%zu]\n", i);
+            s += buf;
+            for (int k = 0; k < 20; k++) {
+                snprintf(buf, sizeof(buf), "key%d = %s\n", k, word().c_str());
+                s += buf;
+            }
+        }
+        return s;
+    }
+
+    std::string word() {
+        static const char *words[] = {
+            "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf", "hotel",
+            "india", "juliet", "kilo", "lima", "mike", "november", "oscar", "papa",
+        };
+        return words[next() % 16];
+    }
+
+private:
+    uint64_t next() {
+        state_ ^= state_ << 13;
+        state_ ^= state_ >> 7;
+        state_ ^= state_ << 17;
+        return state_;
+    }
+
+    std::string sentence(size_t words) {
+        std::string s;
+        for (size_t i = 0; i < words; i++) {
+            if (i > 0) s += ' ';
+            s += word();
+            if (next() % 16 == 0) s += next() % 2 ? "\\\"" : "\\n";
+        }
+        return s;
+    }
+
+    void nest(std::string &s, int depth, int fanout) {
+        char buf[32];
+        s += '{';
+        for (int i = 0; i < fanout; i++) {
+            snprintf(buf, sizeof(buf), "%s\"k%d\": ", i > 0 ? ", " : "", i);
+            s += buf;
+            if (depth > 1) {
+                nest(s, depth - 1, fanout);
+            } else {
+                snprintf(buf, sizeof(buf), "%u", (unsigned)(next() % 1000));
+                s += buf;
+            }
+        }
+        s += '}';
+    }
+
+    size_t scale_;
+    uint64_t state_ = 0x9E3779B97F4A7C15ull;
+};
+
+static int free_callback(jsini_value_t *value, void *user_data) {
+    if (value) {
+        (*(size_t *)user_data)++;
+        jsini_free(value);
     }
-    json += "]";
+    return JSINI_OK;
+}
+
+static int count_fields(const jsini_csv_field_t *, uint32_t count, void *user_data) {
+    *(size_t *)user_data += count;
+    return JSINI_OK;
+}
+
+static void bench_parse(Corpus &corpus) {
+    std::string numbers = corpus.numbers();
+    std::string logs = corpus.logs();
+    std::string config = corpus.config(10, 3);
+    std::string unicode = corpus.unicode();
+    std::string jsonl = corpus.jsonl();
+    std::string csv = corpus.csv(24);
+    std::string ini = corpus.ini();
+    jsini_value_t *value = nullptr;
+    size_t count = 0;
+
+    auto release = [&] { jsini_free(value); };
+
+    bench("parse/numbers", numbers.size(), [&] {
+        value = jsini_parse_string(numbers.data(), numbers.size());
+    }, release);
+    bench("parse/numbers_packed", numbers.size(), [&] {
+        value = jsini_parse_string_ex(numbers.data(), numbers.size(), JSINI_PACK_ARRAYS);
+    }, release);
+    bench("parse/logs", logs.size(), [&] {
+        value = jsini_parse_string(logs.data(), logs.size());
+    }, release);
+    bench("parse/config", config.size(), [&] {
+        value = jsini_parse_string(config.data(), config.size());
+    }, release);
+    bench("parse/unicode", unicode.size(), [&] {
+        value = jsini_parse_string(unicode.data(), unicode.size());
+    }, release);
+    bench("parse/jsonl", jsonl.size(), [&] {
+        value = jsini_parse_string_jsonl(jsonl.data(), jsonl.size());
+    }, release);
+    bench("parse/jsonl_stream", jsonl.size(), [&] {
+        jsini_parse_string_jsonl_ex(jsonl.data(), jsonl.size(), free_callback, &count);
+    });
+    bench("parse/csv", csv.size(), [&] {
+        value = jsini_parse_string_csv(csv.data(), csv.size());
+    }, release);
+    bench("parse/csv_scan", csv.size(), [&] {
+        jsini_scan_csv(csv.data(), csv.size(), JSINI_CSV_DOUBLE_QUOTE, count_fields, &count);
+    });
+    bench("parse/ini", ini.size(), [&] {
+        value = jsini_parse_string_ini(ini.data(), ini.size());
+    }, release);
 
-    std::cout << "JSON size: " << json.size() << " bytes, Elements: " << N << "\n";
+#ifdef JSINI_TAGGED_VALUES
+    jsini_tval_t tval = JSINI_TVAL_UNDEFINED;
+    bench("parse/logs_tagged", logs.size(), [&] {
+        tval = jsini_tval_parse_string(logs.data(), logs.size(), JSINI_COMMENT);
+    }, [&] { jsini_tval_free(tval); });
+#endif
+}
+
+static void bench_stringify(Corpus &corpus) {
+    std::string logs = corpus.logs();
+    std::string config = corpus.config(10, 3);
+    std::string unicode = corpus.unicode();
+    jsini_value_t *parsed_logs = jsini_parse_string(logs.data(), logs.size());
+    jsini_value_t *parsed_config = jsini_parse_string(config.data(), config.size());
+    jsini_value_t *parsed_unicode = jsini_parse_string(unicode.data(), unicode.size());
+    jsb_t sb;
+
+    jsb_init(&sb);
+    auto release = [&] { jsb_clean(&sb); jsb_init(&sb); };
+
+    bench("stringify/logs", logs.size(), [&] {
+        jsini_stringify(parsed_logs, &sb, 0, 2);
+    }, release);
+    bench("stringify/logs_pretty", logs.size(), [&] {
+        jsini_stringify(parsed_logs, &sb, JSINI_PRETTY_PRINT, 2);
+    }, release);
+    bench("stringify/logs_sorted", logs.size(), [&] {
+        jsini_stringify(parsed_logs, &sb, JSINI_SORT_KEYS, 2);
+    }, release);
+    bench("stringify/config_pretty", config.size(), [&] {
+        jsini_stringify(parsed_config, &sb, JSINI_PRETTY_PRINT, 2);
+    }, release);
+    bench("stringify/unicode_escaped", unicode.size(), [&] {
+        jsini_stringify(parsed_unicode, &sb, JSINI_ESCAPE_UNICODE, 2);
+    }, release);
+
+    jsini_free(parsed_logs);
+    jsini_free(parsed_config);
+    jsini_free(parsed_unicode);
+}
 
-    // Benchmark C++ Wrapper
-    {
-        auto start = std::chrono::high_resolution_clock::now();
-        jsini::Value root(json);
-        long long sum = 0;
-        for (int i = 0; i < N; ++i) {
-            // internal implicit cast to int
-            sum += (int)root[i]; 
+static void bench_select(Corpus &corpus) {
+    std::string config = corpus.config(10, 3);
+    std::string jsonl = corpus.jsonl();
+    jsini_value_t *parsed = jsini_parse_string(config.data(), config.size());
+    size_t count = 0;
+
+    bench("select/config_x1000", 0, [&] {
+        for (int i = 0; i < 1000; i++) {
+            count += jsini_select((jsini_object_t *)parsed, "k2.k1.k0.k2.k1.k0.k2.k1.k0.k2") != NULL;
         }
-        auto end = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> diff = end - start;
-        std::cout << "C++ Wrapper Time: " << diff.count() << " s (Sum: " << sum << ")\n";
+    });
+    bench("select/jsonl_stream", jsonl.size(), [&] {
+        jsini_select_string_jsonl(jsonl.data(), jsonl.size(), "props.y", free_callback, &count);
+    });
+
+    jsini_free(parsed);
+}
+
+static void bench_hash(Corpus &corpus) {
+    std::vector<std::string> keys;
+    char buf[32];
+    jsh_t *map = nullptr;
+    size_t found = 0;
+
+    for (int i = 0; i < 100000; i++) {
+        snprintf(buf, sizeof(buf), "%s-%d", corpus.word().c_str(), i);
+        keys.push_back(buf);
     }
+    auto fill = [&] {
+        map = jsh_create_simple(0, 0);
+        for (size_t i = 0; i < keys.size(); i++) {
+            jsh_put(map, keys[i].c_str(), (void *)(uintptr_t)(i + 1));
+        }
+    };
+
+    bench("jsh/put", 0, fill, [&] { jsh_destroy(map); });
+
+    fill();
+    bench("jsh/get", 0, [&] {
+        for (size_t i = 0; i < keys.size(); i++) {
+            found += jsh_get(map, keys[i].c_str()) != NULL;
+        }
+    });
+    bench("jsh/exists_miss", 0, [&] {
+        for (size_t i = 0; i < keys.size(); i++) {
+            found += jsh_exists(map, keys[i].c_str() + 1);
+        }
+    });
+    bench("jsh/iterate", 0, [&] {
+        for (const jsh_iterator_t *it = jsh_first(map); it; it = jsh_next(map, it)) {
+            found++;
+        }
+    });
+    jsh_destroy(map);
 
-    // Benchmark Pure C
-    {
-        auto start = std::chrono::high_resolution_clock::now();
-        jsini_value_t* root = jsini_parse_string(json.c_str(), json.length());
-        jsini_array_t* arr = (jsini_array_t*)root;
-        long long sum = 0;
-        for (int i = 0; i < N; ++i) {
-             jsini_value_t* val = jsini_aget(arr, i);
-             sum += ((jsini_integer_t*)val)->data;
+    bench("jsh/remove", 0, fill, [&] {
+        for (size_t i = 0; i < keys.size(); i++) {
+            jsh_remove(map, keys[i].c_str());
+        }
+        jsh_destroy(map);
+    });
+}
+
+static void bench_csv_write(Corpus &corpus) {
+    std::string csv = corpus.csv(24);
+    jsini_value_t *parsed = jsini_parse_string_csv(csv.data(), csv.size());
+
+    bench("csv/write", csv.size(), [&] {
+        jsini_print_file_csv(NULL_DEVICE, parsed, ',');
+    });
+
+    jsini_free(parsed);
+}
+
+static void bench_wrapper(Corpus &corpus) {
+    std::string numbers = corpus.numbers();
+    std::string logs = corpus.logs();
+    jsini::Value array(numbers);
+    jsini::Value records(logs);
+    double sum = 0;
+
+    bench("cpp/array_index", 0, [&] {
+        for (size_t i = 0; i < array.size(); i++) {
+            sum += (double)array[i];
+        }
+    });
+    bench("cpp/object_access", 0, [&] {
+        for (size_t i = 0; i < records.size(); i++) {
+            sum += (int)records[i]["status"];
+        }
+    });
+}
+
+int main(int argc, char **argv) {
+    size_t scale = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--scale") == 0 && i + 1 < argc) {
+            scale = std::max(1, atoi(argv[++i]));
+        } else {
+            filter = argv[i];
         }
-        jsini_free(root);
-        auto end = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double> diff = end - start;
-        std::cout << "Pure C Time:      " << diff.count() << " s (Sum: " << sum << ")\n";
     }
 
+    printf("%-28s %6s %12s %12s %10s\n", "benchmark", "runs", "median ms", "p99 ms", "MB/s");
+
+    Corpus corpus(scale);
+    bench_parse(corpus);
+    bench_stringify(corpus);
+    bench_select(corpus);
+    bench_hash(corpus);
+    bench_csv_write(corpus);
+    bench_wrapper(corpus);
+
     return 0;
 }
@@ -96,14 +96,89 @@ static void test_hash_comment() {
     })json";
     jsini::Value value(text);
     assert(value.is_object());
+#ifndef JSINI_OMIT_LINENO
     assert(value.lineno() == 1);
     assert(value["address"].lineno() == 3);
     assert(value["tags"].lineno() == 11);
     assert(value["tags"][1].lineno() == 14);
+#endif
     assert(value["tags"].size() == 2);
 }
 
+static int collect_selected(jsini_value_t *value, void *user_data) {
+    std::string *out = (std::string *)user_data;
+    jsb_t sb;
+    jsb_init(&sb);
+    if (value) {
+        jsini_stringify(value, &sb, 0, 0);
+        jsini_free(value);
+    }
+    *out += value ? sb.data : "-";
+    *out += "\n";
+    jsb_clean(&sb);
+    return JSINI_OK;
+}
+
+static void test_find_path() {
+    jsl_t lex;
+    jsb_t scratch;
+    jsb_init(&scratch);
+
+    {
+        const char *code = R"json({z: [1, {a: 2}, (3)], 'q': "}", # a: 0
+          "a" => {b: `x`, c: {d: [true]}}})json";
+        jsl_init(&lex, code, strlen(code), JSINI_COMMENT);
+        assert(jsl_find_path(&lex, "a.c/d", &scratch) == 1);
+        auto val = jsini_read_json(&lex);
+        assert(val->type == JSINI_TARRAY);
+        jsini_free(val);
+
+        jsl_init(&lex, code, strlen(code), JSINI_COMMENT);
+        assert(jsl_find_path(&lex, "a.x", &scratch) == 0);
+        jsl_init(&lex, code, strlen(code), JSINI_COMMENT);
+        assert(jsl_find_path(&lex, "z.a", &scratch) == 0);
+        jsl_init(&lex, code, strlen(code), JSINI_COMMENT);
+        assert(jsl_skip_value(&lex, &scratch) == JSINI_OK);
+        assert(lex.input == lex.input_end);
+    }
+
+    {
+        const char *code = "{a: 1, b: [1, {c: 2}";
+        jsl_init(&lex, code, strlen(code), JSINI_COMMENT);
+        assert(jsl_find_path(&lex, "c", &scratch) == JSINI_ERROR_NOT_CLOSED);
+        // The rest of the object is read as the parser would
+        jsl_init(&lex, code, strlen(code), JSINI_COMMENT);
+        assert(jsl_find_path(&lex, "a", &scratch) == JSINI_ERROR_NOT_CLOSED);
+    }
+
+    {
+        // A repeated key resolves to its last value, as in jsini_select()
+        const char *code = "{\"a\": {\"b\": 1}, \"c\": 0, \"a\": {\"b\": 2}, \"d\": 3}";
+        jsl_init(&lex, code, strlen(code), JSINI_COMMENT);
+        assert(jsl_find_path(&lex, "a.b", &scratch) == 1);
+        auto val = jsini_read_json(&lex);
+        assert(val->type == JSINI_TINTEGER && ((jsini_integer_t *)val)->data == 2);
+        jsini_free(val);
+
+        auto root = jsini_parse_string(code, strlen(code));
+        val = jsini_select((jsini_object_t *)root, "a.b");
+        assert(val->type == JSINI_TINTEGER && ((jsini_integer_t *)val)->data == 2);
+        jsini_free(root);
+    }
+
+    {
+        const char *text = "{\"a\": {\"b\": [1]}}\n\n{\"a\": 1}\n{\"b\": 2, \"a\": {\"b\": \"x\"}}";
+        std::string out;
+        assert(jsini_select_string_jsonl(text, strlen(text), "a.b", collect_selected, &out)
+                == JSINI_OK);
+        assert(out == "[1]\n-\n\"x\"\n");
+    }
+
+    jsb_clean(&scratch);
+}
+
 void test_jsl() {
   test_hash_comment();
+  test_find_path();
   test_read_env_vars();
 }
\ No newline at end of file
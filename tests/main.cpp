@@ -1,5 +1,6 @@
 #include <assert.h>
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 
@@ -211,6 +212,53 @@ void test_iterating() {
         jsini::Value& value = array[i];
         assert(value == (int)i + 2);
     }
+
+    // Array elements via range-for and <algorithm>
+    {
+        int64_t sum = 0;
+        for (jsini_value_t& item : array.elements()) {
+            assert(item.type == JSINI_TINTEGER);
+            sum += ((jsini_integer_t*)&item)->data;
+        }
+        assert(sum == 2 + 3 + 4);
+
+        auto items = array.elements();
+        assert(items.size() == 3);
+        assert(items.end() - items.begin() == 3);
+        assert(((jsini_integer_t*)&items.begin()[2])->data == 4);
+
+        auto it = std::find_if(items.begin(), items.end(), [](const jsini_value_t& v) {
+            return ((const jsini_integer_t*)&v)->data == 3;
+        });
+        assert(it - items.begin() == 1);
+        assert(std::distance(it, items.end()) == 2);
+
+        jsini::Value::ArrayIterator last = items.end();
+        --last;
+        assert(((jsini_integer_t*)&*last)->data == 4);
+        assert(last > it && it >= items.begin());
+        assert(value.elements().empty());
+    }
+
+    // Object attributes via range-for
+    {
+        std::string keys;
+        for (jsini_attr_t& attr : value.entries()) {
+            keys += attr.name->data.data;
+        }
+        assert(keys == "abc");
+
+        auto entries = value.entries();
+        auto it = std::find_if(entries.begin(), entries.end(), [](const jsini_attr_t& attr) {
+            return !strcmp(attr.name->data.data, "c");
+        });
+        assert(it != entries.end());
+        assert(it->value->type == JSINI_TOBJECT);
+        assert(std::count_if(entries.begin(), entries.end(), [](const jsini_attr_t& attr) {
+                   return attr.value->type == JSINI_TINTEGER;
+               }) == 2);
+        assert(array.entries().empty());
+    }
 }
 
 static std::string to_string(jsini::Value& value, int options = 0, int indent = 0) {
@@ -517,9 +565,57 @@ static void test_vector_of_objects() {
     }
 }
 
+static void test_vector_of_numbers() {
+    {
+        jsini::Value value(std::string("[1, 2.5, 3]"));
+        std::vector<double> dst;
+        assert(value.to(dst) == JSINI_OK);
+        assert(dst.size() == 3);
+        assert(abs(dst[1] - 2.5) < eps);
+
+        std::vector<int64_t> ints;
+        assert(value.to(ints) == JSINI_ERROR);
+    }
+    {
+        jsini::Value value(jsini::Value::parse("{a: [4, 5, 6]}", JSINI_COMMENT | JSINI_PACK_ARRAYS));
+        std::vector<int64_t> ints;
+        assert(value["a"].to(ints) == JSINI_OK);
+        assert(ints.size() == 3 && ints[2] == 6);
+
+        std::vector<double> dst;
+        assert(value["a"].to(dst) == JSINI_OK);
+        assert(abs(dst[0] - 4) < eps);
+
+        assert(value["a"][1] == 5);
+        assert(value["a"].size() == 3);
+
+        // Element access and assignment keep the array packed
+        jsini_array_t *a = (jsini_array_t *) value["a"].raw();
+        value["a"][0] = 40;
+        assert(value["a"][0].is_integer());
+        assert((int) value["a"][0] == 40);
+        assert(a->packed == JSINI_TINTEGER);
+
+        value["a"].push(7);
+        assert(a->packed == JSINI_TINTEGER && value["a"].size() == 4);
+
+        value["a"][1] = 0.5;
+        assert(a->packed == 0);
+        assert(value["a"][1].is_number() && abs((double) value["a"][1] - 0.5) < eps);
+    }
+
+    {
+        jsini::Value value(jsini::Value::parse("[true, false]", JSINI_PACK_ARRAYS));
+        assert(((jsini_array_t *) value.raw())->packed == JSINI_TBOOL);
+        assert((int) value[0] == 1 && (int) value[1] == 0);
+        assert((double) value[0] == 1.0);
+    }
+}
+
 static void test_vector() {
     test_vector_of_pointers();
     test_vector_of_objects();
+    test_vector_of_numbers();
 }
 
 namespace ns3 {
@@ -649,6 +745,14 @@ static void test_to_map() {
 }
 
 static void test_lineno() {
+    assert(jsini_offset_lineno("a\nb\nc", 4) == 3);
+    {
+        jsini::Value value(jsini::Value::parse("{\n  a: 1\n}", JSINI_NO_LINENO));
+        assert(value.lineno() == 0);
+        assert(value["a"].lineno() == 0);
+        assert((int) value["a"] == 1);
+    }
+#ifndef JSINI_OMIT_LINENO
     std::string text = R"json({
         address: {
             country: "Australia",
@@ -669,6 +773,7 @@ static void test_lineno() {
     it++;
     assert(it.key().lineno() == 4);
     assert(it.value().lineno() == 5);
+#endif
 }
 
 static void test_jsonl() {
@@ -731,6 +836,39 @@ static void test_jsonl() {
 
         remove("test.jsonl");
     }
+
+    // Line reader: lines longer than a block, NUL bytes, no final newline
+    {
+        std::string big(JSB_READ_BLOCK + 100, 'x');
+        FILE* fp = fopen("test.jsonl", "wb");
+        fprintf(fp, "{\"s\": \"%s\"}\r\n", big.c_str());
+        fwrite("a\0b\n\n", 1, 5, fp);
+        fprintf(fp, "{\"n\": 7}");
+        fclose(fp);
+
+        fp = fopen("test.jsonl", "rb");
+        jsb_reader_t reader;
+        const char* line;
+        size_t size;
+        jsb_reader_init(&reader, fp);
+        assert(jsb_reader_getline(&reader, &line, &size) == JSB_OK);
+        assert(size == big.size() + 11 && line[size - 1] == '\n');
+        assert(jsb_reader_getline(&reader, &line, &size) == JSB_OK);
+        assert(size == 4 && memcmp(line, "a\0b\n", 4) == 0);
+        assert(jsb_reader_getline(&reader, &line, &size) == JSB_OK && size == 1);
+        assert(jsb_reader_getline(&reader, &line, &size) == JSB_OK);
+        assert(size == 8 && line[size] == '\0');
+        assert(jsb_reader_getline(&reader, &line, &size) == JSB_ERROR);
+        jsb_reader_clean(&reader);
+        fclose(fp);
+
+        // Nothing after a NUL byte is lost
+        jsini::Value value4(jsini::Value::from_jsonl_file("test.jsonl"));
+        assert(value4.size() == 3);
+        assert(std::string(value4[size_t(0)]["s"]) == big);
+        assert(value4[2]["n"] == 7);
+        remove("test.jsonl");
+    }
 }
 
 extern "C" {
@@ -739,6 +877,7 @@ extern "C" {
     void test_utf8();
     void test_csv();
     void test_jsini_c();
+    void test_tagged();
 }
 
 void test_jsl();
@@ -763,6 +902,10 @@ int main(int argc, char** argv) {
         test_csv();
     }
 
+    if (spec == "all" || spec == "tagged") {
+        test_tagged();
+    }
+
     if (spec == "jsini_c") {
         test_jsini_c();
     }
@@ -10,6 +10,36 @@ static int csv_check_cb(jsini_value_t *val, void *user_data)
     return JSINI_OK;
 }
 
+typedef struct
+{
+    jsini_array_t *rows;
+    uint32_t limit;
+} csv_stop_t;
+
+static int csv_stop_cb(jsini_value_t *val, void *user_data)
+{
+    csv_stop_t *stop = (csv_stop_t *)user_data;
+    jsini_push_value(stop->rows, val);
+    return jsini_array_size(stop->rows) < stop->limit ? JSINI_OK : JSINI_ERROR;
+}
+
+typedef struct
+{
+    int records;
+    int fields;
+    jsb_t last;
+} scan_stats_t;
+
+static int csv_scan_cb(const jsini_csv_field_t *fields, uint32_t count, void *user_data)
+{
+    scan_stats_t *stats = (scan_stats_t *)user_data;
+    stats->records++;
+    stats->fields += count;
+    jsb_clear(&stats->last);
+    jsini_csv_unescape(&fields[count - 1], &stats->last);
+    return JSINI_OK;
+}
+
 void test_csv()
 {
     printf("Testing CSV...\n");
@@ -209,5 +239,441 @@ void test_csv()
         jsini_free_array(result);
     }
 
+    // Test 10: Quoted field spanning many lines and read chunks, CRLF records
+    {
+        int i;
+        FILE *fp = fopen(filename, "w");
+        fprintf(fp, "id,\"");
+        for (i = 0; i < 20000; i++)
+            fprintf(fp, "line %d \"\"q\"\"\n", i);
+        fprintf(fp, "\"\r\n2,,x\r\n");
+        fclose(fp);
+
+        jsini_array_t *result = jsini_alloc_array();
+        int res = jsini_parse_file_csv_ex(filename, JSINI_CSV_DOUBLE_QUOTE, csv_check_cb, result);
+        assert(res == JSINI_OK);
+        assert(jsini_array_size(result) == 2);
+
+        jsini_array_t *row = (jsini_array_t *)jsini_aget(result, 0);
+        assert(jsini_array_size(row) == 2);
+        jsini_string_t *s = (jsini_string_t *)jsini_aget(row, 1);
+        assert(strncmp(s->data.data, "line 0 \"q\"\nline 1 ", 18) == 0);
+        assert(s->data.size > 20000 * 12);
+
+        row = (jsini_array_t *)jsini_aget(result, 1);
+        assert(jsini_array_size(row) == 3);
+        assert(strcmp(((jsini_string_t *)jsini_aget(row, 1))->data.data, "") == 0);
+        assert(strcmp(((jsini_string_t *)jsini_aget(row, 2))->data.data, "x") == 0);
+
+        jsini_free_array(result);
+    }
+
+    // Test 11: Field spans, including fields longer than a SIMD block
+    {
+        const char *csv_data =
+            "short,\"a much longer quoted field, with \"\"doubled\"\" quotes inside it\"\n"
+            "0123456789012345678901234567890123456789,x\r\n"
+            ",\"\"\"\"\"\"";
+        scan_stats_t stats = {0};
+        jsb_init(&stats.last);
+
+        assert(jsini_scan_csv(csv_data, strlen(csv_data), JSINI_CSV_DOUBLE_QUOTE,
+                              csv_scan_cb, &stats) == JSINI_OK);
+        assert(stats.records == 3);
+        assert(stats.fields == 6);
+        assert(strcmp(stats.last.data, "\"\"") == 0);
+
+        jsini_array_t *result = (jsini_array_t *)jsini_parse_string_csv(csv_data, strlen(csv_data));
+        jsini_object_t *row = (jsini_object_t *)jsini_aget(result, 0);
+        assert(strcmp(jsini_get_string(row, "short"), "0123456789012345678901234567890123456789") == 0);
+        assert(strcmp(jsini_get_string(row, "a much longer quoted field, with \"doubled\" quotes inside it"), "x") == 0);
+        jsini_free_array(result);
+        jsb_clean(&stats.last);
+    }
+
+    // Test 12: Parallel parsing gives the same records in the same order
+    {
+        uint32_t i;
+        FILE *fp = fopen(filename, "w");
+        fprintf(fp, "id,text,n\n");
+        for (i = 0; i < 60000; i++)
+        {
+            if (i % 7 == 0)
+                fprintf(fp, "%u,\"multi\nline, \"\"%u\"\"\r\n text\",%u\n", i, i, i * 3);
+            else if (i == 30001)
+            {
+                // A field longer than a parallel chunk, so records span chunks
+                int k;
+                fprintf(fp, "%u,\"", i);
+                for (k = 0; k < 1 << 20; k++)
+                    fputs(k % 65536 ? "ab,c\r\n" : "a,\"\"\n\r\n", fp);
+                fprintf(fp, "\",%u\n", i * 3);
+            }
+            else
+                fprintf(fp, "%u,plain text number %u,%u\n", i, i, i * 3);
+        }
+        fclose(fp);
+
+        jsini_array_t *seq = jsini_alloc_array();
+        jsini_array_t *par = jsini_alloc_array();
+        assert(jsini_parse_file_csv_ex(filename, JSINI_CSV_DEFAULT, csv_check_cb, seq) == JSINI_OK);
+        assert(jsini_parse_file_csv_ex(filename, JSINI_CSV_DEFAULT | JSINI_CSV_PARALLEL,
+                                       csv_check_cb, par) == JSINI_OK);
+        assert(jsini_array_size(seq) == 60000);
+
+        assert(jsini_array_size(par) == 60000);
+        for (i = 0; i < jsini_array_size(seq); i++)
+        {
+            jsini_object_t *r1 = (jsini_object_t *)jsini_aget(seq, i);
+            jsini_object_t *r2 = (jsini_object_t *)jsini_aget(par, i);
+            assert(strcmp(jsini_get_string(r1, "id"), jsini_get_string(r2, "id")) == 0);
+            assert(strcmp(jsini_get_string(r1, "text"), jsini_get_string(r2, "text")) == 0);
+            assert(strcmp(jsini_get_string(r1, "n"), jsini_get_string(r2, "n")) == 0);
+        }
+        assert(strcmp(jsini_get_string((jsini_object_t *)jsini_aget(par, 7), "text"),
+                      "multi\nline, \"7\"\r\n text") == 0);
+        assert(strlen(jsini_get_string((jsini_object_t *)jsini_aget(par, 30001), "text"))
+               == 6 << 20);
+
+        // A callback error stops the workers and drops the rows parsed ahead
+        csv_stop_t stop = {jsini_alloc_array(), 40000};
+        assert(jsini_parse_file_csv_ex(filename, JSINI_CSV_DEFAULT | JSINI_CSV_PARALLEL,
+                                       csv_stop_cb, &stop) == JSINI_ERROR);
+        assert(jsini_array_size(stop.rows) == 40000);
+        jsini_free_array(stop.rows);
+
+        jsini_free_array(seq);
+        jsini_free_array(par);
+    }
+
+    // Test 13: Type inference per field and per column
+    {
+        int i;
+        FILE *fp = fopen(filename, "w");
+        fprintf(fp, "id,price,flag,name,zip,note\n"
+                    "1,2.5,true,alice,00123,null\n"
+                    "-2,3,FALSE,\"42\",02134,\n"
+                    "3,1e3,true,1234567890123456789,0,x\n");
+        fclose(fp);
+
+        jsini_array_t *result = jsini_alloc_array();
+        assert(jsini_parse_file_csv_ex(filename, JSINI_CSV_DEFAULT | JSINI_CSV_INFER_TYPES,
+                                       csv_check_cb, result) == JSINI_OK);
+        assert(jsini_array_size(result) == 3);
+        jsini_object_t *r0 = (jsini_object_t *)jsini_aget(result, 0);
+        jsini_object_t *r1 = (jsini_object_t *)jsini_aget(result, 1);
+        jsini_object_t *r2 = (jsini_object_t *)jsini_aget(result, 2);
+        assert(jsini_type(jsini_get_value(r0, "id")) == JSINI_TINTEGER);
+        assert(((jsini_number_t *)jsini_get_value(r0, "price"))->data == 2.5);
+        assert(((jsini_bool_t *)jsini_get_value(r0, "flag"))->data == 1);
+        assert(strcmp(jsini_get_string(r0, "zip"), "00123") == 0);
+        assert(jsini_type(jsini_get_value(r0, "note")) == JSINI_TNULL);
+        assert(((jsini_integer_t *)jsini_get_value(r1, "id"))->data == -2);
+        assert(jsini_type(jsini_get_value(r1, "price")) == JSINI_TINTEGER);
+        assert(((jsini_bool_t *)jsini_get_value(r1, "flag"))->data == 0);
+        assert(strcmp(jsini_get_string(r1, "name"), "42") == 0);
+        assert(strcmp(jsini_get_string(r1, "note"), "") == 0);
+        assert(((jsini_number_t *)jsini_get_value(r2, "price"))->data == 1000);
+        assert(jsini_type(jsini_get_value(r2, "name")) == JSINI_TSTRING);
+        assert(jsini_type(jsini_get_value(r2, "zip")) == JSINI_TINTEGER);
+        jsini_free_array(result);
+
+        // A number column makes its integers numbers too
+        result = jsini_alloc_array();
+        assert(jsini_parse_file_csv_ex(filename, JSINI_CSV_DEFAULT | JSINI_CSV_INFER_COLUMNS,
+                                       csv_check_cb, result) == JSINI_OK);
+        r1 = (jsini_object_t *)jsini_aget(result, 1);
+        assert(jsini_type(jsini_get_value(r1, "id")) == JSINI_TINTEGER);
+        assert(((jsini_number_t *)jsini_get_value(r1, "price"))->data == 3);
+        assert(jsini_type(jsini_get_value(r1, "price")) == JSINI_TNUMBER);
+        jsini_free_array(result);
+
+        // A text column stays text past the sampled records
+        fp = fopen(filename, "w");
+        fprintf(fp, "code,n\n");
+        for (i = 0; i < JSINI_CSV_INFER_ROWS; i++)
+            fprintf(fp, "c%d,%d\n", i, i);
+        fprintf(fp, "7,0.5\n");
+        fclose(fp);
+
+        for (i = 0; i < 2; i++)
+        {
+            result = jsini_alloc_array();
+            assert(jsini_parse_file_csv_ex(filename, JSINI_CSV_DEFAULT | JSINI_CSV_INFER_COLUMNS
+                                           | (i ? JSINI_CSV_PARALLEL : 0),
+                                           csv_check_cb, result) == JSINI_OK);
+            assert(jsini_array_size(result) == JSINI_CSV_INFER_ROWS + 1);
+            r0 = (jsini_object_t *)jsini_aget(result, JSINI_CSV_INFER_ROWS);
+            assert(strcmp(jsini_get_string(r0, "code"), "7") == 0);
+            assert(((jsini_number_t *)jsini_get_value(r0, "n"))->data == 0.5);
+            jsini_free_array(result);
+        }
+
+        // A bool column reads bools, and other values still fall back
+        fp = fopen(filename, "w");
+        fprintf(fp, "flag\n");
+        for (i = 0; i < JSINI_CSV_INFER_ROWS; i++)
+            fprintf(fp, "%s\n", i % 2 ? "true" : "FALSE");
+        fprintf(fp, "maybe\n");
+        fclose(fp);
+
+        result = jsini_alloc_array();
+        assert(jsini_parse_file_csv_ex(filename, JSINI_CSV_DEFAULT | JSINI_CSV_INFER_COLUMNS,
+                                       csv_check_cb, result) == JSINI_OK);
+        r0 = (jsini_object_t *)jsini_aget(result, 0);
+        r1 = (jsini_object_t *)jsini_aget(result, 1);
+        assert(((jsini_bool_t *)jsini_get_value(r0, "flag"))->data == 0);
+        assert(((jsini_bool_t *)jsini_get_value(r1, "flag"))->data == 1);
+        r2 = (jsini_object_t *)jsini_aget(result, JSINI_CSV_INFER_ROWS);
+        assert(strcmp(jsini_get_string(r2, "flag"), "maybe") == 0);
+        jsini_free_array(result);
+    }
+
+    // Test 14: Columnar result with packed columns
+    {
+        FILE *fp = fopen(filename, "w");
+        fprintf(fp, "id,price,name,zip\n"
+                    "1,2,alice,00123\n"
+                    "2,2.5,\"bob, jr\"\n"
+                    "3,4,carol,7\n");
+        fclose(fp);
+
+        jsini_object_t *obj = (jsini_object_t *)jsini_parse_file_csv_columnar(filename,
+                JSINI_CSV_DEFAULT | JSINI_CSV_INFER_TYPES);
+        jsini_array_t *id = jsini_get_array(obj, "id");
+        jsini_array_t *price = jsini_get_array(obj, "price");
+        jsini_array_t *name = jsini_get_array(obj, "name");
+        jsini_array_t *zip = jsini_get_array(obj, "zip");
+        int64_t ids[3];
+
+        assert(jsini_object_size(obj) == 4);
+        assert(id->packed == JSINI_TINTEGER && jsini_array_to_int64(id, ids) == JSINI_OK);
+        assert(ids[0] == 1 && ids[2] == 3);
+        assert(price->packed == JSINI_TNUMBER);
+        assert(jsini_aget_number(price, 0) == 2 && jsini_aget_number(price, 1) == 2.5);
+        assert(name->packed == JSINI_TSTRING && jsini_array_size(name) == 3);
+        assert(strcmp(jsini_aget_string(name, 1), "bob, jr") == 0);
+        // Short record padded with null, mixed column boxed
+        assert(zip->packed == 0 && jsini_array_size(zip) == 3);
+        assert(jsini_atype(zip, 1) == JSINI_TNULL && jsini_atype(zip, 2) == JSINI_TINTEGER);
+        jsini_free((jsini_value_t *)obj);
+
+        // Without a header: an array of text columns
+        jsini_array_t *columns = (jsini_array_t *)jsini_parse_file_csv_columnar(filename, 0);
+        assert(columns->type == JSINI_TARRAY && jsini_array_size(columns) == 4);
+        name = (jsini_array_t *)jsini_aget(columns, 2);
+        assert(name->packed == JSINI_TSTRING && jsini_array_size(name) == 4);
+        assert(strcmp(jsini_aget_string(name, 0), "name") == 0);
+        jsini_free((jsini_value_t *)columns);
+    }
+
+    // Test 15: Rows share the header keys, repeated names keep the later column
+    {
+        FILE *fp = fopen(filename, "w");
+        fprintf(fp, "a,b,a\n1,2,3\n4\n5,6,7,8\n");
+        fclose(fp);
+
+        jsini_array_t *result = jsini_alloc_array();
+        assert(jsini_parse_file_csv_ex(filename, JSINI_CSV_DEFAULT, csv_check_cb, result) == JSINI_OK);
+        assert(jsini_array_size(result) == 3);
+        jsini_object_t *r0 = (jsini_object_t *)jsini_aget(result, 0);
+        jsini_object_t *r1 = (jsini_object_t *)jsini_aget(result, 1);
+        jsini_object_t *r2 = (jsini_object_t *)jsini_aget(result, 2);
+        assert(jsini_object_size(r0) == 2);
+        assert(strcmp(jsini_get_string(r0, "a"), "3") == 0);
+        assert(strcmp(((jsini_attr_t *)r0->keys.item[1])->name->data.data, "b") == 0);
+        assert(jsini_object_size(r1) == 1 && strcmp(jsini_get_string(r1, "a"), "4") == 0);
+        assert(strcmp(jsini_get_string(r2, "a"), "7") == 0);
+        assert(((jsini_attr_t *)r0->keys.item[0])->name == ((jsini_attr_t *)r2->keys.item[0])->name);
+
+        // Rows stay usable on their own after the others are gone
+        jsini_remove(r2, "b");
+        jsini_set_string(r2, "c", "x");
+        jsini_array_remove(result, 0);
+        jsini_array_remove(result, 0);
+        assert(jsini_object_size(r2) == 2 && strcmp(jsini_get_string(r2, "c"), "x") == 0);
+        jsini_free_array(result);
+    }
+
+    // Test 16: Streaming writer with explicit columns
+    {
+        const char *text = "{\"b\": 1, \"x\": {\"y\": [1]}}";
+        jsini_csv_writer_t *w = jsini_csv_writer_open("test_out_stream.csv", ',');
+        jsini_array_t *names = jsini_alloc_packed_array(JSINI_TSTRING);
+        jsini_array_t *row = jsini_alloc_packed_array(JSINI_TNUMBER);
+        jsini_value_t *obj = jsini_parse_string(text, strlen(text));
+        char buf[1024];
+
+        assert(w != NULL);
+        jsini_push_string(names, "a", 1);
+        jsini_push_string(names, "b", 1);
+        jsini_push_string(names, "x", 1);
+        assert(jsini_csv_writer_columns(w, names) == JSINI_OK);
+        assert(jsini_csv_write_row(w, obj) == JSINI_OK);
+        jsini_push_number(row, 2.5);
+        jsini_push_number(row, -1);
+        assert(jsini_csv_write_row(w, (jsini_value_t *)row) == JSINI_OK);
+        assert(jsini_csv_writer_columns(w, names) == JSINI_ERROR);
+        assert(jsini_csv_writer_close(w) == JSINI_OK);
+
+        FILE *fp = fopen("test_out_stream.csv", "r");
+        size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+        buf[n] = 0;
+        assert(strcmp(buf, "a,b,x\n,1,\"{\"\"y\"\":[1]}\"\n2.5,-1\n") == 0);
+        fclose(fp);
+
+        // A row that is not an object or array stops the writer
+        jsini_value_t *scalar = jsini_alloc_null();
+        w = jsini_csv_writer_open("test_out_stream.csv", ',');
+        assert(jsini_csv_write_row(w, (jsini_value_t *)row) == JSINI_OK);
+        assert(jsini_csv_write_row(w, scalar) == JSINI_ERROR);
+        assert(jsini_csv_write_row(w, (jsini_value_t *)row) == JSINI_ERROR);
+        assert(jsini_csv_writer_close(w) == JSINI_ERROR);
+        fp = fopen("test_out_stream.csv", "r");
+        n = fread(buf, 1, sizeof(buf) - 1, fp);
+        buf[n] = 0;
+        assert(strcmp(buf, "2.5,-1\n") == 0);
+        fclose(fp);
+        jsini_free(scalar);
+
+        jsini_free(obj);
+        jsini_free_array(names);
+        jsini_free_array(row);
+        remove("test_out_stream.csv");
+    }
+
+    // Test 17: Projection by name and index, sequential and parallel
+    {
+        uint32_t i;
+        int k;
+        FILE *fp = fopen(filename, "w");
+        fprintf(fp, "id,text,n,skip\n");
+        for (i = 0; i < 20000; i++)
+            fprintf(fp, "%u,\"long, \"\"quoted\"\"\n text %u\",%u,x\n", i, i, i * 3);
+        fprintf(fp, "20000,t");
+        fclose(fp);
+
+        for (k = 0; k < 2; k++)
+        {
+            int flags = JSINI_CSV_DEFAULT | JSINI_CSV_INFER_TYPES | (k ? JSINI_CSV_PARALLEL : 0);
+            jsini_array_t *result = jsini_alloc_array();
+            assert(jsini_parse_file_csv_select(filename, flags, "n,0", csv_check_cb, result)
+                   == JSINI_OK);
+            assert(jsini_array_size(result) == 20001);
+            for (i = 0; i < 20000; i++)
+            {
+                jsini_object_t *row = (jsini_object_t *)jsini_aget(result, i);
+                assert(jsini_object_size(row) == 2);
+                assert(strcmp(((jsini_attr_t *)row->keys.item[0])->name->data.data, "id") == 0);
+                assert(jsini_get_integer(row, "id") == (int)i);
+                assert(jsini_get_integer(row, "n") == (int)i * 3);
+            }
+            jsini_object_t *last = (jsini_object_t *)jsini_aget(result, 20000);
+            assert(jsini_object_size(last) == 1 && jsini_get_integer(last, "id") == 20000);
+            jsini_free_array(result);
+        }
+
+        // Without a header only indexes select
+        jsini_array_t *result = jsini_alloc_array();
+        assert(jsini_parse_file_csv_select(filename, JSINI_CSV_DOUBLE_QUOTE, "3,1", csv_check_cb,
+                                           result) == JSINI_OK);
+        jsini_array_t *row = (jsini_array_t *)jsini_aget(result, 1);
+        assert(jsini_array_size(row) == 2);
+        assert(strcmp(jsini_aget_string(row, 0), "long, \"quoted\"\n text 0") == 0);
+        assert(strcmp(jsini_aget_string(row, 1), "x") == 0);
+        assert(strcmp(jsini_aget_string((jsini_array_t *)jsini_aget(result, 20001), 0), "t") == 0);
+        jsini_free_array(result);
+
+        result = jsini_alloc_array();
+        assert(jsini_parse_file_csv_select(filename, JSINI_CSV_DEFAULT, "id,nope", csv_check_cb,
+                                           result) == JSINI_ERROR);
+        assert(jsini_parse_file_csv_select(filename, JSINI_CSV_DOUBLE_QUOTE, "id", csv_check_cb,
+                                           result) == JSINI_ERROR);
+        assert(jsini_array_size(result) == 0);
+        jsini_free_array(result);
+    }
+
+    // Test 18: Row filter on raw fields
+    {
+        int i, k;
+        FILE *fp = fopen(filename, "w");
+        fprintf(fp, "id,status,latency,note\n");
+        for (i = 0; i < 20000; i++)
+            fprintf(fp, "%d,%s,%d,\"say \"\"hi\"\" %d\"\n", i, i % 20 ? "ok" : "error",
+                    (i * 37) % 1000, i % 3);
+        fprintf(fp, "20000,error\n");
+        fclose(fp);
+
+        assert(jsini_csv_filter_compile("status ==") == NULL);
+        assert(jsini_csv_filter_compile("status ~ 1") == NULL);
+        assert(jsini_csv_filter_compile("a == 1 & b == 2") == NULL);
+
+        jsini_csv_filter_t *filter = jsini_csv_filter_compile(
+                "status == error && latency > 500 || note = \"say \\\"hi\\\" 1\" && id<=4");
+        assert(filter != NULL);
+        for (k = 0; k < 2; k++)
+        {
+            int flags = JSINI_CSV_DEFAULT | (k ? JSINI_CSV_PARALLEL : 0);
+            int expected = 0;
+            jsini_array_t *result = jsini_alloc_array();
+            assert(jsini_parse_file_csv_filter(filename, flags, "id", filter, csv_check_cb, result)
+                   == JSINI_OK);
+            for (i = 0; i < 20000; i++)
+            {
+                if (!((i % 20 == 0 && (i * 37) % 1000 > 500) || (i % 3 == 1 && i <= 4)))
+                    continue;
+                jsini_object_t *row = (jsini_object_t *)jsini_aget(result, expected);
+                char id[16];
+                sprintf(id, "%d", i);
+                assert(jsini_object_size(row) == 1);
+                assert(strcmp(jsini_get_string(row, "id"), id) == 0);
+                expected++;
+            }
+            // The short record has no latency, which is not a number
+            assert((int)jsini_array_size(result) == expected);
+            assert(strcmp(jsini_get_string((jsini_object_t *)jsini_aget(result, 0), "id"), "1") == 0);
+            jsini_free_array(result);
+        }
+        jsini_csv_filter_free(filter);
+
+        // Indexes without a header; names cannot be bound
+        filter = jsini_csv_filter_compile("0 < 2 || 2 != 0");
+        jsini_array_t *result = jsini_alloc_array();
+        assert(jsini_parse_file_csv_filter(filename, JSINI_CSV_DOUBLE_QUOTE, NULL, filter,
+                                           csv_check_cb, result) == JSINI_OK);
+        // All but latency 0 (every 1000th row from 1000), plus the header
+        // line and the short record, which are not numbers
+        assert(jsini_array_size(result) == 19983);
+        assert(jsini_array_size((jsini_array_t *)jsini_aget(result, 0)) == 4);
+        assert(strcmp(jsini_aget_string((jsini_array_t *)jsini_aget(result, 2), 0), "1") == 0);
+        jsini_free_array(result);
+        jsini_csv_filter_free(filter);
+
+        filter = jsini_csv_filter_compile("status == ok");
+        result = jsini_alloc_array();
+        assert(jsini_parse_file_csv_filter(filename, JSINI_CSV_DOUBLE_QUOTE, NULL, filter,
+                                           csv_check_cb, result) == JSINI_ERROR);
+        jsini_csv_filter_free(filter);
+        filter = jsini_csv_filter_compile("\"no such\" == ok");
+        assert(jsini_parse_file_csv_filter(filename, JSINI_CSV_DEFAULT, NULL, filter,
+                                           csv_check_cb, result) == JSINI_ERROR);
+        assert(jsini_array_size(result) == 0);
+        jsini_csv_filter_free(filter);
+        jsini_free_array(result);
+
+        // Literals outside the JSON number grammar compare as text
+        fp = fopen(filename, "w");
+        fprintf(fp, "name,n\nnan,1\ninf,2\n0x1p3,3\n8,4\n");
+        fclose(fp);
+        filter = jsini_csv_filter_compile("name == nan || name == inf || name == 0x1p3");
+        result = jsini_alloc_array();
+        assert(jsini_parse_file_csv_filter(filename, JSINI_CSV_DEFAULT, "n", filter,
+                                           csv_check_cb, result) == JSINI_OK);
+        assert(jsini_array_size(result) == 3);
+        assert(strcmp(jsini_get_string((jsini_object_t *)jsini_aget(result, 2), "n"), "3") == 0);
+        jsini_csv_filter_free(filter);
+        jsini_free_array(result);
+    }
+
     remove(filename);
 }
@@ -34,5 +34,140 @@ void test_jsini_c() {
         jsini_free_object(obj);
     }
 
+    // Test bulk extraction from boxed arrays
+    {
+        jsini_array_t *array = jsini_alloc_array();
+        int64_t ints[5];
+        double nums[5];
+
+        jsini_push_integer(array, 1);
+        jsini_push_integer(array, -2);
+        jsini_push_integer(array, 3);
+
+        assert(jsini_array_to_int64(array, ints) == JSINI_OK);
+        assert(ints[0] == 1 && ints[1] == -2 && ints[2] == 3);
+        assert(jsini_array_to_double(array, nums) == JSINI_OK);
+        assert(nums[1] == -2.0);
+
+        jsini_push_number(array, 0.5);
+        assert(jsini_array_to_int64(array, ints) == JSINI_ERROR);
+        jsini_push_string(array, "x", 1);
+        assert(jsini_array_to_double(array, nums) == JSINI_ERROR);
+
+        jsini_free_array(array);
+    }
+
+    // Test packed arrays from the parser
+    {
+        const char *text = "{a: [1, 2, 3], b: [0.5, 1.5], c: [1, 2.5], d: []}";
+        jsini_object_t *obj = (jsini_object_t *)jsini_parse_string_ex(text,
+                strlen(text), JSINI_COMMENT | JSINI_PACK_ARRAYS);
+        jsini_array_t *a = jsini_get_array(obj, "a");
+        jsini_array_t *b = jsini_get_array(obj, "b");
+        jsini_array_t *c = jsini_get_array(obj, "c");
+        int64_t ints[3];
+        double nums[3];
+        jsb_t sb;
+
+        assert(a->packed == JSINI_TINTEGER);
+        assert(b->packed == JSINI_TNUMBER);
+        assert(c->packed == 0);
+        assert(jsini_get_array(obj, "d")->packed == 0);
+
+        assert(jsini_array_to_int64(a, ints) == JSINI_OK);
+        assert(ints[0] == 1 && ints[2] == 3);
+        assert(jsini_array_to_double(a, nums) == JSINI_OK);
+        assert(nums[2] == 3.0);
+        assert(jsini_array_to_int64(b, ints) == JSINI_ERROR);
+        assert(jsini_array_to_double(b, nums) == JSINI_OK);
+        assert(nums[0] == 0.5 && nums[1] == 1.5);
+
+        jsb_init(&sb);
+        jsini_stringify((jsini_value_t *)obj, &sb, 0, 0);
+        assert(strcmp(sb.data, "{\"a\":[1,2,3],\"b\":[0.5,1.5],\"c\":[1,2.5],\"d\":[]}") == 0);
+        jsb_clean(&sb);
+
+        // Element access unpacks the array
+        jsini_value_t *v = jsini_aget(b, 1);
+        assert(b->packed == 0);
+        assert(v->type == JSINI_TNUMBER && ((jsini_number_t *)v)->data == 1.5);
+
+        jsini_array_remove(a, 0);
+        assert(a->packed == JSINI_TINTEGER && jsini_array_size(a) == 2);
+        jsini_push_string(a, "x", 1);
+        assert(a->packed == 0 && jsini_array_size(a) == 3);
+        assert(((jsini_integer_t *)jsini_aget(a, 0))->data == 2);
+
+        jsini_free((jsini_value_t *)obj);
+    }
+
+    {
+        const char *text = "[true, false, true]";
+        jsini_array_t *flags = (jsini_array_t *)jsini_parse_string_ex(text,
+                strlen(text), JSINI_PACK_ARRAYS);
+        jsini_array_t *nums = jsini_alloc_packed_array(JSINI_TNUMBER);
+        jsb_t sb;
+
+        assert(flags->packed == JSINI_TBOOL);
+        assert(jsini_atype(flags, 1) == JSINI_TBOOL);
+        assert(jsini_aget_bool(flags, 0) == 1 && jsini_aget_bool(flags, 1) == 0);
+        assert(jsini_aget_integer(flags, 0) == 1 && jsini_aget_number(flags, 1) == 0);
+        jsini_array_set_bool(flags, 1, 1);
+        jsini_push_bool(flags, 0);
+        assert(flags->packed == JSINI_TBOOL && jsini_array_size(flags) == 4);
+
+        jsb_init(&sb);
+        jsini_stringify((jsini_value_t *)flags, &sb, 0, 0);
+        assert(strcmp(sb.data, "[true,true,true,false]") == 0);
+        jsb_clean(&sb);
+
+        // Typed pushes and matching nodes keep the array packed
+        jsini_push_number(nums, 0.25);
+        jsini_push_value(nums, (jsini_value_t *)jsini_alloc_number(2.5));
+        jsini_array_set_number(nums, 0, 1.25);
+        assert(nums->packed == JSINI_TNUMBER && jsini_array_size(nums) == 2);
+        assert(jsini_aget_number(nums, 0) == 1.25);
+        assert(jsini_aget_integer(nums, 1) == 2);
+        assert(jsini_atype(nums, 2) == JSINI_UNDEFINED);
+
+        // A value of another type promotes it to boxed nodes
+        jsini_push_integer(nums, 7);
+        assert(nums->packed == 0 && jsini_array_size(nums) == 3);
+        assert(jsini_atype(nums, 2) == JSINI_TINTEGER);
+        assert(jsini_aget_number(nums, 1) == 2.5);
+
+        jsini_free((jsini_value_t *)flags);
+        jsini_free((jsini_value_t *)nums);
+    }
+
+    {
+        jsini_array_t *names = jsini_alloc_packed_array(JSINI_TSTRING);
+        size_t size;
+        jsb_t sb;
+
+        // Strings go into one buffer, including empty ones
+        jsini_push_string(names, "ab", 2);
+        jsini_push_string(names, "", 0);
+        jsini_push_value(names, (jsini_value_t *)jsini_alloc_string("q\"x", 3));
+        assert(names->packed == JSINI_TSTRING && jsini_array_size(names) == 3);
+        assert(jsini_atype(names, 1) == JSINI_TSTRING);
+        assert(strcmp(jsini_aget_string(names, 0), "ab") == 0);
+        assert(strcmp(jsini_array_get_string(names, 1, &size), "") == 0 && size == 0);
+        assert(strcmp(jsini_array_get_string(names, 2, &size), "q\"x") == 0 && size == 3);
+        assert(jsini_aget_integer(names, 0) == 0);
+
+        jsb_init(&sb);
+        jsini_stringify((jsini_value_t *)names, &sb, 0, 0);
+        assert(strcmp(sb.data, "[\"ab\",\"\",\"q\\\"x\"]") == 0);
+        jsb_clean(&sb);
+
+        // Removing or boxed access unpacks
+        jsini_array_remove(names, 0);
+        assert(names->packed == 0 && jsini_array_size(names) == 2);
+        assert(strcmp(jsini_aget_string(names, 1), "q\"x") == 0);
+
+        jsini_free((jsini_value_t *)names);
+    }
+
     printf("JSINI C API Tests Passed.\n");
 }
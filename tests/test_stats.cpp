@@ -195,5 +195,229 @@ void test_stats() {
 
         jsh_free_ex(stats, free_stats_entry);
     }
+
+    // Case 7: Maps collected from parts merge into the map of the whole
+    {
+        const char* lines[] = {
+            R"json({"id": 1, "tags": [{"k": "a"}], "meta": {"x": 1}})json",
+            R"json({"id": 2, "meta": {"y": 2}})json",
+            R"json({"id": 3, "tags": [{"k": "b", "v": 1}, {"v": 2}]})json",
+            R"json({"other": true})json",
+        };
+        jsh_t* whole = jsh_create_simple(32, 0);
+        jsh_t* parts[2] = { jsh_create_simple(32, 0), jsh_create_simple(32, 0) };
+        jsh_t* merged = jsh_create_simple(32, 0);
+
+        for (int i = 0; i < 4; i++) {
+            jsini::Value val{std::string(lines[i])};
+            jsini_collect_key_stats(val.raw(), whole);
+            jsini_collect_key_stats(val.raw(), parts[i % 2]);
+        }
+        jsini_merge_key_stats(merged, parts[0]);
+        jsini_merge_key_stats(merged, parts[1]);
+
+        assert(jsh_count(merged) == jsh_count(whole));
+        for (const jsh_iterator_t* it = jsh_first(whole); it; it = jsh_next(whole, it)) {
+            jsini_key_stats_t* expected = (jsini_key_stats_t*)it->value;
+            jsini_key_stats_t* actual = (jsini_key_stats_t*)jsh_get(merged, it->key);
+            assert(actual && actual->object_count == expected->object_count);
+            assert(jsh_count(actual->key_frequencies) == jsh_count(expected->key_frequencies));
+            for (const jsh_iterator_t* kt = jsh_first(expected->key_frequencies); kt;
+                 kt = jsh_next(expected->key_frequencies, kt)) {
+                assert(jsh_get_int(actual->key_frequencies, kt->key)
+                       == jsh_get_int(expected->key_frequencies, kt->key));
+            }
+        }
+        assert(jsh_get_int(((jsini_key_stats_t*)jsh_get(merged, "root"))->key_frequencies, "id") == 3);
+        assert(((jsini_key_stats_t*)jsh_get(merged, "root.tags"))->object_count == 3);
+
+        jsh_free_ex(whole, free_stats_entry);
+        jsh_free_ex(parts[0], free_stats_entry);
+        jsh_free_ex(parts[1], free_stats_entry);
+        jsh_free_ex(merged, free_stats_entry);
+    }
+
+    // Case 8: Value profiles, collected whole and in two merged parts
+    {
+        jsh_t* whole = jsh_create_simple(32, 0);
+        jsh_t* merged = jsh_create_simple(32, 0);
+        jsini_key_stats_collector_t* all = jsini_key_stats_collector_create_ex(JSINI_STATS_VALUES);
+        jsini_key_stats_collector_t* parts[2] = {
+            jsini_key_stats_collector_create_ex(JSINI_STATS_VALUES),
+            jsini_key_stats_collector_create_ex(JSINI_STATS_VALUES),
+        };
+
+        for (int i = 0; i < 20000; i++) {
+            std::string line = "{\"id\": " + std::to_string(i) + ", \"kind\": \""
+                + (i % 10 == 0 ? "rare" : "common") + "\", \"score\": "
+                + (i % 2 ? "0.5" : "null") + "}";
+            jsini::Value val(line);
+            jsini_key_stats_collector_add(all, val.raw());
+            jsini_key_stats_collector_add(parts[i % 2], val.raw());
+        }
+        jsini_key_stats_collector_flush(all, whole);
+        jsini_key_stats_collector_flush(parts[0], merged);
+        jsini_key_stats_collector_flush(parts[1], merged);
+
+        jsh_t* maps[2] = { whole, merged };
+        for (int m = 0; m < 2; m++) {
+            jsini_key_stats_t* id = (jsini_key_stats_t*)jsh_get(maps[m], "root.id");
+            assert(id && id->key_frequencies == nullptr && id->values);
+            assert(id->values->type_counts[JSINI_TINTEGER] == 20000);
+            assert(id->values->number_min == 0 && id->values->number_max == 19999);
+            double distinct = jsini_value_stats_distinct(id->values);
+            assert(id->values->registers && distinct > 19000 && distinct < 21000);
+
+            jsini_value_stats_t* kind = ((jsini_key_stats_t*)jsh_get(maps[m], "root.kind"))->values;
+            assert(kind->string_count == 20000 && jsini_value_stats_distinct(kind) == 2);
+            assert(kind->length_min == 4 && kind->length_max == 6 && kind->lengths[3] == 20000);
+            assert(kind->top_count == 2);
+            for (uint32_t i = 0; i < kind->top_count; i++) {
+                assert(kind->top[i].error == 0);
+                assert(kind->top[i].count == (strcmp(kind->top[i].text, "\"rare\"") ? 18000 : 2000));
+            }
+
+            jsini_value_stats_t* score = ((jsini_key_stats_t*)jsh_get(maps[m], "root.score"))->values;
+            assert(score->type_counts[JSINI_TNULL] == 10000 && score->type_counts[JSINI_TNUMBER] == 10000);
+            assert(score->number_count == 10000 && score->number_sum == 5000);
+
+            jsini_value_stats_t* root = ((jsini_key_stats_t*)jsh_get(maps[m], "root"))->values;
+            assert(root->type_counts[JSINI_TOBJECT] == 20000);
+        }
+
+        jsini_key_stats_collector_free(all);
+        jsini_key_stats_collector_free(parts[0]);
+        jsini_key_stats_collector_free(parts[1]);
+        jsh_free_ex(whole, free_stats_entry);
+        jsh_free_ex(merged, free_stats_entry);
+    }
+
+    // Case 9: Packed array elements are profiled at the path of the array
+    {
+        const char* text = R"json({"v": [3, 1, 2], "s": ["ab", "ab"]})json";
+        jsini_value_t* value = jsini_parse_string_ex(text, strlen(text), JSINI_PACK_ARRAYS);
+        jsh_t* stats = jsh_create_simple(32, 0);
+        jsini_key_stats_collector_t* c = jsini_key_stats_collector_create_ex(JSINI_STATS_VALUES);
+
+        jsini_key_stats_collector_add(c, value);
+        jsini_key_stats_collector_flush(c, stats);
+
+        jsini_value_stats_t* v = ((jsini_key_stats_t*)jsh_get(stats, "root.v"))->values;
+        assert(v->type_counts[JSINI_TARRAY] == 1 && v->type_counts[JSINI_TINTEGER] == 3);
+        assert(v->number_min == 1 && v->number_max == 3 && jsini_value_stats_distinct(v) == 3);
+        jsini_value_stats_t* s = ((jsini_key_stats_t*)jsh_get(stats, "root.s"))->values;
+        assert(s->type_counts[JSINI_TSTRING] == 2 && s->top[0].count == 2);
+
+        jsini_key_stats_collector_free(c);
+        jsh_free_ex(stats, free_stats_entry);
+        jsini_free(value);
+    }
+
+    // Case 10: Counting from the lexer matches counting parsed values
+    {
+        const char* text =
+            "{a: 1, 'b': \"x\", `c`: [1, [2, {d: null}], ()], e => {f = true}}\n"
+            "{\"s\": \"t\\tu\", \"bare\": hello, \"arr\": [{\"k\": 1}, {\"k\": \"v\"}, []]}\n"
+            "  {\"x\": {}}   [\"top\", {\"a\": 0.5}]\n";
+        jsh_t* parsed = jsh_create_simple(32, 0);
+        jsh_t* lexed = jsh_create_simple(32, 0);
+        jsini_key_stats_collector_t* c = jsini_key_stats_collector_create_ex(JSINI_STATS_VALUES);
+        jsini_value_t* values = jsini_parse_string_jsonl(text, strlen(text));
+
+        for (uint32_t i = 0; i < jsini_array_size((jsini_array_t*)values); i++) {
+            jsini_key_stats_collector_add(c, jsini_aget((jsini_array_t*)values, i));
+        }
+        jsini_key_stats_collector_flush(c, parsed);
+        jsini_key_stats_collector_free(c);
+
+        c = jsini_key_stats_collector_create_ex(JSINI_STATS_VALUES);
+        assert(jsini_key_stats_collector_add_json(c, text, strlen(text)) == 4);
+        jsini_key_stats_collector_flush(c, lexed);
+
+        assert(jsh_count(lexed) == jsh_count(parsed));
+        for (const jsh_iterator_t* it = jsh_first(parsed); it; it = jsh_next(parsed, it)) {
+            jsini_key_stats_t* expected = (jsini_key_stats_t*)it->value;
+            jsini_key_stats_t* actual = (jsini_key_stats_t*)jsh_get(lexed, it->key);
+            assert(actual && actual->object_count == expected->object_count);
+            assert(!actual->key_frequencies == !expected->key_frequencies);
+            if (expected->key_frequencies) {
+                assert(jsh_count(actual->key_frequencies) == jsh_count(expected->key_frequencies));
+                for (const jsh_iterator_t* kt = jsh_first(expected->key_frequencies); kt;
+                     kt = jsh_next(expected->key_frequencies, kt)) {
+                    assert(jsh_get_int(actual->key_frequencies, kt->key)
+                           == jsh_get_int(expected->key_frequencies, kt->key));
+                }
+            }
+            assert(memcmp(actual->values->type_counts, expected->values->type_counts,
+                          sizeof(expected->values->type_counts)) == 0);
+            assert(actual->values->length_sum == expected->values->length_sum);
+            assert(actual->values->number_sum == expected->values->number_sum);
+            assert(actual->values->sparse_count == expected->values->sparse_count);
+        }
+        assert(jsh_get_int(((jsini_key_stats_t*)jsh_get(lexed, "root"))->key_frequencies, "a") == 2);
+
+        // A broken value is an error, after the values before it were counted
+        assert(jsini_key_stats_collector_add_json(c, "{\"z\": [1", 9) == JSINI_ERROR_NOT_CLOSED);
+        {
+            const char* broken = "{\"a\": 1}\n{\"a\": 2, \"b\": \"x\"}\n{\"a\" 1}\n";
+            jsh_t* stats = jsh_create_simple(32, 0);
+            jsini_key_stats_collector_t* d = jsini_key_stats_collector_create_ex(JSINI_STATS_VALUES);
+            assert(jsini_key_stats_collector_add_json(d, broken, strlen(broken)) == JSINI_ERROR_SEPARATOR);
+            jsini_key_stats_collector_flush(d, stats);
+            jsini_key_stats_collector_free(d);
+
+            jsini_key_stats_t* root = (jsini_key_stats_t*)jsh_get(stats, "root");
+            jsini_key_stats_t* a = (jsini_key_stats_t*)jsh_get(stats, "root.a");
+            assert(root->object_count == 2);
+            assert(jsh_get_int(root->key_frequencies, "a") == 2);
+            assert(a->values->type_counts[JSINI_TINTEGER] == 2);
+            jsh_free_ex(stats, free_stats_entry);
+        }
+
+        // Input cut anywhere is read only up to its end; ASan catches a read
+        // past these unterminated copies
+        const char* cut[] = { "{\"a\"\n", "{\"a\" ", "{\"a\": 12", "{\"a\": -1e", "{\"a\": 1 /", "7" };
+        for (const char* line : cut) {
+            size_t len = strlen(line);
+            char* copy = (char*)malloc(len);
+            memcpy(copy, line, len);
+            int n = jsini_key_stats_collector_add_json(c, copy, len);
+            assert(line[0] == '7' ? n == 1 : n < 0);
+            jsini_value_t* value = jsini_parse_string(copy, len);
+            if (value) jsini_free(value);
+            free(copy);
+        }
+
+        jsini_key_stats_collector_free(c);
+        jsini_free(values);
+        jsh_free_ex(parsed, free_stats_entry);
+        jsh_free_ex(lexed, free_stats_entry);
+    }
+
+    // Case 11: Sampled stats print 95% intervals of the ratios
+    {
+        jsh_t* stats = jsh_create_simple(32, 0);
+        jsini_key_stats_collector_t* c = jsini_key_stats_collector_create();
+        for (int i = 0; i < 100; i++) {
+            const char* line = i % 4 ? "{\"a\": 1}" : "{\"a\": 1, \"b\": 2}";
+            jsini_key_stats_collector_add_json(c, line, strlen(line));
+        }
+        jsini_key_stats_collector_flush(c, stats);
+        jsini_key_stats_collector_free(c);
+
+        char buffer[512];
+        FILE* out = tmpfile();
+        jsini_print_key_stats_ex(out, stats, -1, 0.0, JSINI_STATS_SAMPLED);
+        rewind(out);
+        size_t n = fread(buffer, 1, sizeof(buffer) - 1, out);
+        buffer[n] = '\0';
+        fclose(out);
+
+        assert(strstr(buffer, ". (root, 100 objects sampled)") != nullptr);
+        assert(strstr(buffer, "a (freq 100, 100.0%, 95% CI 96.3-100.0%)") != nullptr);
+        assert(strstr(buffer, "b (freq 25, 25.0%, 95% CI 17.5-34.3%)") != nullptr);
+
+        jsh_free_ex(stats, free_stats_entry);
+    }
 }
 
@@ -0,0 +1,94 @@
+#include "jsini.h"
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+void test_tagged()
+{
+#ifdef JSINI_TAGGED_VALUES
+    printf("Testing tagged values...\n");
+
+    // Scalars are inline words
+    {
+        assert(sizeof(jsini_tval_t) == 8);
+        assert(jsini_tval_type(JSINI_TVAL_NULL) == JSINI_TNULL);
+        assert(jsini_tval_type(jsini_tval_bool(1)) == JSINI_TBOOL);
+        assert(jsini_tval_get_bool(jsini_tval_bool(1)) == 1);
+        assert(jsini_tval_get_bool(jsini_tval_bool(0)) == 0);
+
+        assert(jsini_tval_type(jsini_tval_number(-2.5)) == JSINI_TNUMBER);
+        assert(jsini_tval_get_number(jsini_tval_number(-2.5)) == -2.5);
+        assert(jsini_tval_type(jsini_tval_number(NAN)) == JSINI_TNUMBER);
+        assert(jsini_tval_type(jsini_tval_number(-INFINITY)) == JSINI_TNUMBER);
+
+        assert(jsini_tval_get_integer(jsini_tval_integer(-42)) == -42);
+        assert(jsini_tval_get_integer(jsini_tval_integer(((int64_t)1 << 47) - 1))
+                == ((int64_t)1 << 47) - 1);
+
+        // Wider integers are boxed
+        jsini_tval_t wide = jsini_tval_integer(INT64_MIN);
+        assert(jsini_tval_type(wide) == JSINI_TINTEGER);
+        assert(jsini_tval_get_integer(wide) == INT64_MIN);
+        jsini_tval_free(wide);
+    }
+
+    // Parsing, access and stringify
+    {
+        const char *text = "{a: [1, 2.5, true, null, \"x\"], b: {c: -7}, a: [3]}";
+        jsini_tval_t root = jsini_tval_parse_string(text, strlen(text), JSINI_COMMENT);
+        jsini_tval_t a = jsini_tval_get(root, "a");
+        jsb_t sb;
+
+        assert(jsini_tval_type(root) == JSINI_TOBJECT);
+        assert(jsini_tval_size(root) == 2);
+        assert(jsini_tval_size(a) == 1);
+        assert(jsini_tval_get_integer(jsini_tval_aget(a, 0)) == 3);
+        assert(jsini_tval_get_integer(jsini_tval_get(jsini_tval_get(root, "b"), "c")) == -7);
+        assert(jsini_tval_get(root, "z") == JSINI_TVAL_UNDEFINED);
+        assert(strcmp(jsini_tval_attr(root, 1)->name->data.data, "b") == 0);
+
+        jsini_tval_set(root, "s", jsini_tval_string("hi", 2));
+        jsini_tval_push(a, jsini_tval_number(0.5));
+        assert(jsini_tval_push(root, JSINI_TVAL_NULL) == JSINI_ERROR);
+
+        jsb_init(&sb);
+        jsini_tval_stringify(root, &sb, JSINI_SORT_KEYS, 0);
+        assert(strcmp(sb.data, "{\"a\":[3,0.5],\"b\":{\"c\":-7},\"s\":\"hi\"}") == 0);
+        jsb_clean(&sb);
+
+        jsini_tval_free(root);
+
+        text = "[1, 2";
+        assert(jsini_tval_parse_string(text, strlen(text), 0) == JSINI_TVAL_UNDEFINED);
+    }
+
+    // Round trip through the classic tree gives the same output
+    {
+        const char *text = "{a: [1, 2.5, true, null, \"x\"], b: {c: [[]], d: {}}}";
+        jsini_value_t *value = jsini_parse_string_ex(text, strlen(text),
+                JSINI_COMMENT | JSINI_PACK_ARRAYS);
+        jsini_tval_t tval = jsini_tval_from_value(value);
+        jsini_value_t *back = jsini_tval_to_value(tval);
+        jsb_t s1, s2, s3;
+
+        jsb_init(&s1);
+        jsb_init(&s2);
+        jsb_init(&s3);
+        jsini_stringify(value, &s1, JSINI_PRETTY_PRINT, 2);
+        jsini_tval_stringify(tval, &s2, JSINI_PRETTY_PRINT, 2);
+        jsini_stringify(back, &s3, JSINI_PRETTY_PRINT, 2);
+        assert(strcmp(s1.data, s2.data) == 0);
+        assert(strcmp(s1.data, s3.data) == 0);
+        jsb_clean(&s1);
+        jsb_clean(&s2);
+        jsb_clean(&s3);
+
+        jsini_free(value);
+        jsini_free(back);
+        jsini_tval_free(tval);
+    }
+
+    printf("Tagged value tests passed.\n");
+#endif
+}